@@ -29,6 +29,7 @@ protected:
   bool openRoute();
 public:
   ChanEndpoint();
+  virtual ~ChanEndpoint() {}
   /// Give notification that a route to the destination has been opened.
   virtual void notifyDestClaimed(ticks_t time) = 0;
 
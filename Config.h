@@ -48,6 +48,37 @@
 /// Size of the (input) buffer in a chanend.
 #define CHANEND_BUFFER_SIZE 8
 
+/// Maximum number of undelivered tokens buffered on a route between cores
+/// in parallel quantum mode.
+#define QUANTUM_CHANNEL_BUFFER_SIZE 1024
+
+/// Default number of executions of a fragment compiled by the JIT's
+/// baseline tier before it is recompiled with the optimizing tier.
+#define JIT_TIER_UP_THRESHOLD 10000
+
+/// Maximum number of fragments the JIT compiles into a single function.
+#define JIT_MAX_REGION_FRAGMENTS 16
+
+/// Number of times a successor of a fragment must have been reached before
+/// the JIT adds it to the region being compiled.
+#define JIT_REGION_SUCCESSOR_THRESHOLD 32
+
+/// Maximum number of targets of an indirect branch that the JIT's optimizing
+/// tier checks for before returning to the dispatch loop.
+#define JIT_INLINE_CACHE_SIZE 4
+
+/// Number of entries in each thread's return address stack.
+#define JIT_RETURN_ADDRESS_STACK_SIZE 16
+
+/// Default number of cycles between the samples taken by the profiler.
+#define PROFILE_DEFAULT_INTERVAL 10000
+
+/// Maximum number of frames the profiler unwinds for each sample.
+#define PROFILE_MAX_STACK_DEPTH 64
+
+/// Size in bytes of the buffer used to write binary traces.
+#define TRACE_BUFFER_SIZE (1 << 20)
+
 /// Number of processor cycles per 100MHz timer tick
 #define CYCLES_PER_TICK 4
 
@@ -57,12 +88,54 @@ typedef uint64_t ticks_t;
 
 #ifdef __GNUC__
 #define UNUSED(x) x __attribute__((__unused__))
+/// The threaded interpreter uses the labels as values extension.
+#define THREADED_INTERPRETER 1
 #endif // __GNUC__
 
+#ifndef THREADED_INTERPRETER
+#define THREADED_INTERPRETER 0
+#endif
+
 #ifndef UNUSED
 #define UNUSED(x) x
 #endif
 
+/// Whether each core's memory is placed in a reservation of host address
+/// space covering the whole 32-bit address space. Loads and stores outside
+/// of memory then fault on the host instead of being checked by the
+/// interpreter and the JIT's baseline tier.
+#ifndef GUARDED_MEMORY
+#if defined(__GNUC__) && defined(__LP64__) && !defined(_WIN32)
+#define GUARDED_MEMORY 1
+#else
+#define GUARDED_MEMORY 0
+#endif
+#endif
+
+/// Whether writes to code are detected by write protecting the host pages
+/// holding memory which has been decoded or compiled instead of checking the
+/// invalidation info on every store made by the interpreter. Requires
+/// GUARDED_MEMORY. Only the interpreter's stores skip the check. Stores made
+/// by JIT compiled code still check the invalidation info and also check
+/// whether the page is protected, since compiled code can't retry a store
+/// which faults. Off by default until the self modifying code tests have
+/// been run with it enabled.
+#ifndef PAGE_PROTECTED_CODE
+#define PAGE_PROTECTED_CODE 0
+#endif
+
+#if PAGE_PROTECTED_CODE && !GUARDED_MEMORY
+#error "PAGE_PROTECTED_CODE requires GUARDED_MEMORY"
+#endif
+
+/// Number of writes to code on a page after which the page is no longer
+/// protected and the code on it is interpreted without being cached.
+#define CODE_PAGE_FAULT_LIMIT 16
+
+/// Size in bytes of a host cache line. Each core's decode cache is aligned to
+/// this size.
+#define HOST_CACHE_LINE_SIZE 64
+
 #if defined(BOOST_LITTLE_ENDIAN)
 #define HOST_LITTLE_ENDIAN 1
 #elif defined(BOOST_BIG_ENDIAN)
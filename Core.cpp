@@ -12,15 +12,111 @@
 #include "Lock.h"
 #include "Chanend.h"
 #include "ClockBlock.h"
+#include "HostMemory.h"
+#include <cstdlib>
 #include <iostream>
 #include <iomanip>
 #include <sstream>
 
 
+#if GUARDED_MEMORY
+size_t Core::getMemoryReservationSize()
+{
+  // Leave room for a word access at the top of the address space.
+  return (size_t(1) << 32) + HostMemory::getPageSize();
+}
+
+/// Reserve host address space for the whole 32-bit address space and commit
+/// the part of it used for memory.
+static uint32_t *allocateMemory(uint32_t RamSize, uint32_t RamBase)
+{
+  size_t pageSize = HostMemory::getPageSize();
+  if (RamSize % pageSize != 0 || RamBase % pageSize != 0) {
+    std::cerr << "Error: memory must be aligned to the host page size\n";
+    std::exit(1);
+  }
+  char *reservation = static_cast<char*>(
+    HostMemory::reserve(Core::getMemoryReservationSize()));
+  if (!reservation || !HostMemory::commit(reservation + RamBase, RamSize)) {
+    std::cerr << "Error: failed to reserve memory\n";
+    std::exit(1);
+  }
+  HostMemory::installFaultHandler();
+  return reinterpret_cast<uint32_t*>(reservation + RamBase);
+}
+#else
+static uint32_t *allocateMemory(uint32_t RamSize, uint32_t RamBase)
+{
+  return new uint32_t[RamSize >> 2];
+}
+#endif
+
+#if GUARDED_MEMORY
+/// Allocate zero filled memory using anonymous host pages. The pages are only
+/// backed by memory once they are written so the caches of idle cores are
+/// almost free.
+static char *allocateZeroed(size_t size)
+{
+  void *address = HostMemory::allocateZeroed(size);
+  if (!address) {
+    std::cerr << "Error: failed to allocate memory\n";
+    std::exit(1);
+  }
+  return static_cast<char*>(address);
+}
+
+static void releaseZeroed(char *address, size_t size)
+{
+  HostMemory::release(address, size);
+}
+#else
+static char *allocateZeroed(size_t size)
+{
+  char *address = new char[size];
+  std::memset(address, 0, size);
+  return address;
+}
+
+static void releaseZeroed(char *address, size_t size)
+{
+  delete[] address;
+}
+#endif
+
+/// Returns the next cache line aligned address at or after p.
+static char *alignToCacheLine(char *p)
+{
+  const uintptr_t lineSize = HOST_CACHE_LINE_SIZE;
+  uintptr_t address = reinterpret_cast<uintptr_t>(p);
+  return reinterpret_cast<char*>((address + lineSize - 1) & ~(lineSize - 1));
+}
+
+/// Allocate the arrays indexed by pc from a single zero filled allocation.
+/// Zero is the initial state of every array except the opcode array, which
+/// is filled by initCache() when it is first needed.
+void Core::allocateCaches(uint32_t RamSize)
+{
+  const uint32_t numShorts = RamSize >> 1;
+  const uint32_t numPcs = numShorts + ILLEGAL_PC_THREAD_ADDR_OFFSET;
+  const size_t opcodeSize = sizeof(opcode[0]) * numPcs;
+  const size_t decodeCacheSize = sizeof(decodeCache[0]) * numPcs;
+  const size_t executionFrequencySize =
+    sizeof(executionFrequency[0]) * numShorts;
+  const size_t invalidationInfoSize = sizeof(invalidationInfo[0]) * numShorts;
+  cacheStorageSize = opcodeSize + decodeCacheSize + executionFrequencySize +
+                     invalidationInfoSize + 4 * (HOST_CACHE_LINE_SIZE - 1);
+  cacheStorage = allocateZeroed(cacheStorageSize);
+  char *p = alignToCacheLine(cacheStorage);
+  opcode = reinterpret_cast<OPCODE_TYPE*>(p);
+  p = alignToCacheLine(p + opcodeSize);
+  decodeCache = reinterpret_cast<DecodeCacheEntry*>(p);
+  p = alignToCacheLine(p + decodeCacheSize);
+  executionFrequency = reinterpret_cast<executionFrequency_t*>(p);
+  p = alignToCacheLine(p + executionFrequencySize);
+  invalidationInfo = reinterpret_cast<unsigned char*>(p);
+}
+
 Core::Core(uint32_t RamSize, uint32_t RamBase) :
-  executionFrequency(new executionFrequency_t[RamSize >> 1]),
-  opcode(new OPCODE_TYPE[(RamSize >> 1) + ILLEGAL_PC_THREAD_ADDR_OFFSET]),
-  operands(new Operands[RamSize >> 1]),
   ramSizeLog2(31 - countLeadingZeros(RamSize)),
   ram_base(RamBase),
   ramBaseMultiple(RamBase / RamSize),
@@ -34,15 +130,26 @@ Core::Core(uint32_t RamSize, uint32_t RamBase) :
   portNum(new unsigned[33]),
   resource(new Resource**[LAST_STD_RES_TYPE + 1]),
   resourceNum(new unsigned[LAST_STD_RES_TYPE + 1]),
-  memory(new uint32_t[RamSize >> 2]),
+  memory(allocateMemory(RamSize, RamBase)),
   coreNumber(0),
   parent(0),
-  invalidationInfo(new unsigned char[RamSize >> 1]),
+  schedulingContext(0),
+  cachedCode(false),
+  opcodeCacheInitialized(false),
   syscallAddress(~0),
   exceptionAddress(~0)
 {
+  allocateCaches(RamSize);
   memoryOffset = memory - (RamBase / 4);
   invalidationInfoOffset = invalidationInfo - (RamBase / 2);
+#if PAGE_PROTECTED_CODE
+  // allocateMemory() checks memory is aligned to the page size.
+  codePageSizeLog2 = 31 - countLeadingZeros(HostMemory::getPageSize());
+  codePageState = new unsigned char[getNumCodePages()];
+  codePageFaults = new unsigned[getNumCodePages()];
+  std::memset(codePageState, CODE_PAGE_WRITABLE, getNumCodePages());
+  std::memset(codePageFaults, 0, sizeof(codePageFaults[0]) * getNumCodePages());
+#endif
 
   resource[RES_TYPE_PORT] = 0;
   resourceNum[RES_TYPE_PORT] = 0;
@@ -111,18 +218,14 @@ Core::Core(uint32_t RamSize, uint32_t RamBase) :
     portNum[width] = num;
   }
   thread[0].alloc(0);
-  initInstructionCache(*this);
-  for (unsigned i = 0; i != (RamSize >> 1); ++i) {
-    invalidationInfo[i] = INVALIDATE_NONE;
-  }
-  std::memset(executionFrequency, 0,
-              sizeof(executionFrequency[0]) * (RamSize >> 1));
 }
 
 Core::~Core() {
-  delete[] opcode;
-  delete[] operands;
-  delete[] invalidationInfo;
+  releaseZeroed(cacheStorage, cacheStorageSize);
+#if PAGE_PROTECTED_CODE
+  delete[] codePageState;
+  delete[] codePageFaults;
+#endif
   delete[] thread;
   delete[] sync;
   delete[] lock;
@@ -130,7 +233,11 @@ Core::~Core() {
   delete[] timer;
   delete[] resource;
   delete[] resourceNum;
+#if GUARDED_MEMORY
+  HostMemory::release(memoryOffset, getMemoryReservationSize());
+#else
   delete[] memory;
+#endif
 }
 
 bool Core::allocatable[LAST_STD_RES_TYPE + 1] = {
@@ -188,6 +295,25 @@ void Core::writeMemory(uint32_t address, void *src, size_t size)
   std::memcpy(&memOffset()[address], src, size);
 }
 
+void Core::invalidateRange(uint32_t address, uint32_t size)
+{
+  if (size == 0)
+    return;
+#if PAGE_PROTECTED_CODE
+  uint32_t first = getCodePage(toPc(address));
+  uint32_t last = getCodePage(toPc(address + (size - 1)));
+  for (uint32_t page = first; page <= last; ++page) {
+    if (codePageState[page] == CODE_PAGE_PROTECTED)
+      invalidateCodePage(page);
+  }
+#else
+  uint32_t end = address + size;
+  for (address &= ~1; address < end; address += 2) {
+    invalidateShort(address);
+  }
+#endif
+}
+
 const Port *Core::getPortByID(ResourceID ID) const
 {
   assert(ID.type() == RES_TYPE_PORT);
@@ -256,14 +382,24 @@ initCache(OPCODE_TYPE decode, OPCODE_TYPE illegalPC,
   opcode[getInterpretOneAddr()] = interpretOne;
   opcode[getIllegalPCThreadAddr()] = illegalPCThread;
   decodeOpcode = decode;
+  opcodeCacheInitialized = true;
 }
 
 void Core::resetCaches()
 {
+  if (!cachedCode)
+    return;
+  cachedCode = false;
   uint32_t ramEnd = ram_base + (1 << ramSizeLog2);
   for (unsigned address = ram_base; address < ramEnd; address += 4) {
     invalidateWord(address);    
   }
+#if PAGE_PROTECTED_CODE
+  // Memory is written without a fault context when a program is loaded.
+  HostMemory::commit(mem(), getRamSize());
+  std::memset(codePageState, CODE_PAGE_WRITABLE, getNumCodePages());
+  std::memset(codePageFaults, 0, sizeof(codePageFaults[0]) * getNumCodePages());
+#endif
 }
 
 bool Core::getLocalChanendDest(ResourceID ID, ChanEndpoint *&result)
@@ -302,7 +438,7 @@ ChanEndpoint *Core::getChanendDest(ResourceID ID)
   // Try to lookup locally first.
   if (getLocalChanendDest(ID, result))
     return result;
-  return parent->getChanendDest(ID);
+  return parent->getChanendDest(ID, *schedulingContext);
 }
 
 void Core::finalize()
@@ -312,6 +448,14 @@ void Core::finalize()
   }
 }
 
+void Core::setSchedulingContext(SchedulingContext &context)
+{
+  schedulingContext = &context;
+  for (unsigned i = 0; i < NUM_THREADS; i++) {
+    thread[i].finalize();
+  }
+}
+
 void Core::updateIDs()
 {
   unsigned coreID = getCoreID();
@@ -350,8 +494,10 @@ void Core::invalidateSlowPath(uint32_t shiftedAddress)
   do {
     info = invalidationInfoOffset[shiftedAddress];
     uint32_t pc = shiftedAddress - (ram_base/2);
-    if (!JIT::invalidate(*this, pc))
+    if (!JIT::invalidate(*this, pc)) {
       opcode[pc] = decodeOpcode;
+      decodeCache[pc].threadedDispatch = 0;
+    }
     executionFrequency[pc] = 0;
     invalidationInfoOffset[shiftedAddress--] = INVALIDATE_NONE;
   } while (info == INVALIDATE_CURRENT_AND_PREVIOUS);
@@ -365,24 +511,113 @@ void Core::runJIT(uint32_t jitPc)
   JIT::compileBlock(*this, jitPc);
 }
 
+void Core::runOptimizingJIT(uint32_t jitPc)
+{
+  JIT::optimizeRegion(*this, jitPc);
+}
+
+void Core::installCompiledCodeSlowPath()
+{
+  compiledCodePending.clear();
+  // Try again later if the JIT is busy.
+  if (!JIT::installCompiledCode(*this))
+    compiledCodePending.set();
+}
+
+bool Core::shouldLeaveCompiledCode() const
+{
+  // The code can't be installed until the worker has finished compiling.
+  return compiledCodePending.isSet() && !JIT::isCompiling();
+}
+
 void Core::clearOpcode(uint32_t pc)
 {
   opcode[pc] = decodeOpcode;
+  decodeCache[pc].threadedDispatch = 0;
 }
 
 void Core::setOpcode(uint32_t pc, OPCODE_TYPE opc, unsigned size)
 {
   opcode[pc] = opc;
+  decodeCache[pc].threadedDispatch = 0;
+  setInvalidationInfo(pc, size);
+}
+
+void Core::setInvalidationInfo(uint32_t pc, unsigned size)
+{
+  cachedCode = true;
   if (invalidationInfo[pc] == INVALIDATE_NONE)
     invalidationInfo[pc] = INVALIDATE_CURRENT;
   assert((size % 2) == 0);
   for (unsigned i = 1; i < size / 2; i++) {
     invalidationInfo[pc + i] = INVALIDATE_CURRENT_AND_PREVIOUS;
   }
+#if PAGE_PROTECTED_CODE
+  protectCodePages(pc, size);
+#endif
 }
 
 void Core::setOpcode(uint32_t pc, OPCODE_TYPE opc, Operands &ops, unsigned size)
 {
   setOpcode(pc, opc, size);
-  operands[pc] = ops;
+  decodeCache[pc].operands = ops;
+}
+
+#if PAGE_PROTECTED_CODE
+bool Core::isCacheableCode(uint32_t pc, unsigned size) const
+{
+  for (uint32_t page = getCodePage(pc), last = getCodePage(pc + size / 2 - 1);
+       page <= last; ++page) {
+    if (codePageState[page] == CODE_PAGE_UNCACHEABLE)
+      return false;
+  }
+  return true;
+}
+
+/// Write protect the pages holding code of the specified size at the pc so
+/// the first write to them faults.
+void Core::protectCodePages(uint32_t pc, unsigned size)
+{
+  const uint32_t pageSize = 1 << codePageSizeLog2;
+  for (uint32_t page = getCodePage(pc), last = getCodePage(pc + size / 2 - 1);
+       page <= last; ++page) {
+    if (codePageState[page] != CODE_PAGE_WRITABLE)
+      continue;
+    HostMemory::protect(mem() + page * pageSize, pageSize);
+    codePageState[page] = CODE_PAGE_PROTECTED;
+  }
+}
+
+/// Invalidate all cached code on a protected page and make it writable.
+void Core::invalidateCodePage(uint32_t page)
+{
+  const uint32_t pageSize = 1 << codePageSizeLog2;
+  const uint32_t pageShorts = pageSize >> 1;
+  // Walk backwards so the walk in invalidateSlowPath() clears the info of the
+  // earlier halfwords of each instruction.
+  const uint32_t begin = (ram_base >> 1) + page * pageShorts;
+  for (uint32_t shiftedAddress = begin + pageShorts; shiftedAddress != begin;) {
+    --shiftedAddress;
+    if (invalidationInfoOffset[shiftedAddress] != INVALIDATE_NONE)
+      invalidateSlowPath(shiftedAddress);
+  }
+  // Stop caching code on pages which keep being written to avoid faulting on
+  // every write.
+  if (++codePageFaults[page] >= CODE_PAGE_FAULT_LIMIT)
+    codePageState[page] = CODE_PAGE_UNCACHEABLE;
+  else
+    codePageState[page] = CODE_PAGE_WRITABLE;
+  HostMemory::commit(mem() + page * pageSize, pageSize);
+}
+
+bool Core::fixupMemoryFault(size_t address)
+{
+  if (address < ram_base || address - ram_base >= getRamSize())
+    return false;
+  uint32_t page = (address - ram_base) >> codePageSizeLog2;
+  if (codePageState[page] != CODE_PAGE_PROTECTED)
+    return false;
+  invalidateCodePage(page);
+  return true;
 }
+#endif // PAGE_PROTECTED_CODE
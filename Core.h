@@ -14,6 +14,7 @@
 #include "Port.h"
 #include "Instruction.h"
 #include "BitManip.h"
+#include "HostThread.h"
 #include <string>
 #include <climits>
 
@@ -28,12 +29,26 @@ class Timer;
 #define ARRAY_SIZE(x) (sizeof(x)/sizeof(x[0]))
 
 class Node;
+class SchedulingContext;
 
 enum ProcessorState {
   PS_RAM_BASE = 0x00b,
   PS_VECTOR_BASE = 0x10b
 };
 
+/// The part of the cached decode of the instruction at a pc which the threaded
+/// interpreter reads to execute it. Keeping the fields together in a 16 byte
+/// entry means each instruction it executes touches a single cache line.
+/// The dispatch loop, which also reads the opcode array, doesn't benefit.
+struct DecodeCacheEntry {
+  Operands operands;
+  /// If non zero then the opcode array holds an interpreter function which
+  /// the threaded interpreter may execute directly using this entry of its
+  /// dispatch table. Otherwise the function in the opcode array must be
+  /// called.
+  uint16_t threadedDispatch;
+};
+
 class Core {
 public:
   enum {
@@ -41,8 +56,9 @@ public:
     INTERPRET_ONE_ADDR_OFFSET = 3,
     ILLEGAL_PC_THREAD_ADDR_OFFSET = 4
   };
+  /// The invalidation info starts zero filled so INVALIDATE_NONE must be 0.
   enum {
-    INVALIDATE_NONE,
+    INVALIDATE_NONE = 0,
     INVALIDATE_CURRENT,
     INVALIDATE_CURRENT_AND_PREVIOUS
   };
@@ -58,7 +74,12 @@ private:
   // the previous instruction. Addition pseudo instructions come after this and
   // are use for communicating illegal states.
   OPCODE_TYPE *opcode;
-  Operands *operands;
+  /// Parallel to the opcode array and aligned to a cache line.
+  DecodeCacheEntry *decodeCache;
+  /// The zero filled allocation holding the opcode array, the decode cache,
+  /// the execution frequencies and the invalidation info.
+  char *cacheStorage;
+  size_t cacheStorageSize;
 public:
   const uint32_t ramSizeLog2;
   const uint32_t ram_base;
@@ -78,15 +99,52 @@ private:
   uint32_t * const memory;
   unsigned coreNumber;
   Node *parent;
+  /// The context used to schedule the core's threads and resources.
+  SchedulingContext *schedulingContext;
   std::string codeReference;
   OPCODE_TYPE decodeOpcode;
 
+  /// Set by the JIT when code compiled for this core is waiting to be
+  /// installed.
+  AtomicFlag compiledCodePending;
+
+  /// Set when code is first cached so resetCaches() can skip the sweep over
+  /// memory if nothing has been cached.
+  bool cachedCode;
+
+  /// Set once initCache() has filled the opcode array. This is deferred
+  /// until the core first runs or decodes code so cores that never do
+  /// don't touch the array.
+  bool opcodeCacheInitialized;
+
   bool hasMatchingNodeID(ResourceID ID);
+  void allocateCaches(uint32_t RamSize);
   void invalidateWordSlowPath(uint32_t address);
   void invalidateSlowPath(uint32_t shiftedAddress);
+  void installCompiledCodeSlowPath();
 private:
   unsigned char *invalidationInfo;
   uint32_t getRamSizeShorts() const { return 1 << (ramSizeLog2 - 1); }
+#if PAGE_PROTECTED_CODE
+  enum CodePageState {
+    CODE_PAGE_WRITABLE,
+    CODE_PAGE_PROTECTED,
+    CODE_PAGE_UNCACHEABLE
+  };
+  /// Log base 2 of the size in bytes of the host pages memory is protected in.
+  uint32_t codePageSizeLog2;
+  unsigned char *codePageState;
+  /// Number of times the code on each page has been invalidated by a write.
+  unsigned *codePageFaults;
+  uint32_t getNumCodePages() const {
+    return 1 << (ramSizeLog2 - codePageSizeLog2);
+  }
+  uint32_t getCodePage(uint32_t pc) const {
+    return pc >> (codePageSizeLog2 - 1);
+  }
+  void protectCodePages(uint32_t pc, unsigned size);
+  void invalidateCodePage(uint32_t page);
+#endif
 
 public:
   uint32_t vector_base;
@@ -99,10 +157,45 @@ public:
 
   void clearOpcode(uint32_t pc);
   void setOpcode(uint32_t pc, OPCODE_TYPE opc, unsigned size);
+  /// Ensure writes to the code at the specified pc invalidate the function
+  /// in the opcode array at the start of the code.
+  void setInvalidationInfo(uint32_t pc, unsigned size);
   void setOpcode(uint32_t pc, OPCODE_TYPE opc, Operands &ops, unsigned size);
+  void setOperands(uint32_t pc, Operands &ops) {
+    decodeCache[pc].operands = ops;
+  }
+
+#if PAGE_PROTECTED_CODE
+  /// Returns whether code of the specified size at the pc may be cached.
+  /// Code on pages which are written too often is interpreted instead.
+  bool isCacheableCode(uint32_t pc, unsigned size) const;
+  /// Called by the thread after an access to the core's memory faulted,
+  /// never from the signal handler. If the address is on a page protected
+  /// because it holds cached code then the code is invalidated and the page
+  /// is made writable, in which case it returns true.
+  bool fixupMemoryFault(size_t address);
+  /// Returns whether a store to the valid address would fault because the
+  /// page holds cached code.
+  bool isProtectedCodeAddress(uint32_t address) const {
+    uint32_t page = (address - ram_base) >> codePageSizeLog2;
+    return codePageState[page] == CODE_PAGE_PROTECTED;
+  }
+#else
+  bool isCacheableCode(uint32_t pc, unsigned size) const { return true; }
+#endif
 
-  const Operands &getOperands(uint32_t pc) const { return operands[pc]; }
+  const Operands &getOperands(uint32_t pc) const {
+    return decodeCache[pc].operands;
+  }
   const OPCODE_TYPE *getOpcodeArray() const { return opcode; }
+  const DecodeCacheEntry *getDecodeCache() const { return decodeCache; }
+
+  /// Set the threaded interpreter's dispatch table entry for the function in
+  /// the opcode array at the specified pc. This must be called after
+  /// setOpcode().
+  void setThreadedDispatch(uint32_t pc, unsigned entry) {
+    decodeCache[pc].threadedDispatch = entry;
+  }
 
   bool setSyscallAddress(uint32_t value);
   bool setExceptionAddress(uint32_t value);
@@ -111,9 +204,54 @@ public:
                  OPCODE_TYPE illegalPCThread, OPCODE_TYPE runJit,
                  OPCODE_TYPE interpretOne);
 
+  /// Initialise the opcode array if it hasn't been already. Must be called
+  /// before any of the core's code is executed or decoded.
+  void initCacheIfNeeded() {
+    if (!opcodeCacheInitialized)
+      initInstructionCache(*this);
+  }
+
+  /// Discard all cached code. Must be called before a new program is loaded.
   void resetCaches();
 
   void runJIT(uint32_t jitPc);
+  void runOptimizingJIT(uint32_t jitPc);
+
+  void setCompiledCodePending() { compiledCodePending.set(); }
+  /// Returns true if compiled code should return to the dispatch loop so
+  /// pending code can be installed.
+  bool shouldLeaveCompiledCode() const;
+
+  /// Install any code compiled in the background. Must only be called when
+  /// none of the core's threads are executing compiled code.
+  void installCompiledCode() {
+    if (compiledCodePending.isSet())
+      installCompiledCodeSlowPath();
+  }
+
+  executionFrequency_t getExecutionFrequency(uint32_t pc) const {
+    return executionFrequency[pc];
+  }
+
+  void resetExecutionFrequency(uint32_t pc) {
+    executionFrequency[pc] = 0;
+  }
+
+  /// Set the number of times baseline JIT code at the pc should execute
+  /// before it is recompiled by the optimizing tier. The count is kept per
+  /// core so the code itself can be shared between cores.
+  void setBaselineExecutionCount(uint32_t pc, executionFrequency_t count) {
+    executionFrequency[pc] = -count;
+  }
+
+  /// Count an execution of baseline JIT code. Returns true once it has
+  /// executed the number of times set by setBaselineExecutionCount().
+  bool updateBaselineExecutionCount(uint32_t pc) {
+    if (++executionFrequency[pc] < 0)
+      return false;
+    executionFrequency[pc] = MIN_EXECUTION_FREQUENCY;
+    return true;
+  }
 
   uint32_t getRamSize() const { return 1 << ramSizeLog2; }
 
@@ -154,6 +292,13 @@ public:
     return address < getRamSizeShorts();
   }
 
+#if GUARDED_MEMORY
+  /// Returns the start of the host address range reserved for the core's
+  /// memory. Memory is accessed at the reservation plus the address.
+  const void *getMemoryReservation() const { return memoryOffset; }
+  static size_t getMemoryReservationSize();
+#endif
+
   uint32_t toPc(uint32_t address) const {
     return (address - ram_base) >> 1;
   }
@@ -268,6 +413,10 @@ public:
 
   void writeMemory(uint32_t address, void *src, size_t size);
 
+  /// Invalidate any cached code in the specified range of memory. Must be
+  /// called before memory is written other than by a simulated store.
+  void invalidateRange(uint32_t address, uint32_t size);
+
   Resource *allocResource(Thread &current, ResourceType type);
 
   Thread *allocThread(Thread &current)
@@ -310,6 +459,11 @@ public:
   uint32_t getCoreID() const;
   const Node *getParent() const { return parent; }
   Node *getParent() { return parent; }
+  void setSchedulingContext(SchedulingContext &context);
+  const SchedulingContext &getSchedulingContext() const {
+    return *schedulingContext;
+  }
+  SchedulingContext &getSchedulingContext() { return *schedulingContext; }
   void dumpPaused() const;
   Thread &getThread(unsigned num) { return thread[num]; }
   const Thread &getThread(unsigned num) const { return thread[num]; }
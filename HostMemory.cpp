@@ -0,0 +1,111 @@
+// Copyright (c) 2012, Richard Osborne, All rights reserved
+// This software is freely distributable under a derivative of the
+// University of Illinois/NCSA Open Source License posted in
+// LICENSE.txt and at <http://github.xcore.com/>
+
+#include "HostMemory.h"
+
+#if GUARDED_MEMORY
+#include <sys/mman.h>
+#include <signal.h>
+#include <unistd.h>
+
+#ifndef MAP_NORESERVE
+#define MAP_NORESERVE 0
+#endif
+
+size_t HostMemory::getPageSize()
+{
+  return sysconf(_SC_PAGESIZE);
+}
+
+void *HostMemory::reserve(size_t size)
+{
+  void *address = mmap(0, size, PROT_NONE,
+                       MAP_PRIVATE | MAP_ANON | MAP_NORESERVE, -1, 0);
+  if (address == MAP_FAILED)
+    return 0;
+  return address;
+}
+
+void *HostMemory::allocateZeroed(size_t size)
+{
+  void *address = reserve(size);
+  if (!address)
+    return 0;
+  if (!commit(address, size)) {
+    release(address, size);
+    return 0;
+  }
+  return address;
+}
+
+bool HostMemory::commit(void *address, size_t size)
+{
+  return mprotect(address, size, PROT_READ | PROT_WRITE) == 0;
+}
+
+bool HostMemory::protect(void *address, size_t size)
+{
+  return mprotect(address, size, PROT_READ) == 0;
+}
+
+void HostMemory::release(void *address, size_t size)
+{
+  munmap(address, size);
+}
+
+static __thread MemoryFaultContext *currentFaultContext;
+static bool faultHandlerInstalled;
+static struct sigaction previousSegvAction;
+static struct sigaction previousBusAction;
+
+static void handleFault(int sig, siginfo_t *info, void *)
+{
+  MemoryFaultContext *context = currentFaultContext;
+  if (context && context->recordFault(info->si_addr))
+    siglongjmp(context->env, 1);
+  // Restore the previous handler. It is called when the faulting
+  // instruction is retried.
+  sigaction(sig, sig == SIGSEGV ? &previousSegvAction : &previousBusAction, 0);
+}
+
+void HostMemory::installFaultHandler()
+{
+  if (faultHandlerInstalled)
+    return;
+  struct sigaction action;
+  action.sa_sigaction = &handleFault;
+  sigemptyset(&action.sa_mask);
+  // The handler leaves by jumping out of it, so don't block the signal
+  // while it runs. Otherwise the next fault would kill the process.
+  action.sa_flags = SA_SIGINFO | SA_NODEFER;
+  sigaction(SIGSEGV, &action, &previousSegvAction);
+  // Some hosts raise SIGBUS for accesses to reserved pages.
+  sigaction(SIGBUS, &action, &previousBusAction);
+  faultHandlerInstalled = true;
+}
+
+MemoryFaultContext::MemoryFaultContext(const void *b, size_t s) :
+  base(static_cast<const char*>(b)),
+  size(s),
+  previous(currentFaultContext),
+  faultOffset(0)
+{
+  currentFaultContext = this;
+}
+
+MemoryFaultContext::~MemoryFaultContext()
+{
+  currentFaultContext = previous;
+}
+
+bool MemoryFaultContext::recordFault(const void *address)
+{
+  const char *p = static_cast<const char*>(address);
+  if (p < base || p >= base + size)
+    return false;
+  faultOffset = p - base;
+  return true;
+}
+#endif // GUARDED_MEMORY
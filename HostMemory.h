@@ -0,0 +1,62 @@
+// Copyright (c) 2012, Richard Osborne, All rights reserved
+// This software is freely distributable under a derivative of the
+// University of Illinois/NCSA Open Source License posted in
+// LICENSE.txt and at <http://github.xcore.com/>
+
+#ifndef _HostMemory_h_
+#define _HostMemory_h_
+
+#include "Config.h"
+
+#if GUARDED_MEMORY
+#include <cstddef>
+#include <setjmp.h>
+
+/// Thin wrappers around the host's virtual memory primitives.
+namespace HostMemory {
+  size_t getPageSize();
+  /// Reserve a range of host address space. Any access to the range faults
+  /// until part of it is committed. Returns 0 on failure.
+  void *reserve(size_t size);
+  /// Allocate a readable and writable range which initially reads as zero.
+  /// Host memory is only used for the pages of the range which are written.
+  /// Returns 0 on failure.
+  void *allocateZeroed(size_t size);
+  /// Make part of a reserved range readable and writable. The range must be
+  /// page aligned.
+  bool commit(void *address, size_t size);
+  /// Make part of a committed range read only. Writes to it fault until it
+  /// is committed again. The range must be page aligned.
+  bool protect(void *address, size_t size);
+  void release(void *address, size_t size);
+  /// Install the handler which passes faults to the MemoryFaultContext of
+  /// the host thread. Faults outside the context's range are passed on to
+  /// the previously installed handler.
+  void installFaultHandler();
+}
+
+/// While in scope, a fault on the current host thread accessing the context's
+/// range of host addresses jumps to the point where env was saved by calling
+/// sigsetjmp(env, 0). Nothing else is done in the signal handler, any work
+/// needed to handle the fault must be done after the jump.
+class MemoryFaultContext {
+  const char *base;
+  size_t size;
+  MemoryFaultContext *previous;
+  volatile size_t faultOffset;
+  MemoryFaultContext(const MemoryFaultContext &);
+  MemoryFaultContext &operator=(const MemoryFaultContext &);
+public:
+  sigjmp_buf env;
+  MemoryFaultContext(const void *base, size_t size);
+  ~MemoryFaultContext();
+  /// Record a fault at the specified address. Returns false if the address
+  /// isn't in the context's range.
+  bool recordFault(const void *address);
+  /// Returns the offset from the start of the range of the address of the
+  /// last fault.
+  size_t getFaultOffset() const { return faultOffset; }
+};
+#endif // GUARDED_MEMORY
+
+#endif // _HostMemory_h_
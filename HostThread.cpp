@@ -0,0 +1,231 @@
+// Copyright (c) 2012, Richard Osborne, All rights reserved
+// This software is freely distributable under a derivative of the
+// University of Illinois/NCSA Open Source License posted in
+// LICENSE.txt and at <http://github.xcore.com/>
+
+#include "HostThread.h"
+#include <cassert>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+
+struct Mutex::Impl {
+  CRITICAL_SECTION cs;
+};
+
+Mutex::Mutex() : impl(new Impl)
+{
+  InitializeCriticalSection(&impl->cs);
+}
+
+Mutex::~Mutex()
+{
+  DeleteCriticalSection(&impl->cs);
+  delete impl;
+}
+
+void Mutex::lock()
+{
+  EnterCriticalSection(&impl->cs);
+}
+
+bool Mutex::tryLock()
+{
+  return TryEnterCriticalSection(&impl->cs) != 0;
+}
+
+void Mutex::unlock()
+{
+  LeaveCriticalSection(&impl->cs);
+}
+
+struct ConditionVariable::Impl {
+  CONDITION_VARIABLE cv;
+};
+
+ConditionVariable::ConditionVariable() : impl(new Impl)
+{
+  InitializeConditionVariable(&impl->cv);
+}
+
+ConditionVariable::~ConditionVariable()
+{
+  delete impl;
+}
+
+void ConditionVariable::wait(Mutex &mutex)
+{
+  SleepConditionVariableCS(&impl->cv, &mutex.impl->cs, INFINITE);
+}
+
+void ConditionVariable::notifyAll()
+{
+  WakeAllConditionVariable(&impl->cv);
+}
+
+struct HostThread::Impl {
+  HANDLE handle;
+  EntryPoint entry;
+  void *arg;
+  static DWORD WINAPI trampoline(LPVOID p) {
+    Impl *impl = static_cast<Impl*>(p);
+    impl->entry(impl->arg);
+    return 0;
+  }
+};
+
+HostThread::HostThread() : impl(new Impl)
+{
+  impl->handle = 0;
+}
+
+HostThread::~HostThread()
+{
+  assert(!impl->handle && "Host thread was not joined");
+  delete impl;
+}
+
+bool HostThread::start(EntryPoint entry, void *arg)
+{
+  impl->entry = entry;
+  impl->arg = arg;
+  impl->handle = CreateThread(0, 0, &Impl::trampoline, impl, 0, 0);
+  return impl->handle != 0;
+}
+
+void HostThread::join()
+{
+  WaitForSingleObject(impl->handle, INFINITE);
+  CloseHandle(impl->handle);
+  impl->handle = 0;
+}
+
+double getHostTime()
+{
+  LARGE_INTEGER frequency, count;
+  QueryPerformanceFrequency(&frequency);
+  QueryPerformanceCounter(&count);
+  return (double)count.QuadPart / (double)frequency.QuadPart;
+}
+
+unsigned getHostConcurrency()
+{
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  return info.dwNumberOfProcessors ? info.dwNumberOfProcessors : 1;
+}
+
+#else
+#include <pthread.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+struct Mutex::Impl {
+  pthread_mutex_t mutex;
+};
+
+Mutex::Mutex() : impl(new Impl)
+{
+  pthread_mutex_init(&impl->mutex, 0);
+}
+
+Mutex::~Mutex()
+{
+  pthread_mutex_destroy(&impl->mutex);
+  delete impl;
+}
+
+void Mutex::lock()
+{
+  pthread_mutex_lock(&impl->mutex);
+}
+
+bool Mutex::tryLock()
+{
+  return pthread_mutex_trylock(&impl->mutex) == 0;
+}
+
+void Mutex::unlock()
+{
+  pthread_mutex_unlock(&impl->mutex);
+}
+
+struct ConditionVariable::Impl {
+  pthread_cond_t cond;
+};
+
+ConditionVariable::ConditionVariable() : impl(new Impl)
+{
+  pthread_cond_init(&impl->cond, 0);
+}
+
+ConditionVariable::~ConditionVariable()
+{
+  pthread_cond_destroy(&impl->cond);
+  delete impl;
+}
+
+void ConditionVariable::wait(Mutex &mutex)
+{
+  pthread_cond_wait(&impl->cond, &mutex.impl->mutex);
+}
+
+void ConditionVariable::notifyAll()
+{
+  pthread_cond_broadcast(&impl->cond);
+}
+
+struct HostThread::Impl {
+  pthread_t thread;
+  bool started;
+  EntryPoint entry;
+  void *arg;
+  static void *trampoline(void *p) {
+    Impl *impl = static_cast<Impl*>(p);
+    impl->entry(impl->arg);
+    return 0;
+  }
+};
+
+HostThread::HostThread() : impl(new Impl)
+{
+  impl->started = false;
+}
+
+HostThread::~HostThread()
+{
+  assert(!impl->started && "Host thread was not joined");
+  delete impl;
+}
+
+bool HostThread::start(EntryPoint entry, void *arg)
+{
+  impl->entry = entry;
+  impl->arg = arg;
+  impl->started = pthread_create(&impl->thread, 0, &Impl::trampoline,
+                                 impl) == 0;
+  return impl->started;
+}
+
+void HostThread::join()
+{
+  pthread_join(impl->thread, 0);
+  impl->started = false;
+}
+
+double getHostTime()
+{
+  struct timeval tv;
+  gettimeofday(&tv, 0);
+  return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+unsigned getHostConcurrency()
+{
+  long count = sysconf(_SC_NPROCESSORS_ONLN);
+  return count > 0 ? count : 1;
+}
+
+#endif
@@ -0,0 +1,100 @@
+// Copyright (c) 2012, Richard Osborne, All rights reserved
+// This software is freely distributable under a derivative of the
+// University of Illinois/NCSA Open Source License posted in
+// LICENSE.txt and at <http://github.xcore.com/>
+
+#ifndef _HostThread_h_
+#define _HostThread_h_
+
+/// Thin wrappers around the host's native threading primitives. The native
+/// types are kept out of the header so that including it doesn't drag in
+/// windows.h.
+
+class Mutex {
+  struct Impl;
+  Impl *impl;
+  Mutex(const Mutex &);
+  Mutex &operator=(const Mutex &);
+  friend class ConditionVariable;
+public:
+  Mutex();
+  ~Mutex();
+  void lock();
+  /// Acquire the mutex if it is not held by another thread.
+  /// \return Whether the mutex was acquired.
+  bool tryLock();
+  void unlock();
+};
+
+/// Holds a mutex for the lifetime of the object.
+class ScopedLock {
+  Mutex &mutex;
+  ScopedLock(const ScopedLock &);
+  ScopedLock &operator=(const ScopedLock &);
+public:
+  ScopedLock(Mutex &m) : mutex(m) { mutex.lock(); }
+  ~ScopedLock() { mutex.unlock(); }
+};
+
+class ConditionVariable {
+  struct Impl;
+  Impl *impl;
+  ConditionVariable(const ConditionVariable &);
+  ConditionVariable &operator=(const ConditionVariable &);
+public:
+  ConditionVariable();
+  ~ConditionVariable();
+  /// Atomically release the mutex and wait to be notified. The mutex is
+  /// reacquired before returning. Spurious wakeups are possible.
+  void wait(Mutex &mutex);
+  void notifyAll();
+};
+
+class HostThread {
+public:
+  typedef void (*EntryPoint)(void *arg);
+private:
+  struct Impl;
+  Impl *impl;
+  HostThread(const HostThread &);
+  HostThread &operator=(const HostThread &);
+public:
+  HostThread();
+  ~HostThread();
+  /// Start running entry(arg) on a new host thread.
+  /// \return Whether the thread was successfully created.
+  bool start(EntryPoint entry, void *arg);
+  /// Wait for a started thread to finish.
+  void join();
+};
+
+/// A flag which is set by one host thread and polled by another. Polling the
+/// flag is as cheap as reading a plain bool. Setting or clearing it doesn't
+/// order other memory accesses, any data it guards must be protected by a
+/// mutex.
+class AtomicFlag {
+  volatile long value;
+  AtomicFlag(const AtomicFlag &);
+  AtomicFlag &operator=(const AtomicFlag &);
+public:
+  AtomicFlag() : value(0) {}
+#ifdef __ATOMIC_RELAXED
+  void set() { __atomic_store_n(&value, 1, __ATOMIC_RELAXED); }
+  void clear() { __atomic_store_n(&value, 0, __ATOMIC_RELAXED); }
+  bool isSet() const { return __atomic_load_n(&value, __ATOMIC_RELAXED); }
+#else
+  // Aligned volatile accesses are atomic on all supported hosts.
+  void set() { value = 1; }
+  void clear() { value = 0; }
+  bool isSet() const { return value != 0; }
+#endif
+};
+
+/// Returns the host's wall clock time in seconds. Only differences between
+/// values are meaningful.
+double getHostTime();
+
+/// Returns the number of processors available on the host, at least 1.
+unsigned getHostConcurrency();
+
+#endif // _HostThread_h_
@@ -37,6 +37,50 @@ extern "C" void jitUpdateExecutionFrequency(Thread &t) {
   t.getParent().updateExecutionFrequency(t.pc);
 }
 
+extern "C" JITReturn
+jitUpdateBaselineExecutionCount(Thread &t, uint32_t pc) {
+  Core &core = t.getParent();
+  if (core.updateBaselineExecutionCount(pc))
+    core.runOptimizingJIT(pc);
+  // Leave loops which stay inside the function so the dispatch loop can
+  // install the pending code.
+  if (core.shouldLeaveCompiledCode()) {
+    t.pc = pc;
+    return JIT_RETURN_END_TRACE;
+  }
+  return JIT_RETURN_CONTINUE;
+}
+
+extern "C" void jitUpdateRetiredCount(Thread &t, uint32_t count) {
+  t.jitCount += count;
+}
+
+extern "C" void
+jitUpdateInstructionCount(Thread &t, uint32_t opcode, uint32_t count) {
+  t.instructionCounts[opcode] += count;
+}
+
+extern "C" void
+jitRecordIndirectBranch(Thread &t, JITIndirectBranchProfile *profile) {
+  uint32_t numTargets = profile->numTargets;
+  if (numTargets == JIT_INLINE_CACHE_SIZE)
+    return;
+  for (unsigned i = 0; i < numTargets; i++) {
+    if (profile->targets[i] == t.pc)
+      return;
+  }
+  profile->targets[numTargets] = t.pc;
+  profile->numTargets = numTargets + 1;
+}
+
+extern "C" void jitPushReturnAddress(Thread &t, uint32_t pc, void *code) {
+  t.pushReturnAddress(pc, code);
+}
+
+extern "C" void *jitPopReturnAddress(Thread &t) {
+  return t.popReturnAddress(t.pc);
+}
+
 extern "C" uint32_t
 jitComputeAddress(const Thread &t, Register::Reg baseReg, unsigned scale,
                   Register::Reg offsetReg, uint32_t immOffset)
@@ -54,18 +98,32 @@ jitCheckAddress(const Thread &t, uint32_t ramSizeLog2, uint32_t address)
   return (address >> ramSizeLog2) == t.getParent().ramBaseMultiple;
 }
 
+// Compiled code leaves stores to protected code pages to the interpreter
+// since the state of optimized code isn't written back if the store faults.
 extern "C" bool jitInvalidateByteCheck(Thread &t, uint32_t address)
 {
+#if PAGE_PROTECTED_CODE
+  if (t.getParent().isProtectedCodeAddress(address))
+    return true;
+#endif
   return t.getParent().invalidateByteCheck(address);
 }
 
 extern "C" bool jitInvalidateShortCheck(Thread &t, uint32_t address)
 {
+#if PAGE_PROTECTED_CODE
+  if (t.getParent().isProtectedCodeAddress(address))
+    return true;
+#endif
   return t.getParent().invalidateShortCheck(address);
 }
 
 extern "C" bool jitInvalidateWordCheck(Thread &t, uint32_t address)
 {
+#if PAGE_PROTECTED_CODE
+  if (t.getParent().isProtectedCodeAddress(address))
+    return true;
+#endif
   return t.getParent().invalidateWordCheck(address);
 }
 
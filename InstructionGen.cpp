@@ -4,9 +4,11 @@
 // LICENSE.txt and at <http://github.xcore.com/>
 
 #include <vector>
+#include <map>
 #include <string>
 #include <iostream>
 #include <sstream>
+#include <fstream>
 #include <cstdlib>
 #include <cstring>
 #include <cctype>
@@ -387,6 +389,14 @@ setEnableMemCheckOpt()
 
 std::vector<Instruction*> instructions;
 
+/// A sequence of instructions executed by a single handler.
+struct Superinstruction {
+  std::string name;
+  std::vector<Instruction*> insts;
+};
+
+std::vector<Superinstruction> superinstructions;
+
 Instruction &inst(const std::string &name,
                   unsigned size,
                   const std::vector<OpType> &operands,
@@ -705,8 +715,12 @@ void FunctionCodeEmitter::emitCycles()
   std::cout << "THREAD.time += " << inst->getCycles() << ";\n";
 }
 
+/// Count the instruction as retired. Compiled code counts the instructions
+/// of a fragment in bulk instead, see JITImpl::emitFragment().
 void FunctionCodeEmitter::emitCount()
 {
+  if (jit)
+    return;
   std::cout << "COUNT += 1;\n";
 }
 
@@ -756,6 +770,9 @@ void FunctionCodeEmitter::emitUpdateExecutionFrequency()
   std::cout << "if (!tracing) {\n";
   if (inst->getMayBranch()) {
     std::cout << "CORE.updateExecutionFrequency(THREAD.pc);\n";
+    // Interpreted instructions only run from the dispatch loop so this is a
+    // safe point to install compiled code.
+    std::cout << "CORE.installCompiledCode();\n";
   }
   std::cout << "}\n";
 }
@@ -840,6 +857,7 @@ void FunctionCodeEmitter::emitKCall(const std::string &args)
   emitNested(args);
   std::cout << ");\n";
   emitCycles();
+  emitCount();
   emitYieldIfTimeSliceExpired();
   if (!jit)
     emitTraceEnd(*inst);
@@ -862,6 +880,7 @@ void FunctionCodeEmitter::emitPauseOn(const std::string &args)
 void FunctionCodeEmitter::emitYield()
 {
   emitCycles();
+  emitCount();
   emitRegWriteBack();
   emitUpdateExecutionFrequency();
   emitYieldIfTimeSliceExpired();
@@ -871,6 +890,7 @@ void FunctionCodeEmitter::emitYield()
 void FunctionCodeEmitter::emitDeschedule()
 {
   emitCycles();
+  emitCount();
   emitCheckEvents();
   std::cout << "THREAD.waiting() = true;\n";
   if (!jit)
@@ -951,6 +971,191 @@ emitCode(const Instruction &instruction,
   emitter.emitBare(code);
 }
 
+/// Emits the body of an instruction for the threaded interpreter. The pc,
+/// time and instruction count are held in the THREADED_PC, TIME and COUNT
+/// locals and must be written back with THREADED_SYNC() before calling
+/// anything that reads the thread state.
+class ThreadedCodeEmitter : public CodeEmitter {
+  const Instruction *inst;
+public:
+  ThreadedCodeEmitter() : inst(0) {}
+  void setInstruction(const Instruction &i) { inst = &i; }
+  void emitCycles();
+  void emitCount();
+  void emitRegWriteBack();
+  void emitUpdateExecutionFrequency();
+  void emitDispatch();
+protected:
+  virtual void emitBegin() {}
+  virtual void emitRaw(const std::string &s);
+  virtual void emitOp(unsigned);
+  virtual void emitNextPc();
+  virtual void emitException(const std::string &args);
+  virtual void emitKCall(const std::string &args);
+  virtual void emitPauseOn(const std::string &args);
+  virtual void emitYield();
+  virtual void emitDeschedule();
+  virtual void emitStore(const std::string &args, LoadStoreType type);
+  virtual void emitLoad(const std::string &args, LoadStoreType type);
+};
+
+void ThreadedCodeEmitter::emitCycles()
+{
+  std::cout << "TIME += " << inst->getCycles() << ";\n";
+}
+
+void ThreadedCodeEmitter::emitCount()
+{
+  std::cout << "COUNT += 1;\n";
+}
+
+void ThreadedCodeEmitter::emitRegWriteBack()
+{
+  const std::vector<OpType> &operands = inst->getOperands();
+  for (unsigned i = 0, e = operands.size(); i != e; ++i) {
+    switch (operands[i]) {
+    default:
+      break;
+    case out:
+    case inout:
+      assert(!isSR(*inst, i));
+      std::cout << "THREAD.regs[" << getOperandName(*inst, i);
+      std::cout << "] = ";
+      std::cout << "op" << i << ";\n";
+      break;
+    }
+  }
+  std::cout << "THREADED_PC = nextPc;\n";
+}
+
+void ThreadedCodeEmitter::emitUpdateExecutionFrequency()
+{
+  if (inst->getMayBranch()) {
+    std::cout << "CORE.updateExecutionFrequency(THREADED_PC);\n";
+    std::cout << "CORE.installCompiledCode();\n";
+  }
+}
+
+void ThreadedCodeEmitter::emitDispatch()
+{
+  std::cout << "THREADED_DISPATCH();\n";
+}
+
+void ThreadedCodeEmitter::emitRaw(const std::string &s)
+{
+  std::cout << s;
+}
+
+void ThreadedCodeEmitter::emitOp(unsigned num)
+{
+  if (num >= inst->getOperands().size()) {
+    std::cerr << "error: operand out of range in code string\n";
+    std::exit(1);
+  }
+  std::cout << "op" << num;
+}
+
+void ThreadedCodeEmitter::emitNextPc()
+{
+  std::cout << "nextPc";
+}
+
+void ThreadedCodeEmitter::emitException(const std::string &args)
+{
+  std::cout << "THREADED_SYNC();\n";
+  std::cout << "THREADED_PC = exception(THREAD, THREADED_PC, ";
+  emitNested(args);
+  std::cout << ");\n";
+  emitCycles();
+  std::cout << "THREADED_YIELD_IF_TIME_SLICE_EXPIRED();\n";
+  emitDispatch();
+}
+
+void ThreadedCodeEmitter::emitKCall(const std::string &args)
+{
+  assert(0 && "Unexpected kcall in threaded instruction");
+}
+
+void ThreadedCodeEmitter::emitPauseOn(const std::string &args)
+{
+  assert(0 && "Unexpected pause in threaded instruction");
+}
+
+void ThreadedCodeEmitter::emitYield()
+{
+  emitCycles();
+  emitCount();
+  emitRegWriteBack();
+  emitUpdateExecutionFrequency();
+  std::cout << "THREADED_YIELD_IF_TIME_SLICE_EXPIRED();\n";
+  emitDispatch();
+}
+
+void ThreadedCodeEmitter::emitDeschedule()
+{
+  assert(0 && "Unexpected deschedule in threaded instruction");
+}
+
+void ThreadedCodeEmitter::
+emitStore(const std::string &argString, LoadStoreType type)
+{
+  std::vector<std::string> args;
+  splitString(argString, ',', args);
+  assert(args.size() == 2);
+  const std::string &value = args[0];
+  const std::string &addr = args[1];
+  std::cout << "{\n";
+
+  std::cout << "  uint32_t StoreAddr = ";
+  emitNested(addr);
+  std::cout << ";\n";
+
+  std::cout << "  if (!CHECK_ADDR_" << getLoadStoreTypeName(type);
+  std::cout << "(StoreAddr)) {\n";
+  emitException("ET_LOAD_STORE, StoreAddr");
+  std::cout << "  }\n";
+  std::cout << "  THREADED_MEMORY_ACCESS();\n";
+
+  std::cout << "  STORE_" << getLoadStoreTypeName(type);
+  std::cout << "(";
+  emitNested(value);
+  std::cout << ", StoreAddr);\n";
+
+  // Invalidating the decode cache resets the dispatch entry so there is no
+  // need to end the trace.
+  std::cout << "  INVALIDATE_" << getLoadStoreTypeName(type);
+  std::cout << "(StoreAddr);\n";
+
+  std::cout << "}\n";
+}
+
+void ThreadedCodeEmitter::
+emitLoad(const std::string &argString, LoadStoreType type)
+{
+  std::vector<std::string> args;
+  splitString(argString, ',', args);
+  assert(args.size() == 2);
+  const std::string &dest = args[0];
+  const std::string &addr = args[1];
+  std::cout << "{\n";
+
+  std::cout << "  uint32_t LoadAddr = ";
+  emitNested(addr);
+  std::cout << ";\n";
+
+  std::cout << "  if (!CHECK_ADDR_" << getLoadStoreTypeName(type);
+  std::cout << "(LoadAddr)) {\n";
+  emitException("ET_LOAD_STORE, LoadAddr");
+  std::cout << "  }\n";
+  std::cout << "  THREADED_MEMORY_ACCESS();\n";
+
+  emitNested(dest);
+  std::cout << " = LOAD_" << getLoadStoreTypeName(type);
+  std::cout << "(LoadAddr);\n";
+
+  std::cout << "}\n";
+}
+
 class CodePropertyExtractor : public CodeEmitter {
   Instruction *inst;
 protected:
@@ -1115,10 +1320,9 @@ emitTrace(Instruction &instruction)
 
 static void emitStats(Instruction &instruction)
 {
-	const std::string &name = instruction.getName();
-	std::cout << "if (Stats::get().getStatsEnabled()) {\n";
-	std::cout << "STATS(\"" << name << "\");\n";
-	std::cout << "}\n";
+  std::cout << "if (stats) {\n";
+  std::cout << "STATS(" << instruction.getName() << ", nextPc);\n";
+  std::cout << "}\n";
 }
 
 static std::string getInstFunctionName(Instruction &inst)
@@ -1133,6 +1337,62 @@ static std::string getOperandDeclarationType(Instruction &inst, unsigned i)
   return "uint32_t";
 }
 
+/// Emit the body of an instruction function. If last is false the body falls
+/// through to the next instruction of a superinstruction instead of
+/// returning.
+static void emitInstFunctionBody(Instruction &inst, bool jit, bool last)
+{
+  if (!jit) {
+    std::cout << "uint32_t nextPc = THREAD.pc + " << inst.getSize()/2;
+    std::cout << ";\n";
+  }
+  FunctionCodeEmitter emitter(jit);
+  emitter.setInstruction(inst);
+  if (inst.getYieldBefore()) {
+    emitter.emitYieldIfTimeSliceExpired();
+  }
+  // Read operands.
+  const std::vector<OpType> &operands = inst.getOperands();
+  for (unsigned i = 0, e = operands.size(); i != e; ++i) {
+    std::cout << "UNUSED(";
+    if (operands[i] == in)
+      std::cout << "const ";
+    std::cout << getOperandDeclarationType(inst, i) <<  " op" << i << ')';
+    switch (operands[i]) {
+    default:
+      break;
+    case in:
+    case inout:
+      if (isSR(inst, i)) {
+        std::cout << " = THREAD.sr";
+      } else {
+        std::cout << " = THREAD.regs[" << getOperandName(inst, i) << ']';
+      }
+      break;
+    case imm:
+      std::cout << " = " << getOperandName(inst, i);
+      break;
+    }
+    std::cout << ";\n";
+  }
+  if (!jit) {
+    emitTrace(inst);
+    emitStats(inst);
+  }
+  emitter.emit(inst.getCode());
+  std::cout << '\n';
+  // Write operands.
+  emitter.emitRegWriteBack();
+  emitter.emitCycles();
+  emitter.emitCount();
+  emitter.emitUpdateExecutionFrequency();
+  if (last) {
+    emitter.emitNormalReturn();
+  } else {
+    emitTraceEnd(inst);
+  }
+}
+
 static void emitInstFunction(Instruction &inst, bool jit)
 {
   if (inst.getCustom() || (jit && inst.getDisableJit()))
@@ -1141,7 +1401,7 @@ static void emitInstFunction(Instruction &inst, bool jit)
   if (jit)
     std::cout << "extern \"C\" ";
   else
-    std::cout << "template <bool tracing>\n";
+    std::cout << "template <bool tracing, bool stats>\n";
   std::cout << "JITReturn " << getInstFunctionName(inst) << '(';
   std::cout << "Thread &thread";
   if (jit) {
@@ -1156,51 +1416,7 @@ static void emitInstFunction(Instruction &inst, bool jit)
   if (inst.getUnimplemented()) {
     std::cout << "ERROR();\n";
   } else {
-    if (!jit) {
-      std::cout << "uint32_t nextPc = THREAD.pc + " << inst.getSize()/2;
-      std::cout << ";\n";
-    }
-    FunctionCodeEmitter emitter(jit);
-    emitter.setInstruction(inst);
-    if (inst.getYieldBefore()) {
-      emitter.emitYieldIfTimeSliceExpired();
-    }
-    // Read operands.
-    const std::vector<OpType> &operands = inst.getOperands();
-    for (unsigned i = 0, e = operands.size(); i != e; ++i) {
-      std::cout << "UNUSED(";
-      if (operands[i] == in)
-        std::cout << "const ";
-      std::cout << getOperandDeclarationType(inst, i) <<  " op" << i << ')';
-      switch (operands[i]) {
-      default:
-        break;
-      case in:
-      case inout:
-        if (isSR(inst, i)) {
-          std::cout << " = THREAD.sr";
-        } else {
-          std::cout << " = THREAD.regs[" << getOperandName(inst, i) << ']';
-        }
-        break;
-      case imm:
-        std::cout << " = " << getOperandName(inst, i);
-        break;
-      }
-      std::cout << ";\n";
-    }
-    if (!jit)
-	{
-      emitTrace(inst);
-	  emitStats(inst);
-    }
-    emitter.emit(inst.getCode());
-    std::cout << '\n';
-    // Write operands.
-    emitter.emitRegWriteBack();
-    emitter.emitCycles();
-    emitter.emitUpdateExecutionFrequency();
-    emitter.emitNormalReturn();
+    emitInstFunctionBody(inst, jit, true);
   }
   std::cout << "}\n";
 }
@@ -1225,6 +1441,222 @@ static void emitJitInstFunctions()
   std::cout << "#endif //EMIT_JIT_INSTRUCTION_FUNCTIONS\n";
 }
 
+/// Returns whether the instruction can be executed directly by the threaded
+/// interpreter. Instructions which access the thread state other than the
+/// registers, or which may stop the thread executing, are executed by
+/// calling the interpreter function instead.
+static bool isThreaded(const Instruction &inst)
+{
+  if (inst.getCustom() || inst.getUnimplemented() || inst.getYieldBefore() ||
+      inst.getCanEvent() || inst.getMayKCall() || inst.getMayPauseOn() ||
+      inst.getMayDeschedule())
+    return false;
+  for (unsigned i = 0, e = inst.getNumOperands(); i != e; ++i) {
+    if (isSR(inst, i))
+      return false;
+  }
+  return inst.getCode().find("THREAD") == std::string::npos;
+}
+
+/// Emit the body of an instruction for the threaded interpreter. If last is
+/// false the body falls through to the next instruction of a
+/// superinstruction instead of dispatching.
+static void emitThreadedInstBody(Instruction &inst, bool last)
+{
+  assert((inst.getSize() & 1) == 0 && "Unexpected instruction size");
+  std::cout << "{\n";
+  std::cout << "uint32_t nextPc = THREADED_PC + " << inst.getSize()/2;
+  std::cout << ";\n";
+  // Read operands.
+  const std::vector<OpType> &operands = inst.getOperands();
+  for (unsigned i = 0, e = operands.size(); i != e; ++i) {
+    std::cout << "UNUSED(";
+    if (operands[i] == in)
+      std::cout << "const ";
+    std::cout << getOperandDeclarationType(inst, i) <<  " op" << i << ')';
+    switch (operands[i]) {
+    default:
+      break;
+    case in:
+    case inout:
+      std::cout << " = THREAD.regs[" << getOperandName(inst, i) << ']';
+      break;
+    case imm:
+      std::cout << " = " << getOperandName(inst, i);
+      break;
+    }
+    std::cout << ";\n";
+  }
+  ThreadedCodeEmitter emitter;
+  emitter.setInstruction(inst);
+  emitter.emit(inst.getCode());
+  std::cout << '\n';
+  // Write operands.
+  emitter.emitRegWriteBack();
+  emitter.emitCycles();
+  emitter.emitCount();
+  emitter.emitUpdateExecutionFrequency();
+  if (last)
+    emitter.emitDispatch();
+  std::cout << "}\n";
+}
+
+static void emitThreadedInst(Instruction &inst)
+{
+  if (!isThreaded(inst))
+    return;
+  std::cout << "THREADED_BLOCK(" << inst.getName() << ")\n";
+  emitThreadedInstBody(inst, true);
+}
+
+static void emitThreadedSuperinstruction(const Superinstruction &super)
+{
+  std::cout << "THREADED_BLOCK(" << super.name << ")\n";
+  for (unsigned i = 0, e = super.insts.size(); i != e; ++i) {
+    emitThreadedInstBody(*super.insts[i], i + 1 == e);
+  }
+}
+
+static void emitThreadedInsts()
+{
+  std::cout << "#ifdef EMIT_THREADED_BLOCKS\n";
+  for (std::vector<Instruction*>::iterator it = instructions.begin(),
+       e = instructions.end(); it != e; ++it) {
+    emitThreadedInst(**it);
+  }
+  for (std::vector<Superinstruction>::iterator it = superinstructions.begin(),
+       e = superinstructions.end(); it != e; ++it) {
+    emitThreadedSuperinstruction(*it);
+  }
+  std::cout << "#endif //EMIT_THREADED_BLOCKS\n";
+}
+
+static void emitThreadedList()
+{
+  std::cout << "#ifdef EMIT_THREADED_LIST\n";
+  for (std::vector<Instruction*>::iterator it = instructions.begin(),
+       e = instructions.end(); it != e; ++it) {
+    if (isThreaded(**it))
+      std::cout << "THREADED_INSTRUCTION(" << (*it)->getName() << ")\n";
+    else
+      std::cout << "THREADED_SLOW_PATH(" << (*it)->getName() << ")\n";
+  }
+  for (std::vector<Superinstruction>::iterator it = superinstructions.begin(),
+       e = superinstructions.end(); it != e; ++it) {
+    std::cout << "THREADED_INSTRUCTION(" << it->name << ")\n";
+  }
+  std::cout << "#endif //EMIT_THREADED_LIST\n";
+}
+
+static void emitSuperinstructionFunction(const Superinstruction &super)
+{
+  std::cout << "template <bool tracing, bool stats>\n";
+  std::cout << "JITReturn Instruction_" << super.name << "(Thread &thread) {\n";
+  for (unsigned i = 0, e = super.insts.size(); i != e; ++i) {
+    std::cout << "{\n";
+    emitInstFunctionBody(*super.insts[i], false, i + 1 == e);
+    std::cout << "}\n";
+  }
+  std::cout << "}\n";
+}
+
+static void emitSuperinstructionFunctions()
+{
+  std::cout << "#ifdef EMIT_SUPERINSTRUCTION_FUNCTIONS\n";
+  for (std::vector<Superinstruction>::iterator it = superinstructions.begin(),
+       e = superinstructions.end(); it != e; ++it) {
+    emitSuperinstructionFunction(*it);
+  }
+  std::cout << "#endif //EMIT_SUPERINSTRUCTION_FUNCTIONS\n";
+}
+
+static void emitSuperinstructionList()
+{
+  std::cout << "#ifdef EMIT_SUPERINSTRUCTION_LIST\n";
+  for (std::vector<Superinstruction>::iterator it = superinstructions.begin(),
+       e = superinstructions.end(); it != e; ++it) {
+    std::cout << "DO_SUPERINSTRUCTION" << it->insts.size() << '(';
+    std::cout << it->name;
+    for (unsigned i = 0, e = it->insts.size(); i != e; ++i) {
+      std::cout << ", " << it->insts[i]->getName();
+    }
+    std::cout << ")\n";
+  }
+  std::cout << "#endif //EMIT_SUPERINSTRUCTION_LIST\n";
+}
+
+static Instruction *findInstruction(const std::string &name)
+{
+  for (std::vector<Instruction*>::iterator it = instructions.begin(),
+       e = instructions.end(); it != e; ++it) {
+    if ((*it)->getName() == name)
+      return *it;
+  }
+  return 0;
+}
+
+/// Returns whether the instruction can be followed by another instruction in
+/// a superinstruction. The instruction must always continue to the next
+/// instruction unless it raises an exception. Stores are excluded since they
+/// may overwrite the following instruction.
+static bool canFallThroughInSuperinstruction(const Instruction &inst)
+{
+  return isThreaded(inst) && !inst.getMayBranch() && !inst.getMayYield() &&
+         !inst.getMayStore();
+}
+
+/// Read the sequences of instructions to fuse into superinstructions. Each
+/// line lists two or three instruction names. Text after a '#' is ignored so
+/// the output of --pair-profile can be used directly.
+static void readSuperinstructions(const char *filename)
+{
+  std::ifstream in(filename);
+  if (!in) {
+    std::cerr << "error: cannot open " << filename << '\n';
+    std::exit(1);
+  }
+  std::string line;
+  unsigned lineNumber = 0;
+  while (std::getline(in, line)) {
+    ++lineNumber;
+    std::string::size_type comment = line.find('#');
+    if (comment != std::string::npos)
+      line.erase(comment);
+    std::istringstream buf(line);
+    Superinstruction super;
+    super.name = "SUPER";
+    std::string name;
+    while (buf >> name) {
+      Instruction *inst = findInstruction(name);
+      if (!inst) {
+        std::cerr << filename << ':' << lineNumber;
+        std::cerr << ": error: unknown instruction " << name << '\n';
+        std::exit(1);
+      }
+      super.insts.push_back(inst);
+      super.name += "_" + name;
+    }
+    if (super.insts.empty())
+      continue;
+    if (super.insts.size() < 2 || super.insts.size() > 3) {
+      std::cerr << filename << ':' << lineNumber;
+      std::cerr << ": error: expected two or three instructions\n";
+      std::exit(1);
+    }
+    bool valid = isThreaded(*super.insts.back());
+    for (unsigned i = 0, e = super.insts.size() - 1; i != e; ++i) {
+      if (!canFallThroughInSuperinstruction(*super.insts[i]))
+        valid = false;
+    }
+    if (!valid) {
+      std::cerr << filename << ':' << lineNumber;
+      std::cerr << ": warning: ignoring " << super.name << '\n';
+      continue;
+    }
+    superinstructions.push_back(super);
+  }
+}
+
 static void emitInstList(Instruction &instruction)
 {
   std::cout << "DO_INSTRUCTION(" << instruction.getName() << ")\n";
@@ -2810,12 +3242,631 @@ void add()
   pseudoInst("DECODE", "", "").setCustom();
 }
 
-int main()
+enum EncodingFlags {
+  /// The immediate operand is a bitp value.
+  ENCODING_BITP = 1 << 0,
+  /// Any of the 16 registers may be encoded in the register operand of the
+  /// ru6 / lru6 instruction. Otherwise values above 11 don't decode.
+  ENCODING_ANY_REGISTER = 1 << 1
+};
+
+/// The encoding of an instruction. The format is given by the suffix of the
+/// instruction's name. See matchesEncoding() for the meaning of the selector.
+struct Encoding {
+  const char *name;
+  /// Bits 15:11 of the first halfword of a short instruction or of the second
+  /// halfword of a long instruction.
+  unsigned major;
+  unsigned selector;
+  unsigned flags;
+};
+
+static const Encoding encodings[] = {
+  { "EDU_1r", 0x00, 0, 0 },
+  { "STW_2rus", 0x00, 0, 0 },
+  { "TINITPC_2r", 0x00, 0, 0 },
+  { "EEU_1r", 0x00, 1, 0 },
+  { "GETST_2r", 0x00, 1, 0 },
+  { "WAITEU_0r", 0x00, 0x7ec, 0 },
+  { "CLRE_0r", 0x00, 0x7ed, 0 },
+  { "SSYNC_0r", 0x00, 0x7ee, 0 },
+  { "FREET_0r", 0x00, 0x7ef, 0 },
+  { "DCALL_0r", 0x00, 0x7fc, 0 },
+  { "KRET_0r", 0x00, 0x7fd, 0 },
+  { "DRET_0r", 0x00, 0x7fe, 0 },
+  { "SETKEP_0r", 0x00, 0x7ff, 0 },
+  { "LDW_2rus", 0x01, 0, 0 },
+  { "TINITDP_2r", 0x01, 0, 0 },
+  { "WAITET_1r", 0x01, 0, 0 },
+  { "OUTT_2r", 0x01, 1, 0 },
+  { "WAITEF_1r", 0x01, 1, 0 },
+  { "LDSPC_0r", 0x01, 0xfec, 0 },
+  { "STSPC_0r", 0x01, 0xfed, 0 },
+  { "LDSSR_0r", 0x01, 0xfee, 0 },
+  { "STSSR_0r", 0x01, 0xfef, 0 },
+  { "STSED_0r", 0x01, 0xffc, 0 },
+  { "STET_0r", 0x01, 0xffd, 0 },
+  { "GETED_0r", 0x01, 0xffe, 0 },
+  { "GETET_0r", 0x01, 0xfff, 0 },
+  { "ADD_3r", 0x02, 0, 0 },
+  { "FREER_1r", 0x02, 0, 0 },
+  { "TINITSP_2r", 0x02, 0, 0 },
+  { "MJOIN_1r", 0x02, 1, 0 },
+  { "SETD_2r", 0x02, 1, 0 },
+  { "DENTSP_0r", 0x02, 0x17ec, 0 },
+  { "DRESTSP_0r", 0x02, 0x17ed, 0 },
+  { "GETID_0r", 0x02, 0x17ee, 0 },
+  { "GETKEP_0r", 0x02, 0x17ef, 0 },
+  { "GETKSP_0r", 0x02, 0x17fc, 0 },
+  { "LDSED_0r", 0x02, 0x17fd, 0 },
+  { "LDET_0r", 0x02, 0x17fe, 0 },
+  { "SUB_3r", 0x03, 0, 0 },
+  { "TINITCP_2r", 0x03, 0, 0 },
+  { "TSTART_1r", 0x03, 0, 0 },
+  { "MSYNC_1r", 0x03, 1, 0 },
+  { "TSETMR_2r", 0x03, 1, 0 },
+  { "BLA_1r", 0x04, 0, 0 },
+  { "SHL_3r", 0x04, 0, 0 },
+  { "BAU_1r", 0x04, 1, 0 },
+  { "EET_2r", 0x04, 1, 0 },
+  { "ANDNOT_2r", 0x05, 0, 0 },
+  { "BRU_1r", 0x05, 0, 0 },
+  { "SHR_3r", 0x05, 0, 0 },
+  { "EEF_2r", 0x05, 1, 0 },
+  { "SETSP_1r", 0x05, 1, 0 },
+  { "EQ_3r", 0x06, 0, 0 },
+  { "SETDP_1r", 0x06, 0, 0 },
+  { "SEXT_2r", 0x06, 0, 0 },
+  { "SETCP_1r", 0x06, 1, 0 },
+  { "SEXT_rus", 0x06, 1, ENCODING_BITP },
+  { "AND_3r", 0x07, 0, 0 },
+  { "DGETREG_1r", 0x07, 0, 0 },
+  { "GETTS_2r", 0x07, 0, 0 },
+  { "SETEV_1r", 0x07, 1, 0 },
+  { "SETPT_2r", 0x07, 1, 0 },
+  { "KCALL_1r", 0x08, 0, 0 },
+  { "OR_3r", 0x08, 0, 0 },
+  { "ZEXT_2r", 0x08, 0, 0 },
+  { "SETV_1r", 0x08, 1, 0 },
+  { "ZEXT_rus", 0x08, 1, ENCODING_BITP },
+  { "ECALLF_1r", 0x09, 0, 0 },
+  { "LDW_3r", 0x09, 0, 0 },
+  { "OUTCT_2r", 0x09, 0, 0 },
+  { "ECALLT_1r", 0x09, 1, 0 },
+  { "OUTCT_rus", 0x09, 1, 0 },
+  { "STWDP_ru6", 0x0a, 0, ENCODING_ANY_REGISTER },
+  { "STWSP_ru6", 0x0a, 1, ENCODING_ANY_REGISTER },
+  { "LDWDP_ru6", 0x0b, 0, ENCODING_ANY_REGISTER },
+  { "LDWSP_ru6", 0x0b, 1, ENCODING_ANY_REGISTER },
+  { "LDAWDP_ru6", 0x0c, 0, ENCODING_ANY_REGISTER },
+  { "LDAWSP_ru6", 0x0c, 1, ENCODING_ANY_REGISTER },
+  { "LDC_ru6", 0x0d, 0, ENCODING_ANY_REGISTER },
+  { "LDWCP_ru6", 0x0d, 1, ENCODING_ANY_REGISTER },
+  { "BRFT_ru6", 0x0e, 0, 0 },
+  { "BRBT_ru6", 0x0e, 1, 0 },
+  { "BRFU_u6", 0x0e, 0xc, 0 },
+  { "BLAT_u6", 0x0e, 0xd, 0 },
+  { "EXTDP_u6", 0x0e, 0xe, 0 },
+  { "KCALL_u6", 0x0e, 0xf, 0 },
+  { "BRBU_u6", 0x0e, 0x1c, 0 },
+  { "ENTSP_u6", 0x0e, 0x1d, 0 },
+  { "EXTSP_u6", 0x0e, 0x1e, 0 },
+  { "RETSP_u6", 0x0e, 0x1f, 0 },
+  { "BRFF_ru6", 0x0f, 0, 0 },
+  { "BRBF_ru6", 0x0f, 1, 0 },
+  { "CLRSR_u6", 0x0f, 0xc, 0 },
+  { "SETSR_u6", 0x0f, 0xd, 0 },
+  { "KENTSP_u6", 0x0f, 0xe, 0 },
+  { "KRESTSP_u6", 0x0f, 0xf, 0 },
+  { "GETSR_u6", 0x0f, 0x1c, 0 },
+  { "LDAWCP_u6", 0x0f, 0x1d, 0 },
+  { "CLRPT_1r", 0x10, 0, 0 },
+  { "GETR_rus", 0x10, 0, 0 },
+  { "LD16S_3r", 0x10, 0, 0 },
+  { "INCT_2r", 0x10, 1, 0 },
+  { "SYNCR_1r", 0x10, 1, 0 },
+  { "LD8U_3r", 0x11, 0, 0 },
+  { "NOT_2r", 0x11, 0, 0 },
+  { "INT_2r", 0x11, 1, 0 },
+  { "ADD_2rus", 0x12, 0, 0 },
+  { "NEG_2r", 0x12, 0, 0 },
+  { "ENDIN_2r", 0x12, 1, 0 },
+  { "SUB_2rus", 0x13, 0, 0 },
+  { "MKMSK_2r", 0x14, 0, 0 },
+  { "SHL_2rus", 0x14, 0, ENCODING_BITP },
+  { "MKMSK_rus", 0x14, 1, ENCODING_BITP },
+  { "OUT_2r", 0x15, 0, 0 },
+  { "SHR_2rus", 0x15, 0, ENCODING_BITP },
+  { "OUTSHR_2r", 0x15, 1, 0 },
+  { "EQ_2rus", 0x16, 0, 0 },
+  { "IN_2r", 0x16, 0, 0 },
+  { "INSHR_2r", 0x16, 1, 0 },
+  { "PEEK_2r", 0x17, 0, 0 },
+  { "TSETR_3r", 0x17, 0, 0 },
+  { "TESTCT_2r", 0x17, 1, 0 },
+  { "LSS_3r", 0x18, 0, 0 },
+  { "SETPSC_2r", 0x18, 0, 0 },
+  { "TESTWCT_2r", 0x18, 1, 0 },
+  { "CHKCT_2r", 0x19, 0, 0 },
+  { "LSU_3r", 0x19, 0, 0 },
+  { "CHKCT_rus", 0x19, 1, 0 },
+  { "BLRF_u10", 0x1a, 0, 0 },
+  { "BLRB_u10", 0x1a, 1, 0 },
+  { "LDAPF_u10", 0x1b, 0, 0 },
+  { "LDAPB_u10", 0x1b, 1, 0 },
+  { "BLACP_u10", 0x1c, 0, 0 },
+  { "LDWCPL_u10", 0x1c, 1, 0 },
+  { "SETC_ru6", 0x1d, 0, 0 },
+  { "CRC8_l4r", 0x00, 0, 0 },
+  { "LDIVU_l5r", 0x00, 0, 0 },
+  { "LMUL_l6r", 0x00, 0, 0 },
+  { "LADD_l5r", 0x00, 1, 0 },
+  { "MACCU_l4r", 0x00, 1, 0 },
+  { "BITREV_l2r", 0x00, 0xc, 0 },
+  { "STW_l3r", 0x00, 0xc, 0 },
+  { "BYTEREV_l2r", 0x00, 0x1c, 0 },
+  { "LSUB_l5r", 0x01, 0, 0 },
+  { "MACCS_l4r", 0x01, 0, 0 },
+  { "CLZ_l2r", 0x01, 0xc, 0 },
+  { "XOR_l3r", 0x01, 0xc, 0 },
+  { "SETCLK_l2r", 0x01, 0x1c, 0 },
+  { "ASHR_l3r", 0x02, 0xc, 0 },
+  { "TINITLR_l2r", 0x02, 0xc, 0 },
+  { "GETPS_l2r", 0x02, 0x1c, 0 },
+  { "LDAWF_l3r", 0x03, 0xc, 0 },
+  { "SETPS_l2r", 0x03, 0xc, 0 },
+  { "GETD_l2r", 0x03, 0x1c, 0 },
+  { "LDAWB_l3r", 0x04, 0xc, 0 },
+  { "TESTLCL_l2r", 0x04, 0xc, 0 },
+  { "SETTW_l2r", 0x04, 0x1c, 0 },
+  { "LDA16F_l3r", 0x05, 0xc, 0 },
+  { "SETRDY_l2r", 0x05, 0xc, 0 },
+  { "SETC_l2r", 0x05, 0x1c, 0 },
+  { "LDA16B_l3r", 0x06, 0xc, 0 },
+  { "SETN_l2r", 0x06, 0xc, 0 },
+  { "GETN_l2r", 0x06, 0x1c, 0 },
+  { "MUL_l3r", 0x07, 0xc, 0 },
+  { "DIVS_l3r", 0x08, 0xc, 0 },
+  { "DIVU_l3r", 0x09, 0xc, 0 },
+  { "STWDP_lru6", 0x0a, 0, ENCODING_ANY_REGISTER },
+  { "STWSP_lru6", 0x0a, 1, ENCODING_ANY_REGISTER },
+  { "LDWDP_lru6", 0x0b, 0, ENCODING_ANY_REGISTER },
+  { "LDWSP_lru6", 0x0b, 1, ENCODING_ANY_REGISTER },
+  { "LDAWDP_lru6", 0x0c, 0, ENCODING_ANY_REGISTER },
+  { "LDAWSP_lru6", 0x0c, 1, ENCODING_ANY_REGISTER },
+  { "LDC_lru6", 0x0d, 0, ENCODING_ANY_REGISTER },
+  { "LDWCP_lru6", 0x0d, 1, ENCODING_ANY_REGISTER },
+  { "BRFT_lru6", 0x0e, 0, 0 },
+  { "BRBT_lru6", 0x0e, 1, 0 },
+  { "BRFU_lu6", 0x0e, 0xc, 0 },
+  { "BLAT_lu6", 0x0e, 0xd, 0 },
+  { "EXTDP_lu6", 0x0e, 0xe, 0 },
+  { "KCALL_lu6", 0x0e, 0xf, 0 },
+  { "BRBU_lu6", 0x0e, 0x1c, 0 },
+  { "ENTSP_lu6", 0x0e, 0x1d, 0 },
+  { "EXTSP_lu6", 0x0e, 0x1e, 0 },
+  { "RETSP_lu6", 0x0e, 0x1f, 0 },
+  { "BRFF_lru6", 0x0f, 0, 0 },
+  { "BRBF_lru6", 0x0f, 1, 0 },
+  { "CLRSR_lu6", 0x0f, 0xc, 0 },
+  { "SETSR_lu6", 0x0f, 0xd, 0 },
+  { "KENTSP_lu6", 0x0f, 0xe, 0 },
+  { "KRESTSP_lu6", 0x0f, 0xf, 0 },
+  { "GETSR_lu6", 0x0f, 0x1c, 0 },
+  { "LDAWCP_lu6", 0x0f, 0x1d, 0 },
+  { "ST16_l3r", 0x10, 0xc, 0 },
+  { "ST8_l3r", 0x11, 0xc, 0 },
+  { "ASHR_l2rus", 0x12, 0xc, ENCODING_BITP },
+  { "OUTPW_l2rus", 0x12, 0xd, 0 },
+  { "INPW_l2rus", 0x12, 0xe, 0 },
+  { "LDAWF_l2rus", 0x13, 0xc, 0 },
+  { "LDAWB_l2rus", 0x14, 0xc, 0 },
+  { "CRC_l3r", 0x15, 0xc, 0 },
+  { "REMS_l3r", 0x18, 0xc, 0 },
+  { "REMU_l3r", 0x19, 0xc, 0 },
+  { "BLRF_lu10", 0x1a, 0, 0 },
+  { "BLRB_lu10", 0x1a, 1, 0 },
+  { "LDAPF_lu10", 0x1b, 0, 0 },
+  { "LDAPB_lu10", 0x1b, 1, 0 },
+  { "BLACP_lu10", 0x1c, 0, 0 },
+  { "LDWCPL_lu10", 0x1c, 1, 0 },
+  { "SETC_lru6", 0x1d, 0, 0 },
+};
+
+enum DecodeFormat {
+  FORMAT_0R,
+  FORMAT_1R,
+  FORMAT_2R,
+  FORMAT_RUS,
+  FORMAT_3R,
+  FORMAT_2RUS,
+  FORMAT_RU6,
+  FORMAT_U6,
+  FORMAT_U10,
+  FORMAT_LRU6,
+  FORMAT_LU6,
+  FORMAT_LU10,
+  FORMAT_L2R,
+  FORMAT_L3R,
+  FORMAT_L2RUS,
+  FORMAT_L4R,
+  FORMAT_L5R,
+  FORMAT_L6R
+};
+
+static const struct {
+  const char *suffix;
+  DecodeFormat format;
+} decodeFormats[] = {
+  { "0r", FORMAT_0R },
+  { "1r", FORMAT_1R },
+  { "2r", FORMAT_2R },
+  { "rus", FORMAT_RUS },
+  { "3r", FORMAT_3R },
+  { "2rus", FORMAT_2RUS },
+  { "ru6", FORMAT_RU6 },
+  { "u6", FORMAT_U6 },
+  { "u10", FORMAT_U10 },
+  { "lru6", FORMAT_LRU6 },
+  { "lu6", FORMAT_LU6 },
+  { "lu10", FORMAT_LU10 },
+  { "l2r", FORMAT_L2R },
+  { "l3r", FORMAT_L3R },
+  { "l2rus", FORMAT_L2RUS },
+  { "l4r", FORMAT_L4R },
+  { "l5r", FORMAT_L5R },
+  { "l6r", FORMAT_L6R },
+};
+
+static std::string getEncodingSuffix(const Encoding &encoding)
+{
+  std::string name = encoding.name;
+  return name.substr(name.rfind('_') + 1);
+}
+
+static DecodeFormat getDecodeFormat(const Encoding &encoding)
+{
+  std::string suffix = getEncodingSuffix(encoding);
+  for (unsigned i = 0; i < sizeof(decodeFormats) / sizeof(decodeFormats[0]);
+       i++) {
+    if (suffix == decodeFormats[i].suffix)
+      return decodeFormats[i].format;
+  }
+  std::cerr << "error: unknown format for " << encoding.name << '\n';
+  std::exit(1);
+}
+
+/// Returns the name of the function in Instruction.cpp which extracts the
+/// operands of an instruction with the encoding.
+static std::string getOperandDecoderName(const Encoding &encoding)
+{
+  std::string name = "decode";
+  std::string suffix = getEncodingSuffix(encoding);
+  for (unsigned i = 0, e = suffix.size(); i != e; i++) {
+    name += std::toupper(suffix[i]);
+  }
+  if (encoding.flags & ENCODING_BITP)
+    name += "Bitp";
+  return name + "Operands";
+}
+
+static unsigned bitRange(unsigned value, unsigned high, unsigned low)
+{
+  return (value >> low) & ((1 << (1 + high - low)) - 1);
+}
+
+static unsigned bit(unsigned value, unsigned shift)
+{
+  return bitRange(value, shift, shift);
+}
+
+/// Returns whether the halfword has the operand encoding shared by the 3r,
+/// 2rus formats and the second halfword of the l6r format.
+static bool is3ROperandEncoding(unsigned halfword)
+{
+  return bitRange(halfword, 10, 6) < 27;
+}
+
+/// Returns whether the halfword has the operand encoding shared by the 2r and
+/// rus formats and the second halfword of the l5r format.
+static bool is2ROperandEncoding(unsigned halfword)
+{
+  if (is3ROperandEncoding(halfword))
+    return false;
+  return (bitRange(halfword, 10, 6) - 27) + bit(halfword, 5) * 5 < 9;
+}
+
+static bool is1ROperandEncoding(unsigned halfword)
+{
+  return bitRange(halfword, 10, 5) == 0x3f && bitRange(halfword, 3, 0) < 12;
+}
+
+/// Classes of the first halfword of a long instruction which select the long
+/// instructions it may start.
+enum PrefixClass {
+  PREFIX_3R,
+  PREFIX_2R_BIT4_CLEAR,
+  PREFIX_2R_BIT4_SET,
+  PREFIX_NONE,
+  NUM_PREFIX_CLASSES
+};
+
+static PrefixClass getPrefixClass(unsigned low)
+{
+  if (is3ROperandEncoding(low))
+    return PREFIX_3R;
+  if (is2ROperandEncoding(low))
+    return bit(low, 4) ? PREFIX_2R_BIT4_SET : PREFIX_2R_BIT4_CLEAR;
+  return PREFIX_NONE;
+}
+
+/// Returns whether the halfword holding the major opcode of an instruction
+/// matches the encoding. Long instructions encoded after an EOPR prefix also
+/// depend on the class of the first halfword. Long instructions encoded after
+/// a PFIX prefix are matched against the second halfword in the same way as
+/// the short form with the same name.
+static bool
+matchesEncoding(const Encoding &encoding, unsigned halfword,
+                PrefixClass prefixClass)
+{
+  if (bitRange(halfword, 15, 11) != encoding.major)
+    return false;
+  unsigned selector = encoding.selector;
+  switch (getDecodeFormat(encoding)) {
+  case FORMAT_0R:
+    return halfword == selector;
+  case FORMAT_1R:
+    return is1ROperandEncoding(halfword) && bit(halfword, 4) == selector;
+  case FORMAT_2R:
+  case FORMAT_RUS:
+    return is2ROperandEncoding(halfword) && bit(halfword, 4) == selector;
+  case FORMAT_3R:
+  case FORMAT_2RUS:
+    return is3ROperandEncoding(halfword);
+  case FORMAT_RU6:
+  case FORMAT_LRU6:
+    if (!(encoding.flags & ENCODING_ANY_REGISTER) &&
+        bitRange(halfword, 9, 6) >= 12)
+      return false;
+    return bit(halfword, 10) == selector;
+  case FORMAT_U6:
+  case FORMAT_LU6:
+    return bitRange(halfword, 10, 6) == selector;
+  case FORMAT_U10:
+  case FORMAT_LU10:
+    return bit(halfword, 10) == selector;
+  case FORMAT_L2R:
+    if (prefixClass != PREFIX_2R_BIT4_CLEAR &&
+        prefixClass != PREFIX_2R_BIT4_SET)
+      return false;
+    return bitRange(halfword, 10, 4) == 0x7e &&
+           (((prefixClass == PREFIX_2R_BIT4_SET) << 4) |
+            bitRange(halfword, 3, 0)) == selector;
+  case FORMAT_L3R:
+  case FORMAT_L2RUS:
+    return prefixClass == PREFIX_3R && bitRange(halfword, 10, 4) == 0x7e &&
+           bitRange(halfword, 3, 0) == selector;
+  case FORMAT_L4R:
+    return prefixClass == PREFIX_3R && is1ROperandEncoding(halfword) &&
+           bit(halfword, 4) == selector;
+  case FORMAT_L5R:
+    return prefixClass == PREFIX_3R && is2ROperandEncoding(halfword) &&
+           bit(halfword, 4) == selector;
+  case FORMAT_L6R:
+    return prefixClass == PREFIX_3R && is3ROperandEncoding(halfword);
+  }
+  return false;
+}
+
+enum EncodingKind {
+  SHORT_ENCODING,
+  /// A long instruction whose first halfword is a PFIX prefix.
+  PREFIXED_ENCODING,
+  /// A long instruction whose first halfword is an EOPR prefix.
+  EXTENDED_ENCODING
+};
+
+static EncodingKind getEncodingKind(const Encoding &encoding)
+{
+  switch (getDecodeFormat(encoding)) {
+  default:
+    return SHORT_ENCODING;
+  case FORMAT_LRU6:
+  case FORMAT_LU6:
+  case FORMAT_LU10:
+    return PREFIXED_ENCODING;
+  case FORMAT_L2R:
+  case FORMAT_L3R:
+  case FORMAT_L2RUS:
+  case FORMAT_L4R:
+  case FORMAT_L5R:
+  case FORMAT_L6R:
+    return EXTENDED_ENCODING;
+  }
+}
+
+/// Returns the encoding of the specified kind which matches the halfword or
+/// 0 if there is none.
+static const Encoding *
+findEncoding(EncodingKind kind, unsigned halfword, PrefixClass prefixClass)
+{
+  const Encoding *found = 0;
+  for (unsigned i = 0; i < sizeof(encodings) / sizeof(encodings[0]); i++) {
+    const Encoding &encoding = encodings[i];
+    if (encoding.major != bitRange(halfword, 15, 11) ||
+        getEncodingKind(encoding) != kind ||
+        !matchesEncoding(encoding, halfword, prefixClass))
+      continue;
+    if (found) {
+      std::cerr << "error: " << found->name << " and " << encoding.name;
+      std::cerr << " have overlapping encodings\n";
+      std::exit(1);
+    }
+    found = &encoding;
+  }
+  return found;
+}
+
+enum {
+  PFIX = 0x1e,
+  EOPR = 0x1f
+};
+
+/// The decode information for a halfword. The first halfword of a long
+/// instruction decodes as ILLEGAL_PC if the second halfword is outside of
+/// memory.
+struct DecodeInfo {
+  std::string opcode;
+  std::string operandDecoder;
+  bool isLong;
+  unsigned longColumn;
+  DecodeInfo(const std::string &o, const std::string &d) :
+    opcode(o), operandDecoder(d), isLong(false), longColumn(0) {}
+  DecodeInfo(unsigned column) :
+    opcode("ILLEGAL_PC"), operandDecoder("decode0ROperands"), isLong(true),
+    longColumn(column) {}
+  DecodeInfo(const Encoding *encoding) :
+    opcode(encoding ? encoding->name : "ILLEGAL_INSTRUCTION"),
+    operandDecoder(encoding ? getOperandDecoderName(*encoding) :
+                              "decode0ROperands"),
+    isLong(false), longColumn(0) {}
+  bool operator<(const DecodeInfo &other) const {
+    if (opcode != other.opcode)
+      return opcode < other.opcode;
+    return longColumn < other.longColumn;
+  }
+};
+
+/// Columns of the long decode classes. The first halfword of a long
+/// instruction selects a column, the second halfword selects the class.
+static unsigned getLongColumn(bool prefixed, PrefixClass prefixClass)
+{
+  return prefixed * NUM_PREFIX_CLASSES + prefixClass;
+}
+
+enum {
+  NUM_LONG_COLUMNS = 2 * NUM_PREFIX_CLASSES
+};
+
+class DecodeInfoTable {
+  std::vector<DecodeInfo> entries;
+  std::map<DecodeInfo, unsigned> indices;
+public:
+  unsigned get(const DecodeInfo &info) {
+    std::map<DecodeInfo, unsigned>::iterator it = indices.find(info);
+    if (it != indices.end())
+      return it->second;
+    entries.push_back(info);
+    return indices[info] = entries.size() - 1;
+  }
+  unsigned size() const { return entries.size(); }
+  const DecodeInfo &operator[](unsigned i) const { return entries[i]; }
+};
+
+static void emitDecodeTable(const char *type, const char *name,
+                            const std::vector<unsigned> &table)
+{
+  std::cout << "static const " << type << ' ' << name << "[] = {";
+  for (unsigned i = 0, e = table.size(); i != e; i++) {
+    if (i % 16 == 0)
+      std::cout << "\n ";
+    std::cout << ' ' << table[i] << ',';
+  }
+  std::cout << "\n};\n";
+}
+
+/// Emit the tables used by instructionDecode(). The first halfword of an
+/// instruction indexes the short decode table which gives the entry of the
+/// decode info array to use. For the first halfword of a long instruction
+/// the entry gives a column of the long decode classes and the second
+/// halfword indexes the long decode table which gives the class.
+static void emitDecodeTables()
+{
+  DecodeInfoTable decodeInfo;
+  // Encodings which match no instruction decode as ILLEGAL_INSTRUCTION, make
+  // it the first entry.
+  decodeInfo.get(DecodeInfo(static_cast<const Encoding*>(0)));
+  std::vector<unsigned> shortTable(1 << 16);
+  for (unsigned low = 0; low < (1 << 16); low++) {
+    unsigned major = bitRange(low, 15, 11);
+    if (major == PFIX || major == EOPR) {
+      bool prefixed = major == PFIX && bit(low, 10) == 0;
+      unsigned column = getLongColumn(prefixed, getPrefixClass(low));
+      shortTable[low] = decodeInfo.get(DecodeInfo(column));
+    } else {
+      const Encoding *encoding = findEncoding(SHORT_ENCODING, low, PREFIX_NONE);
+      shortTable[low] = decodeInfo.get(DecodeInfo(encoding));
+    }
+  }
+  std::vector<std::vector<unsigned> > longClasses;
+  std::map<std::vector<unsigned>, unsigned> longClassIndices;
+  std::vector<unsigned> longTable(1 << 16);
+  for (unsigned high = 0; high < (1 << 16); high++) {
+    std::vector<unsigned> longClass(NUM_LONG_COLUMNS);
+    const Encoding *prefixed =
+      findEncoding(PREFIXED_ENCODING, high, PREFIX_NONE);
+    for (unsigned i = 0; i < NUM_PREFIX_CLASSES; i++) {
+      PrefixClass prefixClass = static_cast<PrefixClass>(i);
+      const Encoding *extended =
+        findEncoding(EXTENDED_ENCODING, high, prefixClass);
+      longClass[getLongColumn(false, prefixClass)] =
+        decodeInfo.get(DecodeInfo(extended));
+      // If the second halfword doesn't match an instruction encoded after
+      // a PFIX prefix then it is decoded as if the prefix were EOPR.
+      longClass[getLongColumn(true, prefixClass)] =
+        decodeInfo.get(DecodeInfo(prefixed ? prefixed : extended));
+    }
+    std::map<std::vector<unsigned>, unsigned>::iterator it =
+      longClassIndices.find(longClass);
+    if (it == longClassIndices.end()) {
+      it = longClassIndices.insert(std::make_pair(longClass,
+                                                  longClasses.size())).first;
+      longClasses.push_back(longClass);
+    }
+    longTable[high] = it->second;
+  }
+  const char *infoIndexType = decodeInfo.size() <= 256 ? "uint8_t" : "uint16_t";
+  const char *classIndexType =
+    longClasses.size() <= 256 ? "uint8_t" : "uint16_t";
+
+  std::cout << "#ifdef EMIT_DECODE_TABLES\n";
+  std::cout << "static const InstructionDecodeInfo ";
+  std::cout << "instructionDecodeInfo[] = {\n";
+  for (unsigned i = 0, e = decodeInfo.size(); i != e; i++) {
+    const DecodeInfo &info = decodeInfo[i];
+    std::cout << "  { " << info.opcode << ", &" << info.operandDecoder << ", ";
+    std::cout << (info.isLong ? "true" : "false") << ", " << info.longColumn;
+    std::cout << " },\n";
+  }
+  std::cout << "};\n";
+  emitDecodeTable(infoIndexType, "shortDecodeTable", shortTable);
+  std::cout << "static const " << infoIndexType;
+  std::cout << " longDecodeClasses[][" << NUM_LONG_COLUMNS << "] = {\n";
+  for (unsigned i = 0, e = longClasses.size(); i != e; i++) {
+    std::cout << "  {";
+    for (unsigned j = 0; j < NUM_LONG_COLUMNS; j++) {
+      std::cout << ' ' << longClasses[i][j] << ',';
+    }
+    std::cout << " },\n";
+  }
+  std::cout << "};\n";
+  emitDecodeTable(classIndexType, "longDecodeTable", longTable);
+  std::cout << "#endif //EMIT_DECODE_TABLES\n";
+}
+
+int main(int argc, char **argv)
 {
   add();
   analyze();
+  if (argc > 1)
+    readSuperinstructions(argv[1]);
   emitInstFunctions();
   emitJitInstFunctions();
+  emitSuperinstructionFunctions();
+  emitThreadedInsts();
+  emitThreadedList();
   emitInstList();
+  emitSuperinstructionList();
   emitInstProperties();
+  emitDecodeTables();
 }
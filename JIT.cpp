@@ -22,28 +22,140 @@
 #include "LLVMExtra.h"
 #include "InstructionProperties.h"
 #include "JITOptimize.h"
+#include "JITCache.h"
+#include "HostThread.h"
+#include "Stats.h"
 #include <iostream>
+#include <iomanip>
 #include <cstdlib>
 #include <cassert>
+#include <algorithm>
+#include <deque>
 #include <map>
 #include <vector>
 
+/// Key identifying the regions for which the same code is compiled: the
+/// tier, the memory layout of the core and the pcs and contents of each
+/// fragment.
+typedef std::vector<uint32_t> JITSharedKey;
+
+/// A function shared by all cores that compiled the same region.
+struct JITSharedFunction {
+  explicit JITSharedFunction(const JITSharedKey &k) :
+    key(k), value(0), thunk(0), thunkCode(0), codeSize(0), users(0),
+    lastUsed(0) {}
+  JITSharedKey key;
+  LLVMValueRef value;
+  LLVMValueRef thunk;
+  JITInstructionFunction_t thunkCode;
+  /// Size in bytes of the machine code for the function and its thunk.
+  size_t codeSize;
+  /// Number of functions of any core referring to the shared function.
+  unsigned users;
+  /// The value of the use epoch when the function was last entered from the
+  /// dispatch loop of any core.
+  volatile uint32_t lastUsed;
+};
+
 struct JITFunctionInfo {
   explicit JITFunctionInfo(uint32_t a) :
-    pc(a), value(0), func(0), isStub(false) {}
+    pc(a), value(0), func(0), thunk(0), isStub(false), optimized(false),
+    installed(false), invalidated(false), codeSize(0), lastUsed(0),
+    shared(0) {}
   JITFunctionInfo(uint32_t a, LLVMValueRef v, JITInstructionFunction_t f,
                   bool s) :
-    pc(a), value(v), func(f), isStub(s) {}
+    pc(a), value(v), func(f), thunk(0), isStub(s), optimized(false),
+    installed(false), invalidated(false), codeSize(0), lastUsed(0),
+    shared(0) {}
   uint32_t pc;
   LLVMValueRef value;
   JITInstructionFunction_t func;
+  /// The function called from the core's opcode array, if any.
+  LLVMValueRef thunk;
+  /// Functions which call this function.
   std::set<JITFunctionInfo*> references;
+  /// Functions called by this function.
+  std::set<JITFunctionInfo*> callees;
+  /// Stubs and baseline functions replaced by this function. These now
+  /// forward to this function.
+  std::vector<LLVMValueRef> forwardingStubs;
   bool isStub;
+  /// Whether the function was compiled by the optimizing tier.
+  bool optimized;
+  /// Whether the function has been added to the function map.
+  bool installed;
+  /// Set if a callee is invalidated before the function is installed.
+  bool invalidated;
+  /// The start of the fragments other than the first that were compiled into
+  /// the function.
+  std::vector<uint32_t> memberPcs;
+  /// The start and end pcs of every fragment compiled into the function.
+  std::vector<std::pair<uint32_t,uint32_t> > fragmentRanges;
+  /// Size in bytes of the machine code for the function, its thunk and its
+  /// forwarding stubs.
+  size_t codeSize;
+  /// The value of the use epoch when the function was last entered from the
+  /// dispatch loop.
+  volatile uint32_t lastUsed;
+  /// The region as recorded in the persistent cache.
+  JITCacheRegion cacheRegion;
+  /// If set, the code belongs to a function shared with other cores and
+  /// the value, thunk and code size are those of the shared function.
+  JITSharedFunction *shared;
+};
+
+/// A fragment decoded by the simulation thread, ready to be compiled.
+struct JITFragment {
+  uint32_t startPc;
+  /// The pc after the last instruction in the fragment.
+  uint32_t endPc;
+  std::vector<InstructionOpcode> opcode;
+  std::vector<Operands> operands;
+  /// The contents of memory between startPc and endPc when the fragment was
+  /// decoded.
+  std::vector<uint16_t> code;
+};
+
+/// Fragments compiled into a single function. The first fragment is the
+/// entry point.
+typedef std::vector<JITFragment> JITRegion;
+
+/// Map from the pc of an indirect branch to the targets seen by baseline code.
+typedef std::map<uint32_t, JITIndirectBranchProfile> JITIndirectBranchProfiles;
+
+struct JITCompileRequest {
+  JITCompileRequest(Core &c, bool o) : core(c), optimize(o) {}
+  Core &core;
+  /// Whether to compile with the optimizing tier.
+  bool optimize;
+  std::vector<JITRegion> regions;
+  /// Targets of the indirect branches in the regions, copied by the
+  /// simulation thread for requests compiled with the optimizing tier.
+  JITIndirectBranchProfiles indirectBranchProfiles;
+};
+
+/// A region that has been compiled but not yet installed.
+struct JITCompiledRegion {
+  JITFunctionInfo *info;
+  JITInstructionFunction_t thunk;
+  /// The fragments of the region. Only the pcs and code are kept.
+  JITRegion fragments;
 };
 
 struct JITCoreInfo {
-  std::vector<uint32_t> unreachableFunctions;
+  std::vector<JITFunctionInfo*> unreachableFunctions;
   std::map<uint32_t, JITFunctionInfo*> functionMap;
+  /// Map from the start of fragments compiled into a function other than as
+  /// its entry point to the function.
+  std::multimap<uint32_t, JITFunctionInfo*> regionMembers;
+  std::vector<JITCompiledRegion> compiledRegions;
+  /// Targets of indirect branches seen by baseline code. The targets are
+  /// written without a lock by the simulation thread through pointers
+  /// embedded in the compiled code and are only read on that thread. Nodes
+  /// are only added while holding both JITImpl::mutex and
+  /// JITImpl::profileMutex so the simulation thread may look up entries
+  /// holding either.
+  JITIndirectBranchProfiles indirectBranchProfiles;
   ~JITCoreInfo();
 };
 
@@ -53,6 +165,16 @@ JITCoreInfo::~JITCoreInfo()
        e = functionMap.end(); it != e; ++it) {
     delete it->second;
   }
+  for (std::vector<JITFunctionInfo*>::iterator
+       it = unreachableFunctions.begin(), e = unreachableFunctions.end();
+       it != e; ++it) {
+    delete *it;
+  }
+  for (std::vector<JITCompiledRegion>::iterator
+       it = compiledRegions.begin(), e = compiledRegions.end(); it != e;
+       ++it) {
+    delete it->info;
+  }
 }
 
 class JITImpl {
@@ -67,6 +189,12 @@ class JITImpl {
     LLVMValueRef jitInvalidateShortCheck;
     LLVMValueRef jitInvalidateWordCheck;
     LLVMValueRef jitInterpretOne;
+    LLVMValueRef jitUpdateBaselineExecutionCount;
+    LLVMValueRef jitUpdateRetiredCount;
+    LLVMValueRef jitUpdateInstructionCount;
+    LLVMValueRef jitRecordIndirectBranch;
+    LLVMValueRef jitPushReturnAddress;
+    LLVMValueRef jitPopReturnAddress;
     void init(LLVMModuleRef mod);
   };
   Functions functions;
@@ -74,6 +202,9 @@ class JITImpl {
   LLVMBuilderRef builder;
   LLVMExecutionEngineRef executionEngine;
   LLVMTypeRef jitFunctionType;
+  /// Passes run on functions compiled by the baseline tier.
+  LLVMPassManagerRef baselineFPM;
+  /// Passes run on functions compiled by the optimizing tier.
   LLVMPassManagerRef FPM;
 
   std::map<const Core*,JITCoreInfo*> jitCoreMap;
@@ -87,12 +218,87 @@ class JITImpl {
   LLVMBasicBlockRef endTraceBB;
   LLVMValueRef earlyReturnPhi;
   std::vector<LLVMValueRef> calls;
+  /// Map from the start of each fragment in the region being compiled to
+  /// the basic block containing its code.
+  std::map<uint32_t,LLVMBasicBlockRef> regionBlocks;
+  /// Targets of the indirect branches in the request being compiled.
+  const JITIndirectBranchProfiles *requestProfiles;
+  /// The number of instructions retired since the emitted code last updated
+  /// the thread's count of instructions retired by compiled code.
+  unsigned pendingRetiredCount;
+  /// The number of times each instruction has executed since the emitted
+  /// code last updated the thread's instruction counts.
+  std::map<InstructionOpcode,unsigned> pendingInstructionCounts;
+  /// Whether the code being emitted updates the thread's instruction counts.
+  bool countInstructions;
+
+  /// Compile requests waiting for the worker thread.
+  std::deque<JITCompileRequest*> queue;
+  /// Protects the queue and the worker state.
+  Mutex queueMutex;
+  /// Signalled when a request is added to the queue or on shutdown.
+  ConditionVariable queueNotEmpty;
+  HostThread worker;
+  bool backgroundCompilation;
+  bool workerStarted;
+  bool shutdown;
+
+  JIT::TierPolicy tierPolicy;
+  uint32_t tierUpThreshold;
+
+  // Statistics, indexed by tier.
+  enum {
+    BASELINE_TIER,
+    OPTIMIZING_TIER,
+    NUM_TIERS
+  };
+  uint64_t regionsCompiled[NUM_TIERS];
+  uint64_t fragmentsCompiled[NUM_TIERS];
+  /// Host time spent compiling in seconds.
+  double compileTime[NUM_TIERS];
+  uint64_t regionsTieredUp;
+  uint64_t regionsDiscarded;
+  /// Number of indirect branches compiled with an inline cache.
+  uint64_t inlineCaches;
+  /// Total size in bytes of the machine code of all functions.
+  size_t codeCacheSize;
+  /// Size the code cache is kept under by evicting functions, or 0 for no
+  /// limit.
+  size_t codeCacheLimit;
+  /// Incremented each time functions are evicted. Functions record the
+  /// current epoch when they are entered.
+  volatile uint32_t useEpoch;
+  uint64_t functionsEvicted;
+  /// Directory holding the persistent cache, or empty if it isn't used.
+  std::string cacheDirectory;
+  /// Regions read from each cache file.
+  std::map<std::string,std::vector<JITCacheRegion> > cacheFiles;
+  /// Cores for which the cache has been read.
+  std::set<const Core*> cacheLoaded;
+  uint64_t cachedRegionsLoaded;
+  /// Whether code is shared between cores.
+  bool codeSharing;
+  std::map<JITSharedKey,JITSharedFunction*> sharedFunctions;
+  /// Number of regions which reused code compiled for another core.
+  uint64_t regionsShared;
+  uint64_t requestsQueued;
+  uint64_t totalQueueDepth;
+  size_t maxQueueDepth;
 
   void init();
+  static void workerMain(void *arg);
+  void runWorker();
+  bool startWorker();
+  void compileRequest(JITCompileRequest &request);
+  void enqueueOrCompile(JITCompileRequest *request);
+  bool installRegion(Core &core, JITCoreInfo &coreInfo,
+                     JITCompiledRegion &compiled);
+  void removeRegionMembers(JITCoreInfo &coreInfo, JITFunctionInfo *info);
+  void deleteFunction(JITFunctionInfo *info);
+  void releaseSharedFunction(JITSharedFunction *shared);
   LLVMValueRef getCurrentFunction();
   void resetPerFunctionState();
   void reclaimUnreachableFunctions(JITCoreInfo &coreInfo);
-  void reclaimUnreachableFunctions();
   void emitCondEarlyReturn(LLVMValueRef cond, LLVMValueRef retval);
   void checkReturnValue(LLVMValueRef call, InstructionProperties &properties);
   void emitCondBrToBlock(LLVMValueRef cond, LLVMBasicBlockRef trueBB);
@@ -104,30 +310,101 @@ class JITImpl {
   JITFunctionInfo *getJITFunctionOrStubImpl(JITCoreInfo &coreInfo, uint32_t pc);
   LLVMValueRef getJITFunctionOrStub(JITCoreInfo &coreIfno, uint32_t pc,
                                     JITFunctionInfo *caller);
-  bool compileOneFragment(Core &core, JITCoreInfo &coreInfo, uint32_t pc,
-                          bool &endOfBlock, uint32_t &nextPc);
+  void emitFragment(JITCoreInfo &coreInfo, JITFragment &fragment,
+                    LLVMValueRef ramBase, JITFunctionInfo *info);
+  JITFunctionInfo *compileRegion(JITCoreInfo &coreInfo, JITRegion &region,
+                                 unsigned regsOffset,
+                                 uint32_t ramBase, uint32_t ramSizeLog2,
+                                 bool optimize);
+  void emitUpdateBaselineExecutionCount(uint32_t pc);
+  void addPendingInstruction(InstructionOpcode opc);
+  void emitUpdateInstructionCounts();
+  void replaceFunction(JITCoreInfo &coreInfo, JITFunctionInfo *old,
+                       JITFunctionInfo *info);
   LLVMBasicBlockRef getOrCreateMemoryCheckBailoutBlock(unsigned index);
   void emitMemoryChecks(unsigned index,
-                        std::queue<std::pair<uint32_t,MemoryCheck*> > &checks);
+                        std::queue<std::pair<uint32_t,MemoryCheck*> > &checks,
+                        bool optimized);
   LLVMValueRef getJitInvalidateFunction(unsigned size);
+  void emitReturnToDispatchLoop();
   void emitJumpToNextFragment(JITCoreInfo &coreInfo, uint32_t targetPc,
                               JITFunctionInfo *caller);
   bool emitJumpToNextFragment(InstructionOpcode opc, const Operands &operands,
                               JITCoreInfo &coreInfo, uint32_t nextPc,
                               JITFunctionInfo *caller);
+  void emitPushReturnAddress(JITCoreInfo &coreInfo, uint32_t returnPc,
+                             JITFunctionInfo *caller);
+  void emitIndirectBranch(JITCoreInfo &coreInfo, InstructionOpcode opc,
+                          uint32_t pc, JITFunctionInfo *caller);
   JITInstructionFunction_t getFunctionThunk(JITFunctionInfo &info);
+  JITInstructionFunction_t shareFunction(JITFunctionInfo &info,
+                                         const JITSharedKey &key);
+  void addCodeSize(JITFunctionInfo &info, LLVMValueRef f);
+  void evictFunction(Core &core, JITCoreInfo &coreInfo, JITFunctionInfo *info);
+  void loadCache(Core &core);
+  void copyIndirectBranchProfiles(JITCompileRequest &request);
+  void resetIndirectBranchProfiles(JITCoreInfo &coreInfo,
+                                   const JITFunctionInfo &info);
 public:
-  JITImpl() : initialized(false) {}
+  JITImpl() :
+    initialized(false),
+    requestProfiles(0),
+    backgroundCompilation(true),
+    workerStarted(false),
+    shutdown(false),
+    tierPolicy(JIT::TIERED),
+    tierUpThreshold(JIT_TIER_UP_THRESHOLD),
+    regionsTieredUp(0),
+    regionsDiscarded(0),
+    inlineCaches(0),
+    codeCacheSize(0),
+    codeCacheLimit(0),
+    useEpoch(0),
+    functionsEvicted(0),
+    cachedRegionsLoaded(0),
+    codeSharing(false),
+    regionsShared(0),
+    requestsQueued(0),
+    totalQueueDepth(0),
+    maxQueueDepth(0)
+  {
+    for (unsigned i = 0; i < NUM_TIERS; i++) {
+      regionsCompiled[i] = 0;
+      fragmentsCompiled[i] = 0;
+      compileTime[i] = 0;
+    }
+  }
   ~JITImpl();
   static JITImpl instance;
+  /// Serialises use of LLVM and of the JIT's per core state by the worker
+  /// thread and by cores running on different host threads.
+  Mutex mutex;
+  /// Protects the set of cores and of indirect branch profiles while they
+  /// are read by the simulation thread outside of mutex.
+  Mutex profileMutex;
+  /// Set while the worker thread is compiling a request.
+  AtomicFlag compiling;
   bool invalidate(Core &c, uint32_t pc);
   void compileBlock(Core &core, uint32_t pc);
+  void optimizeRegion(Core &core, uint32_t pc);
+  void installCompiledCode(Core &core);
+  void setBackgroundCompilation(bool enable) { backgroundCompilation = enable; }
+  void setTierPolicy(JIT::TierPolicy policy) { tierPolicy = policy; }
+  void setTierUpThreshold(uint32_t threshold) { tierUpThreshold = threshold; }
+  void setCodeCacheLimit(size_t bytes) { codeCacheLimit = bytes; }
+  void setCodeSharing(bool enable) { codeSharing = enable; }
+  void evictColdFunctions(Core &core);
+  void setCacheDirectory(const std::string &dir) { cacheDirectory = dir; }
+  void writeCache();
+  void stopWorker();
+  void dumpStats(std::ostream &out);
 };
 
 JITImpl JITImpl::instance;
 
 JITImpl::~JITImpl()
 {
+  stopWorker();
   for (std::map<const Core*,JITCoreInfo*>::iterator it = jitCoreMap.begin(),
        e = jitCoreMap.end(); it != e; ++it) {
     delete it->second;
@@ -149,6 +426,12 @@ void JITImpl::Functions::init(LLVMModuleRef module)
     { "jitInvalidateShortCheck", &jitInvalidateShortCheck },
     { "jitInvalidateWordCheck", &jitInvalidateWordCheck },
     { "jitInterpretOne", &jitInterpretOne },
+    { "jitUpdateBaselineExecutionCount", &jitUpdateBaselineExecutionCount },
+    { "jitUpdateRetiredCount", &jitUpdateRetiredCount },
+    { "jitUpdateInstructionCount", &jitUpdateInstructionCount },
+    { "jitRecordIndirectBranch", &jitRecordIndirectBranch },
+    { "jitPushReturnAddress", &jitPushReturnAddress },
+    { "jitPopReturnAddress", &jitPopReturnAddress },
   };
   for (unsigned i = 0; i < ARRAY_SIZE(initInfo); i++) {
     *initInfo[i].ref = LLVMGetNamedFunction(module, initInfo[i].name);
@@ -176,6 +459,7 @@ void JITImpl::init()
     std::cerr << "Error creating JIT compiler: " << outMessage << '\n';
     std::abort();
   }
+  LLVMExtraEnableCodeSizeTracking(executionEngine);
   builder = LLVMCreateBuilder();
   LLVMValueRef callee = LLVMGetNamedFunction(module, "jitInstructionTemplate");
   assert(callee && "jitInstructionTemplate() not found in module");
@@ -183,7 +467,9 @@ void JITImpl::init()
   functions.init(module);
   FPM = LLVMCreateFunctionPassManagerForModule(module);
   LLVMAddTargetData(LLVMGetExecutionEngineTargetData(executionEngine), FPM);
+  LLVMAddTypeBasedAliasAnalysisPass(FPM);
   LLVMAddBasicAliasAnalysisPass(FPM);
+  LLVMAddPromoteMemoryToRegisterPass(FPM);
   LLVMAddJumpThreadingPass(FPM);
   LLVMAddGVNPass(FPM);
   LLVMAddJumpThreadingPass(FPM);
@@ -191,6 +477,13 @@ void JITImpl::init()
   LLVMAddDeadStoreEliminationPass(FPM);
   LLVMAddInstructionCombiningPass(FPM);
   LLVMInitializeFunctionPassManager(FPM);
+  // The baseline tier only tidies up after inlining.
+  baselineFPM = LLVMCreateFunctionPassManagerForModule(module);
+  LLVMAddTargetData(LLVMGetExecutionEngineTargetData(executionEngine),
+                    baselineFPM);
+  LLVMAddCFGSimplificationPass(baselineFPM);
+  LLVMExtraAddDeadCodeEliminationPass(baselineFPM);
+  LLVMInitializeFunctionPassManager(baselineFPM);
   if (DEBUG_JIT) {
     LLVMExtraRegisterJitDisassembler(executionEngine, LLVMGetTarget(module));
   }
@@ -212,6 +505,9 @@ void JITImpl::resetPerFunctionState()
   earlyReturnIncomingValues.clear();
   earlyReturnIncomingBlocks.clear();
   calls.clear();
+  regionBlocks.clear();
+  pendingRetiredCount = 0;
+  pendingInstructionCounts.clear();
 }
 
 static bool
@@ -221,34 +517,68 @@ getInstruction(Core &core, uint32_t pc, InstructionOpcode &opc,
   if (!core.isValidPc(pc))
     return false;
   instructionDecode(core, pc, opc, operands);
-  return true;
+  return core.isCacheableCode(pc, instructionProperties[opc].size);
 }
 
-void JITImpl::reclaimUnreachableFunctions(JITCoreInfo &coreInfo)
+static void freeFunction(LLVMExecutionEngineRef executionEngine,
+                         LLVMValueRef value)
 {
-  std::vector<uint32_t> &unreachableFunctions = coreInfo.unreachableFunctions;
-  std::map<uint32_t,JITFunctionInfo*> &functionMap = coreInfo.functionMap;
-  for (std::vector<uint32_t>::iterator it = unreachableFunctions.begin(),
-       e = unreachableFunctions.end(); it != e; ++it) {
-    std::map<uint32_t,JITFunctionInfo*>::iterator entry = functionMap.find(*it);
-    if (entry == functionMap.end())
-      continue;
-    LLVMValueRef value = entry->second->value;
-    LLVMFreeMachineCodeForFunction(executionEngine, value);
-    LLVMReplaceAllUsesWith(value, LLVMGetUndef(LLVMTypeOf(value)));
-    LLVMDeleteFunction(value);
-    delete entry->second;
-    functionMap.erase(entry);
+  LLVMExtraFreeMachineCodeForFunction(executionEngine, value);
+  LLVMReplaceAllUsesWith(value, LLVMGetUndef(LLVMTypeOf(value)));
+  LLVMDeleteFunction(value);
+}
+
+/// Free a function that is no longer reachable, removing it from the
+/// references of the functions it calls.
+void JITImpl::deleteFunction(JITFunctionInfo *info)
+{
+  for (std::set<JITFunctionInfo*>::iterator it = info->callees.begin(),
+       e = info->callees.end(); it != e; ++it) {
+    (*it)->references.erase(info);
   }
-  unreachableFunctions.clear();
+  for (std::set<JITFunctionInfo*>::iterator it = info->references.begin(),
+       e = info->references.end(); it != e; ++it) {
+    (*it)->callees.erase(info);
+  }
+  if (info->shared) {
+    releaseSharedFunction(info->shared);
+  } else {
+    freeFunction(executionEngine, info->value);
+    if (info->thunk)
+      freeFunction(executionEngine, info->thunk);
+  }
+  for (std::vector<LLVMValueRef>::iterator it = info->forwardingStubs.begin(),
+       e = info->forwardingStubs.end(); it != e; ++it) {
+    freeFunction(executionEngine, *it);
+  }
+  codeCacheSize -= info->codeSize;
+  delete info;
 }
 
-void JITImpl::reclaimUnreachableFunctions()
+/// Drop a reference to a shared function, freeing it once no core refers to
+/// it.
+void JITImpl::releaseSharedFunction(JITSharedFunction *shared)
 {
-  for (std::map<const Core*,JITCoreInfo*>::iterator it = jitCoreMap.begin(),
-       e = jitCoreMap.end(); it != e; ++it) {
-    reclaimUnreachableFunctions(*it->second);
+  assert(shared->users > 0);
+  if (--shared->users != 0)
+    return;
+  freeFunction(executionEngine, shared->value);
+  freeFunction(executionEngine, shared->thunk);
+  codeCacheSize -= shared->codeSize;
+  sharedFunctions.erase(shared->key);
+  delete shared;
+}
+
+void JITImpl::reclaimUnreachableFunctions(JITCoreInfo &coreInfo)
+{
+  std::vector<JITFunctionInfo*> &unreachableFunctions =
+    coreInfo.unreachableFunctions;
+  for (std::vector<JITFunctionInfo*>::iterator
+       it = unreachableFunctions.begin(), e = unreachableFunctions.end();
+       it != e; ++it) {
+    deleteFunction(*it);
   }
+  unreachableFunctions.clear();
 }
 
 static bool mayReturnEarly(InstructionProperties &properties)
@@ -300,19 +630,6 @@ emitCallToBeInlined(LLVMValueRef fn, LLVMValueRef *args, unsigned numArgs)
   return call;
 }
 
-void JITImpl::compileBlock(Core &core, uint32_t pc)
-{
-  init();
-  reclaimUnreachableFunctions();
-  bool endOfBlock;
-  uint32_t nextPc;
-  JITCoreInfo &coreInfo = *getOrCreateJITCoreInfo(core);
-  do {
-    compileOneFragment(core, coreInfo, pc, endOfBlock, nextPc);
-    pc = nextPc;
-  } while (!endOfBlock);
-}
-
 static bool
 getSuccessors(InstructionOpcode opc, const Operands &operands,
               uint32_t nextPc, std::set<uint32_t> &successors)
@@ -365,6 +682,7 @@ JITCoreInfo *JITImpl::getOrCreateJITCoreInfo(const Core &c)
   if (JITCoreInfo *info = getJITCoreInfo(c))
     return info;
   JITCoreInfo *info = new JITCoreInfo;
+  ScopedLock lock(profileMutex);
   jitCoreMap.insert(std::make_pair(&c, info));
   return info;
 }
@@ -394,6 +712,7 @@ getJITFunctionOrStubImpl(JITCoreInfo &coreInfo, uint32_t pc)
     reinterpret_cast<JITInstructionFunction_t>(
      LLVMGetPointerToGlobal(executionEngine, f));
   info = new JITFunctionInfo(pc, f, code, true);
+  addCodeSize(*info, f);
   LLVMPositionBuilderAtEnd(builder, savedInsertPoint);
   return info;
 }
@@ -404,6 +723,7 @@ getJITFunctionOrStub(JITCoreInfo &coreInfo, uint32_t pc,
 {
   JITFunctionInfo *info = getJITFunctionOrStubImpl(coreInfo, pc);
   info->references.insert(caller);
+  caller->callees.insert(info);
   return info->value;
 }
 
@@ -415,10 +735,35 @@ appendBBToCurrentFunction(LLVMBuilderRef builder, const char *name)
   return LLVMAppendBasicBlock(function, name);
 }
 
+/// Emit code to return to the dispatch loop, which continues from the
+/// thread's pc.
+void JITImpl::emitReturnToDispatchLoop()
+{
+  LLVMValueRef args[] = {
+    threadParam
+  };
+  emitCallToBeInlined(functions.jitUpdateExecutionFrequency, args, 1);
+  // Build return.
+  LLVMBuildRet(builder,
+               LLVMConstInt(LLVMGetReturnType(jitFunctionType),
+                            JIT_RETURN_CONTINUE, 0));
+}
+
 void JITImpl::
 emitJumpToNextFragment(JITCoreInfo &coreInfo, uint32_t targetPc,
                        JITFunctionInfo *caller)
 {
+  std::map<uint32_t,LLVMBasicBlockRef>::iterator block =
+    regionBlocks.find(targetPc);
+  if (block != regionBlocks.end()) {
+    LLVMBuildBr(builder, block->second);
+    return;
+  }
+  // Shared code can't call functions belonging to a single core.
+  if (codeSharing) {
+    emitReturnToDispatchLoop();
+    return;
+  }
   LLVMValueRef next = getJITFunctionOrStub(coreInfo, targetPc, caller);
   LLVMValueRef args[] = {
     threadParam
@@ -463,6 +808,141 @@ emitJumpToNextFragment(InstructionOpcode opc, const Operands &operands,
   return true;
 }
 
+static bool isCall(InstructionOpcode opc)
+{
+  switch (opc) {
+  default:
+    return false;
+  case BLRF_u10:
+  case BLRF_lu10:
+  case BLRB_u10:
+  case BLRB_lu10:
+  case BLA_1r:
+  case BLACP_u10:
+  case BLACP_lu10:
+  case BLAT_u6:
+  case BLAT_lu6:
+    return true;
+  }
+}
+
+static bool isReturn(InstructionOpcode opc)
+{
+  return opc == RETSP_u6 || opc == RETSP_lu6;
+}
+
+static bool isIndirectBranch(InstructionOpcode opc)
+{
+  switch (opc) {
+  default:
+    return isReturn(opc);
+  case BAU_1r:
+  case BLA_1r:
+  case BRU_1r:
+  case BLACP_u10:
+  case BLACP_lu10:
+  case BLAT_u6:
+  case BLAT_lu6:
+  case KRET_0r:
+    return true;
+  }
+}
+
+/// Emit code to push the return address of a call and the compiled code for
+/// the return address onto the thread's return address stack.
+void JITImpl::
+emitPushReturnAddress(JITCoreInfo &coreInfo, uint32_t returnPc,
+                      JITFunctionInfo *caller)
+{
+  LLVMTypeRef paramTypes[3];
+  LLVMGetParamTypes(
+    LLVMGetElementType(LLVMTypeOf(functions.jitPushReturnAddress)),
+    paramTypes);
+  LLVMValueRef code = getJITFunctionOrStub(coreInfo, returnPc, caller);
+  LLVMValueRef args[] = {
+    threadParam,
+    LLVMConstInt(paramTypes[1], returnPc, false),
+    LLVMConstBitCast(code, paramTypes[2])
+  };
+  emitCallToBeInlined(functions.jitPushReturnAddress, args, 3);
+}
+
+/// Emit code to reach the compiled code for the target of an indirect branch
+/// without going through the dispatch loop. Returns are predicted using the
+/// thread's return address stack. Baseline code records the targets of the
+/// branch and optimized code compares against the recorded targets. If the
+/// target isn't found the code emitted afterwards is executed.
+void JITImpl::
+emitIndirectBranch(JITCoreInfo &coreInfo, InstructionOpcode opc, uint32_t pc,
+                   JITFunctionInfo *caller)
+{
+  if (!isIndirectBranch(opc) || codeSharing)
+    return;
+  LLVMValueRef args[] = {
+    threadParam
+  };
+  if (isReturn(opc)) {
+    LLVMValueRef code =
+      emitCallToBeInlined(functions.jitPopReturnAddress, args, 1);
+    LLVMBasicBlockRef hitBB = appendBBToCurrentFunction(builder, "");
+    LLVMBasicBlockRef missBB = appendBBToCurrentFunction(builder, "");
+    LLVMBuildCondBr(builder, LLVMBuildIsNull(builder, code, ""), missBB,
+                    hitBB);
+    LLVMPositionBuilderAtEnd(builder, hitBB);
+    LLVMValueRef next =
+      LLVMBuildPointerCast(builder, code, LLVMPointerType(jitFunctionType, 0),
+                           "");
+    LLVMValueRef call = LLVMBuildCall(builder, next, args, 1, "");
+    LLVMSetTailCall(call, true);
+    LLVMSetInstructionCallConv(call, LLVMFastCallConv);
+    LLVMBuildRet(builder, call);
+    LLVMPositionBuilderAtEnd(builder, missBB);
+  }
+  if (!caller->optimized) {
+    if (tierPolicy != JIT::TIERED)
+      return;
+    LLVMTypeRef paramTypes[2];
+    LLVMGetParamTypes(
+      LLVMGetElementType(LLVMTypeOf(functions.jitRecordIndirectBranch)),
+      paramTypes);
+    uintptr_t profileAddress;
+    {
+      ScopedLock lock(profileMutex);
+      profileAddress =
+        reinterpret_cast<uintptr_t>(&coreInfo.indirectBranchProfiles[pc]);
+    }
+    LLVMValueRef recordArgs[] = {
+      threadParam,
+      LLVMConstIntToPtr(LLVMConstInt(LLVMInt64Type(), profileAddress, false),
+                        paramTypes[1])
+    };
+    emitCallToBeInlined(functions.jitRecordIndirectBranch, recordArgs, 2);
+    return;
+  }
+  JITIndirectBranchProfiles::const_iterator profileIt =
+    requestProfiles->find(pc);
+  if (profileIt == requestProfiles->end())
+    return;
+  const JITIndirectBranchProfile &profile = profileIt->second;
+  unsigned numTargets = profile.numTargets;
+  if (numTargets == 0)
+    return;
+  LLVMValueRef nextPc = emitCallToBeInlined(functions.jitGetPc, args, 1);
+  for (unsigned i = 0; i < numTargets; i++) {
+    LLVMValueRef cmp =
+      LLVMBuildICmp(builder, LLVMIntEQ, nextPc,
+                    LLVMConstInt(LLVMTypeOf(nextPc), profile.targets[i], false),
+                    "");
+    LLVMBasicBlockRef trueBB = appendBBToCurrentFunction(builder, "");
+    LLVMBasicBlockRef afterBB = appendBBToCurrentFunction(builder, "");
+    LLVMBuildCondBr(builder, cmp, trueBB, afterBB);
+    LLVMPositionBuilderAtEnd(builder, trueBB);
+    emitJumpToNextFragment(coreInfo, profile.targets[i], caller);
+    LLVMPositionBuilderAtEnd(builder, afterBB);
+  }
+  ++inlineCaches;
+}
+
 static void deleteFunctionBody(LLVMValueRef f)
 {
   LLVMBasicBlockRef bb = LLVMGetFirstBasicBlock(f);
@@ -507,62 +987,126 @@ getFragmentToCompile(Core &core, uint32_t startPc,
   return !opcode.empty();
 }
 
-/// Try and compile a fragment starting at the specified address. Returns
-/// true if successful setting \a nextAddress to the first instruction after
-/// the fragment. If unsuccessful returns false and sets \a nextAddress to the
-/// address after the current function. \a endOfBlock is set to true if the
-/// next address is in a new basic block.
-bool JITImpl::
-compileOneFragment(Core &core, JITCoreInfo &coreInfo, uint32_t startPc,
-                   bool &endOfBlock, uint32_t &pcAfterFragment)
+static bool
+decodeFragment(Core &core, uint32_t pc, JITFragment &fragment,
+               bool &endOfBlock, uint32_t &nextPc)
 {
-  assert(initialized);
-  resetPerFunctionState();
-
-  std::map<uint32_t,JITFunctionInfo*>::iterator infoIt =
-    coreInfo.functionMap.find(startPc);
-  JITFunctionInfo *info =
-    (infoIt == coreInfo.functionMap.end()) ? 0 : infoIt->second;
-  if (info && !info->isStub) {
-    endOfBlock = true;
+  if (!getFragmentToCompile(core, pc, fragment.opcode, fragment.operands,
+                            endOfBlock, nextPc)) {
     return false;
   }
+  fragment.startPc = pc;
+  fragment.endPc = pc;
+  for (unsigned i = 0, e = fragment.opcode.size(); i != e; ++i) {
+    fragment.endPc += instructionProperties[fragment.opcode[i]].size / 2;
+  }
+  for (uint32_t i = fragment.startPc; i != fragment.endPc; ++i) {
+    fragment.code.push_back(core.loadShort(core.fromPc(i)));
+  }
+  return true;
+}
 
-  std::vector<InstructionOpcode> opcode;
-  std::vector<Operands> operands;
-  if (!getFragmentToCompile(core, startPc, opcode, operands,
-                            endOfBlock, pcAfterFragment)) {
-    return false;
+/// Decode a region starting at the specified pc. The region is grown by
+/// following the successors of its fragments which have been executed often.
+/// If a fragment ends at an instruction that can't be compiled, the pc after
+/// that instruction is added to \a continuations.
+static void
+decodeRegion(Core &core, uint32_t pc, JITRegion &region,
+             std::vector<uint32_t> &continuations)
+{
+  std::deque<uint32_t> worklist;
+  std::set<uint32_t> seen;
+  worklist.push_back(pc);
+  seen.insert(pc);
+  while (!worklist.empty() && region.size() < JIT_MAX_REGION_FRAGMENTS) {
+    uint32_t startPc = worklist.front();
+    worklist.pop_front();
+    bool endOfBlock;
+    uint32_t nextPc;
+    region.push_back(JITFragment());
+    if (!decodeFragment(core, startPc, region.back(), endOfBlock, nextPc)) {
+      region.pop_back();
+      if (startPc == pc && !endOfBlock)
+        continuations.push_back(nextPc);
+      continue;
+    }
+    if (!endOfBlock) {
+      continuations.push_back(nextPc);
+      continue;
+    }
+    const JITFragment &fragment = region.back();
+    std::set<uint32_t> successors;
+    if (!getSuccessors(fragment.opcode.back(), fragment.operands.back(),
+                       fragment.endPc, successors))
+      continue;
+    for (std::set<uint32_t>::iterator it = successors.begin(),
+         e = successors.end(); it != e; ++it) {
+      if (!seen.insert(*it).second)
+        continue;
+      if (core.getExecutionFrequency(*it) < JIT_REGION_SUCCESSOR_THRESHOLD)
+        continue;
+      worklist.push_back(*it);
+    }
   }
+}
+
+/// Decode the regions to compile for the block starting at the specified pc.
+/// Code following instructions that can't be compiled is compiled as a
+/// separate region.
+static void
+decodeBlock(Core &core, uint32_t pc, std::vector<JITRegion> &regions)
+{
+  std::vector<uint32_t> entries;
+  std::set<uint32_t> seen;
+  entries.push_back(pc);
+  seen.insert(pc);
+  while (!entries.empty()) {
+    uint32_t entry = entries.back();
+    entries.pop_back();
+    std::vector<uint32_t> continuations;
+    regions.push_back(JITRegion());
+    decodeRegion(core, entry, regions.back(), continuations);
+    if (regions.back().empty())
+      regions.pop_back();
+    for (std::vector<uint32_t>::iterator it = continuations.begin(),
+         e = continuations.end(); it != e; ++it) {
+      if (seen.insert(*it).second)
+        entries.push_back(*it);
+    }
+  }
+}
+
+/// Emit the code for a fragment of a region at the current insert point.
+void JITImpl::
+emitFragment(JITCoreInfo &coreInfo, JITFragment &fragment, LLVMValueRef ramBase,
+             JITFunctionInfo *info)
+{
+  std::vector<InstructionOpcode> &opcode = fragment.opcode;
+  std::vector<Operands> &operands = fragment.operands;
   std::queue<std::pair<uint32_t,MemoryCheck*> > checks;
   placeMemoryChecks(opcode, operands, checks);
 
-  LLVMValueRef f;
-  if (info) {
-    f = info->value;
-    info->func = 0;
-    info->isStub = false;
-    deleteFunctionBody(f);
-  } else {
-    info = new JITFunctionInfo(startPc);
-    coreInfo.functionMap.insert(std::make_pair(startPc, info));
-    // Create function to contain the code we are about to add.
-    info->value = f = LLVMAddFunction(module, "", jitFunctionType);
-    LLVMSetFunctionCallConv(f, LLVMFastCallConv);
-  }
-  threadParam = LLVMGetParam(f, 0);
-  LLVMValueRef ramBase = LLVMConstInt(LLVMInt32Type(), core.ram_base, false);
-  ramSizeLog2Param = LLVMConstInt(LLVMInt32Type(), core.ramSizeLog2, false);
-  LLVMBasicBlockRef entryBB = LLVMAppendBasicBlock(f, "entry");
-  LLVMPositionBuilderAtEnd(builder, entryBB);
-  uint32_t pc = startPc;
+  // Instruction counts are added in bulk before each point where the code
+  // may leave the fragment, weighted by the number of instructions executed
+  // since the last update. Instructions which may yield or deschedule are
+  // counted after they return to the fragment since they are executed again
+  // when the thread resumes.
+  countInstructions = Stats::get().getInstructionCountsEnabled();
+  uint32_t pc = fragment.startPc;
   bool needsReturn = true;
   for (unsigned i = 0, e = opcode.size(); i != e; ++i) {
     InstructionOpcode opc = opcode[i];
     const Operands &ops = operands[i];
     InstructionProperties *properties = &instructionProperties[opc];
     uint32_t nextPc = pc + properties->size / 2;
-    emitMemoryChecks(i, checks);
+    bool countAfter = properties->mayYield() || properties->mayDeschedule();
+    if (!checks.empty() && checks.front().first == i)
+      emitUpdateInstructionCounts();
+    emitMemoryChecks(i, checks, info->optimized);
+    if (!countAfter)
+      addPendingInstruction(opc);
+    if (mayReturnEarly(*properties))
+      emitUpdateInstructionCounts();
 
     // Lookup function to call.
     LLVMValueRef callee = LLVMGetNamedFunction(module, properties->function);
@@ -589,22 +1133,63 @@ compileOneFragment(Core &core, JITCoreInfo &coreInfo, uint32_t startPc,
     }
     LLVMValueRef call = emitCallToBeInlined(callee, args, numArgs);
     checkReturnValue(call, *properties);
-    if (properties->mayBranch() && properties->function &&
-        emitJumpToNextFragment(opc, ops, coreInfo, nextPc, info)) {
-      needsReturn = false;
+    if (countAfter)
+      addPendingInstruction(opc);
+    if (isCall(opc) && !codeSharing)
+      emitPushReturnAddress(coreInfo, nextPc, info);
+    if (properties->mayBranch() && properties->function) {
+      emitUpdateInstructionCounts();
+      if (emitJumpToNextFragment(opc, ops, coreInfo, nextPc, info))
+        needsReturn = false;
+      else
+        emitIndirectBranch(coreInfo, opc, pc, info);
     }
     pc = nextPc;
   }
   assert(checks.empty() && "Not all checks emitted");
+  assert(pc == fragment.endPc);
   if (needsReturn) {
-    LLVMValueRef args[] = {
-      threadParam
-    };
-    emitCallToBeInlined(functions.jitUpdateExecutionFrequency, args, 1);
-    // Build return.
-    LLVMBuildRet(builder,
-                 LLVMConstInt(LLVMGetReturnType(jitFunctionType),
-                              JIT_RETURN_CONTINUE, 0));
+    emitUpdateInstructionCounts();
+    emitReturnToDispatchLoop();
+  }
+  assert(pendingRetiredCount == 0 && pendingInstructionCounts.empty());
+}
+
+/// Compile a region into a new function. Each fragment of the region is
+/// emitted as a basic block so branches between fragments of the region,
+/// including loop back edges, become branches within the function. The
+/// function isn't added to the function map until it is installed.
+JITFunctionInfo *JITImpl::
+compileRegion(JITCoreInfo &coreInfo, JITRegion &region, unsigned regsOffset,
+              uint32_t ramBaseValue, uint32_t ramSizeLog2, bool optimize)
+{
+  assert(initialized);
+  assert(!region.empty());
+  resetPerFunctionState();
+
+  JITFunctionInfo *info = new JITFunctionInfo(region.front().startPc);
+  info->optimized = optimize;
+  // Create function to contain the code we are about to add.
+  LLVMValueRef f = info->value = LLVMAddFunction(module, "", jitFunctionType);
+  LLVMSetFunctionCallConv(f, LLVMFastCallConv);
+  threadParam = LLVMGetParam(f, 0);
+  LLVMValueRef ramBase = LLVMConstInt(LLVMInt32Type(), ramBaseValue, false);
+  ramSizeLog2Param = LLVMConstInt(LLVMInt32Type(), ramSizeLog2, false);
+  LLVMBasicBlockRef entryBB = LLVMAppendBasicBlock(f, "entry");
+  for (JITRegion::iterator it = region.begin(), e = region.end(); it != e;
+       ++it) {
+    regionBlocks[it->startPc] = LLVMAppendBasicBlock(f, "");
+  }
+  LLVMPositionBuilderAtEnd(builder, entryBB);
+  LLVMBuildBr(builder, regionBlocks[info->pc]);
+  for (JITRegion::iterator it = region.begin(), e = region.end(); it != e;
+       ++it) {
+    LLVMPositionBuilderAtEnd(builder, regionBlocks[it->startPc]);
+    // Count executions at the head of the region so loops which stay inside
+    // the function are counted on every iteration.
+    if (it == region.begin() && !optimize && tierPolicy == JIT::TIERED)
+      emitUpdateBaselineExecutionCount(info->pc);
+    emitFragment(coreInfo, *it, ramBase, info);
   }
   // Add incoming phi values.
   if (earlyReturnBB) {
@@ -621,7 +1206,13 @@ compileOneFragment(Core &core, JITCoreInfo &coreInfo, uint32_t startPc,
        it != e; ++it) {
     LLVMExtraInlineFunction(*it);
   }
-  LLVMRunFunctionPassManager(FPM, f);
+  // Keep registers in SSA values while the optimized code runs.
+  if (optimize) {
+    LLVMExtraPromoteThreadRegisters(f,
+      LLVMGetExecutionEngineTargetData(executionEngine), regsOffset,
+      Register::NUM_REGISTERS);
+  }
+  LLVMRunFunctionPassManager(optimize ? FPM : baselineFPM, f);
   if (DEBUG_JIT) {
     LLVMDumpValue(f);
   }
@@ -629,10 +1220,71 @@ compileOneFragment(Core &core, JITCoreInfo &coreInfo, uint32_t startPc,
   JITInstructionFunction_t compiledFunction =
     reinterpret_cast<JITInstructionFunction_t>(
       LLVMRecompileAndRelinkFunction(executionEngine, f));
-  info->isStub = false;
   info->func = compiledFunction;
-  core.setOpcode(startPc, getFunctionThunk(*info), (pc - startPc) * 2);
-  return true;
+  addCodeSize(*info, f);
+  return info;
+}
+
+void JITImpl::addPendingInstruction(InstructionOpcode opc)
+{
+  ++pendingRetiredCount;
+  if (countInstructions)
+    ++pendingInstructionCounts[opc];
+}
+
+/// Emit code to add the pending instruction counts to the counts of the
+/// thread.
+void JITImpl::emitUpdateInstructionCounts()
+{
+  if (pendingRetiredCount == 0)
+    return;
+  LLVMTypeRef paramTypes[3];
+  LLVMGetParamTypes(
+    LLVMGetElementType(LLVMTypeOf(functions.jitUpdateRetiredCount)),
+    paramTypes);
+  LLVMValueRef retiredArgs[] = {
+    threadParam,
+    LLVMConstInt(paramTypes[1], pendingRetiredCount, false)
+  };
+  emitCallToBeInlined(functions.jitUpdateRetiredCount, retiredArgs, 2);
+  pendingRetiredCount = 0;
+  LLVMGetParamTypes(
+    LLVMGetElementType(LLVMTypeOf(functions.jitUpdateInstructionCount)),
+    paramTypes);
+  for (std::map<InstructionOpcode,unsigned>::iterator
+       it = pendingInstructionCounts.begin(),
+       e = pendingInstructionCounts.end(); it != e; ++it) {
+    LLVMValueRef args[] = {
+      threadParam,
+      LLVMConstInt(paramTypes[1], it->first, false),
+      LLVMConstInt(paramTypes[2], it->second, false)
+    };
+    emitCallToBeInlined(functions.jitUpdateInstructionCount, args, 3);
+  }
+  pendingInstructionCounts.clear();
+}
+
+/// Emit code to count executions of a baseline function, requesting
+/// recompilation by the optimizing tier once it reaches the threshold. The
+/// count is held by the core and is set when the function is installed.
+void JITImpl::emitUpdateBaselineExecutionCount(uint32_t pc)
+{
+  LLVMTypeRef paramTypes[2];
+  LLVMGetParamTypes(
+    LLVMGetElementType(LLVMTypeOf(functions.jitUpdateBaselineExecutionCount)),
+    paramTypes);
+  LLVMValueRef args[] = {
+    threadParam,
+    LLVMConstInt(paramTypes[1], pc, false)
+  };
+  LLVMValueRef call =
+    emitCallToBeInlined(functions.jitUpdateBaselineExecutionCount, args, 2);
+  // Return to the dispatch loop if there is code waiting to be installed.
+  LLVMValueRef cmp =
+    LLVMBuildICmp(builder, LLVMIntNE, call,
+                  LLVMConstInt(LLVMTypeOf(call), JIT_RETURN_CONTINUE, false),
+                  "");
+  emitCondEarlyReturn(cmp, call);
 }
 
 void JITImpl::emitCondBrToBlock(LLVMValueRef cond, LLVMBasicBlockRef trueBB)
@@ -676,7 +1328,8 @@ LLVMBasicBlockRef JITImpl::getOrCreateMemoryCheckBailoutBlock(unsigned index)
 
 void JITImpl::
 emitMemoryChecks(unsigned index,
-                 std::queue<std::pair<uint32_t,MemoryCheck*> > &checks)
+                 std::queue<std::pair<uint32_t,MemoryCheck*> > &checks,
+                 bool optimized)
 {
   while (!checks.empty() && checks.front().first == index) {
     MemoryCheck *check = checks.front().second;
@@ -710,8 +1363,14 @@ emitMemoryChecks(unsigned index,
       emitCondBrToBlock(cmp, bailoutBB);
     }
 
-    // Check address valid.
-    if (check->getFlags() & MemoryCheck::CheckAddress) {
+    // Check address valid. Baseline code keeps the thread's pc and registers
+    // in memory so loads outside of memory can be left to fault. Stores are
+    // still checked if they check the invalidation info since that is
+    // indexed by the address before the store is made. Optimized code may
+    // hold the thread's state in SSA values and so must always check.
+    if (check->getFlags() & MemoryCheck::CheckAddress &&
+        (!GUARDED_MEMORY || optimized ||
+         (check->getFlags() & MemoryCheck::CheckInvalidation))) {
       LLVMValueRef args[] = {
         threadParam,
         ramSizeLog2Param,
@@ -757,12 +1416,25 @@ LLVMValueRef JITImpl::getJitInvalidateFunction(unsigned size)
   }
 }
 
+static LLVMValueRef getInt32Pointer(volatile uint32_t *p)
+{
+  uintptr_t address = reinterpret_cast<uintptr_t>(p);
+  return LLVMConstIntToPtr(LLVMConstInt(LLVMInt64Type(), address, false),
+                           LLVMPointerType(LLVMInt32Type(), 0));
+}
+
+/// Create the function called from the core's opcode array to enter a
+/// function. The thunk records when the function was last used.
 JITInstructionFunction_t JITImpl::getFunctionThunk(JITFunctionInfo &info)
 {
   LLVMValueRef f = LLVMAddFunction(module, "", jitFunctionType);
   LLVMValueRef thread = LLVMGetParam(f, 0);
   LLVMBasicBlockRef entryBB = LLVMAppendBasicBlock(f, "entry");
   LLVMPositionBuilderAtEnd(builder, entryBB);
+  volatile uint32_t *lastUsed =
+    info.shared ? &info.shared->lastUsed : &info.lastUsed;
+  LLVMValueRef epoch = LLVMBuildLoad(builder, getInt32Pointer(&useEpoch), "");
+  LLVMBuildStore(builder, epoch, getInt32Pointer(lastUsed));
   LLVMValueRef args[] = {
     thread
   };
@@ -774,8 +1446,36 @@ JITInstructionFunction_t JITImpl::getFunctionThunk(JITFunctionInfo &info)
     LLVMDumpValue(f);
     LLVMVerifyFunction(f, LLVMAbortProcessAction);
   }
-  return reinterpret_cast<JITInstructionFunction_t>(
+  info.thunk = f;
+  JITInstructionFunction_t code = reinterpret_cast<JITInstructionFunction_t>(
     LLVMGetPointerToGlobal(executionEngine, f));
+  addCodeSize(info, f);
+  return code;
+}
+
+/// Make a newly compiled function available to other cores compiling the
+/// same region and create its thunk. Returns the code of the thunk.
+JITInstructionFunction_t JITImpl::
+shareFunction(JITFunctionInfo &info, const JITSharedKey &key)
+{
+  JITSharedFunction *shared = new JITSharedFunction(key);
+  shared->users = 1;
+  info.shared = shared;
+  JITInstructionFunction_t code = getFunctionThunk(info);
+  shared->value = info.value;
+  shared->thunk = info.thunk;
+  shared->thunkCode = code;
+  shared->codeSize = info.codeSize;
+  info.codeSize = 0;
+  sharedFunctions.insert(std::make_pair(key, shared));
+  return code;
+}
+
+void JITImpl::addCodeSize(JITFunctionInfo &info, LLVMValueRef f)
+{
+  size_t size = LLVMExtraGetMachineCodeSize(f);
+  info.codeSize += size;
+  codeCacheSize += size;
 }
 
 bool JITImpl::invalidate(Core &core, uint32_t pc)
@@ -783,15 +1483,23 @@ bool JITImpl::invalidate(Core &core, uint32_t pc)
   JITCoreInfo *coreInfo = getJITCoreInfo(core);
   if (!coreInfo)
     return false;
+  std::vector<JITFunctionInfo*> worklist;
+  std::set<JITFunctionInfo*> toInvalidate;
   std::map<uint32_t,JITFunctionInfo*>::iterator entry =
     coreInfo->functionMap.find(pc);
-  if (entry == coreInfo->functionMap.end())
+  if (entry != coreInfo->functionMap.end()) {
+    worklist.push_back(entry->second);
+    toInvalidate.insert(entry->second);
+  }
+  typedef std::multimap<uint32_t,JITFunctionInfo*>::iterator member_iterator;
+  std::pair<member_iterator,member_iterator> members =
+    coreInfo->regionMembers.equal_range(pc);
+  for (member_iterator it = members.first; it != members.second; ++it) {
+    if (toInvalidate.insert(it->second).second)
+      worklist.push_back(it->second);
+  }
+  if (worklist.empty())
     return false;
-
-  std::vector<JITFunctionInfo*> worklist;
-  std::set<JITFunctionInfo*> toInvalidate;
-  worklist.push_back(entry->second);
-  toInvalidate.insert(entry->second);
   do {
     JITFunctionInfo *info = worklist.back();
     worklist.pop_back();
@@ -804,13 +1512,661 @@ bool JITImpl::invalidate(Core &core, uint32_t pc)
   } while (!worklist.empty());
   for (std::set<JITFunctionInfo*>::iterator it = toInvalidate.begin(),
        e = toInvalidate.end(); it != e; ++it) {
-    uint32_t functionPc = (*it)->pc;
-    core.clearOpcode(functionPc);
-    coreInfo->unreachableFunctions.push_back(functionPc);
+    JITFunctionInfo *info = *it;
+    if (!info->installed && !info->isStub) {
+      // Compiled in the background but not yet installed. The function is
+      // discarded when the core next tries to install it.
+      info->invalidated = true;
+      continue;
+    }
+    // The code may have changed so forget the branch targets seen by the
+    // function.
+    resetIndirectBranchProfiles(*coreInfo, *info);
+    // The function may still be executing so it is only freed once the core
+    // reaches a safe point.
+    core.clearOpcode(info->pc);
+    coreInfo->functionMap.erase(info->pc);
+    removeRegionMembers(*coreInfo, info);
+    coreInfo->unreachableFunctions.push_back(info);
+  }
+  // The pc may be in the middle of a region, in which case the opcode array
+  // holds an instruction decoded by the interpreter.
+  core.clearOpcode(pc);
+  // Return address stacks may refer to the functions about to be freed.
+  for (unsigned i = 0; i < NUM_THREADS; i++) {
+    core.getThread(i).clearReturnAddressStack();
   }
   return true;
 }
 
+void JITImpl::workerMain(void *arg)
+{
+  static_cast<JITImpl*>(arg)->runWorker();
+}
+
+void JITImpl::runWorker()
+{
+  while (1) {
+    JITCompileRequest *request;
+    {
+      ScopedLock lock(queueMutex);
+      while (queue.empty() && !shutdown)
+        queueNotEmpty.wait(queueMutex);
+      if (shutdown)
+        return;
+      request = queue.front();
+      queue.pop_front();
+    }
+    {
+      ScopedLock lock(mutex);
+      compiling.set();
+      compileRequest(*request);
+      compiling.clear();
+    }
+    // Let the simulation thread install the code at its next safe point.
+    request->core.setCompiledCodePending();
+    delete request;
+  }
+}
+
+/// Start the worker thread if it isn't already running. Returns false if the
+/// thread couldn't be started.
+bool JITImpl::startWorker()
+{
+  if (workerStarted)
+    return true;
+  if (!worker.start(&workerMain, this)) {
+    std::cerr << "Warning: failed to create JIT thread, compiling in the "
+                 "foreground\n";
+    return false;
+  }
+  workerStarted = true;
+  return true;
+}
+
+/// Returns whether a function compiled by the specified tier should replace
+/// an existing function.
+static bool canReplace(const JITFunctionInfo &existing, bool optimized)
+{
+  if (existing.isStub)
+    return true;
+  return optimized && !existing.optimized;
+}
+
+/// Stop the worker thread, dropping any requests that haven't been started.
+/// Later requests are compiled in the foreground.
+void JITImpl::stopWorker()
+{
+  {
+    ScopedLock lock(queueMutex);
+    backgroundCompilation = false;
+    if (!workerStarted)
+      return;
+    shutdown = true;
+    queueNotEmpty.notifyAll();
+  }
+  worker.join();
+  ScopedLock lock(queueMutex);
+  workerStarted = false;
+  for (std::deque<JITCompileRequest*>::iterator it = queue.begin(),
+       e = queue.end(); it != e; ++it) {
+    delete *it;
+  }
+  queue.clear();
+}
+
+static void
+getSharedKey(const Core &core, const JITRegion &region, bool optimize,
+             JITSharedKey &key)
+{
+  key.push_back(optimize);
+  key.push_back(core.ram_base);
+  key.push_back(core.ramSizeLog2);
+  for (JITRegion::const_iterator it = region.begin(), e = region.end();
+       it != e; ++it) {
+    key.push_back(it->startPc);
+    key.push_back(it->endPc);
+    key.insert(key.end(), it->code.begin(), it->code.end());
+  }
+}
+
+/// Compile the fragments of a block. The compiled fragments are added to the
+/// core's list of fragments waiting to be installed. If code sharing is
+/// enabled, regions already compiled for another core reuse its code.
+void JITImpl::compileRequest(JITCompileRequest &request)
+{
+  init();
+  double startTime = getHostTime();
+  JITCoreInfo &coreInfo = *getOrCreateJITCoreInfo(request.core);
+  unsigned tier = request.optimize ? OPTIMIZING_TIER : BASELINE_TIER;
+  Thread &thread = request.core.getThread(0);
+  unsigned regsOffset = reinterpret_cast<char*>(&thread.regs[0]) -
+                        reinterpret_cast<char*>(&thread);
+  requestProfiles = &request.indirectBranchProfiles;
+  for (std::vector<JITRegion>::iterator it = request.regions.begin(),
+       e = request.regions.end(); it != e; ++it) {
+    JITRegion &region = *it;
+    std::map<uint32_t,JITFunctionInfo*>::iterator infoIt =
+      coreInfo.functionMap.find(region.front().startPc);
+    if (infoIt != coreInfo.functionMap.end() &&
+        !canReplace(*infoIt->second, request.optimize))
+      continue;
+    JITSharedKey key;
+    JITSharedFunction *shared = 0;
+    if (codeSharing) {
+      getSharedKey(request.core, region, request.optimize, key);
+      std::map<JITSharedKey,JITSharedFunction*>::iterator sharedIt =
+        sharedFunctions.find(key);
+      if (sharedIt != sharedFunctions.end())
+        shared = sharedIt->second;
+    }
+    coreInfo.compiledRegions.push_back(JITCompiledRegion());
+    JITCompiledRegion &compiled = coreInfo.compiledRegions.back();
+    if (shared) {
+      compiled.info = new JITFunctionInfo(region.front().startPc);
+      compiled.info->optimized = request.optimize;
+      compiled.info->value = shared->value;
+      compiled.info->thunk = shared->thunk;
+      compiled.info->shared = shared;
+      compiled.thunk = shared->thunkCode;
+      ++shared->users;
+      ++regionsShared;
+    } else {
+      compiled.info = compileRegion(coreInfo, region, regsOffset,
+                                    request.core.ram_base,
+                                    request.core.ramSizeLog2,
+                                    request.optimize);
+      if (codeSharing)
+        compiled.thunk = shareFunction(*compiled.info, key);
+      else
+        compiled.thunk = getFunctionThunk(*compiled.info);
+      ++regionsCompiled[tier];
+      fragmentsCompiled[tier] += region.size();
+    }
+    compiled.fragments.resize(region.size());
+    for (unsigned i = 0, e = region.size(); i != e; ++i) {
+      compiled.fragments[i].startPc = region[i].startPc;
+      compiled.fragments[i].endPc = region[i].endPc;
+      compiled.fragments[i].code.swap(region[i].code);
+    }
+  }
+  requestProfiles = 0;
+  compileTime[tier] += getHostTime() - startTime;
+}
+
+static uint64_t hashFragment(const JITFragment &fragment, uint64_t hash)
+{
+  if (fragment.code.empty())
+    return hash;
+  return JITCache::hash(&fragment.code[0],
+                        fragment.code.size() * sizeof(fragment.code[0]), hash);
+}
+
+static void getCacheRegion(const JITRegion &region, bool optimized,
+                           JITCacheRegion &cacheRegion)
+{
+  cacheRegion.optimized = optimized;
+  cacheRegion.fragments.clear();
+  cacheRegion.codeHash = JITCache::INITIAL_HASH;
+  for (JITRegion::const_iterator it = region.begin(), e = region.end();
+       it != e; ++it) {
+    cacheRegion.fragments.push_back(std::make_pair(it->startPc, it->endPc));
+    cacheRegion.codeHash = hashFragment(*it, cacheRegion.codeHash);
+  }
+}
+
+/// Replace an existing stub or baseline function with a new function. The
+/// old function may still be executing so it is changed to forward to the
+/// new function rather than being freed.
+void JITImpl::
+replaceFunction(JITCoreInfo &coreInfo, JITFunctionInfo *old,
+                JITFunctionInfo *info)
+{
+  // Other cores may still be using a shared function. It can't be called
+  // from other functions so it only needs to be kept until the core reaches
+  // a safe point.
+  if (old->shared) {
+    assert(old->references.empty() && old->callees.empty());
+    removeRegionMembers(coreInfo, old);
+    coreInfo.unreachableFunctions.push_back(old);
+    return;
+  }
+  size_t oldSize = LLVMExtraGetMachineCodeSize(old->value);
+  deleteFunctionBody(old->value);
+  LLVMBasicBlockRef entryBB = LLVMAppendBasicBlock(old->value, "entry");
+  LLVMPositionBuilderAtEnd(builder, entryBB);
+  LLVMValueRef args[] = {
+    LLVMGetParam(old->value, 0)
+  };
+  LLVMValueRef call = LLVMBuildCall(builder, info->value, args, 1, "");
+  LLVMSetTailCall(call, true);
+  LLVMSetInstructionCallConv(call, LLVMFastCallConv);
+  LLVMBuildRet(builder, call);
+  LLVMRecompileAndRelinkFunction(executionEngine, old->value);
+  size_t newSize = LLVMExtraGetMachineCodeSize(old->value);
+  codeCacheSize = codeCacheSize - oldSize + newSize;
+  info->codeSize += old->codeSize - oldSize + newSize;
+  // Existing callers now reach the new function through the old one.
+  for (std::set<JITFunctionInfo*>::iterator it = old->references.begin(),
+       e = old->references.end(); it != e; ++it) {
+    (*it)->callees.erase(old);
+    (*it)->callees.insert(info);
+    info->references.insert(*it);
+  }
+  for (std::set<JITFunctionInfo*>::iterator it = old->callees.begin(),
+       e = old->callees.end(); it != e; ++it) {
+    (*it)->references.erase(old);
+  }
+  removeRegionMembers(coreInfo, old);
+  info->forwardingStubs.swap(old->forwardingStubs);
+  info->forwardingStubs.push_back(old->value);
+  if (old->thunk)
+    info->forwardingStubs.push_back(old->thunk);
+  delete old;
+}
+
+void JITImpl::removeRegionMembers(JITCoreInfo &coreInfo,
+                                  JITFunctionInfo *info)
+{
+  typedef std::multimap<uint32_t,JITFunctionInfo*>::iterator iterator;
+  for (std::vector<uint32_t>::iterator it = info->memberPcs.begin(),
+       e = info->memberPcs.end(); it != e; ++it) {
+    std::pair<iterator,iterator> range = coreInfo.regionMembers.equal_range(*it);
+    for (iterator member = range.first; member != range.second; ++member) {
+      if (member->second == info) {
+        coreInfo.regionMembers.erase(member);
+        break;
+      }
+    }
+  }
+  info->memberPcs.clear();
+}
+
+/// Install a compiled region in the function map and the core's opcode
+/// array. Returns false if the region is out of date.
+bool JITImpl::
+installRegion(Core &core, JITCoreInfo &coreInfo, JITCompiledRegion &compiled)
+{
+  JITFunctionInfo *info = compiled.info;
+  if (info->invalidated)
+    return false;
+  // Memory may have been written since the region was decoded.
+  for (JITRegion::iterator it = compiled.fragments.begin(),
+       e = compiled.fragments.end(); it != e; ++it) {
+    if (!core.isCacheableCode(it->startPc, (it->endPc - it->startPc) * 2))
+      return false;
+    for (unsigned i = 0, size = it->code.size(); i != size; ++i) {
+      if ((uint16_t)core.loadShort(core.fromPc(it->startPc + i)) !=
+          it->code[i]) {
+        core.resetExecutionFrequency(info->pc);
+        return false;
+      }
+    }
+  }
+  JITFunctionInfo *&entry = coreInfo.functionMap[info->pc];
+  if (entry) {
+    if (!canReplace(*entry, info->optimized))
+      return false;
+    if (!entry->isStub)
+      ++regionsTieredUp;
+    replaceFunction(coreInfo, entry, info);
+  }
+  entry = info;
+  info->installed = true;
+  info->lastUsed = useEpoch;
+  if (info->shared)
+    info->shared->lastUsed = useEpoch;
+  if (!info->optimized && tierPolicy == JIT::TIERED)
+    core.setBaselineExecutionCount(info->pc, tierUpThreshold);
+  if (!cacheDirectory.empty())
+    getCacheRegion(compiled.fragments, info->optimized, info->cacheRegion);
+  for (JITRegion::iterator it = compiled.fragments.begin(),
+       e = compiled.fragments.end(); it != e; ++it) {
+    info->fragmentRanges.push_back(std::make_pair(it->startPc, it->endPc));
+  }
+  const JITFragment &head = compiled.fragments.front();
+  core.setOpcode(info->pc, compiled.thunk, (head.endPc - head.startPc) * 2);
+  // Writes to the other fragments must also invalidate the function.
+  for (JITRegion::iterator it = compiled.fragments.begin() + 1,
+       e = compiled.fragments.end(); it != e; ++it) {
+    core.setInvalidationInfo(it->startPc, (it->endPc - it->startPc) * 2);
+    coreInfo.regionMembers.insert(std::make_pair(it->startPc, info));
+    info->memberPcs.push_back(it->startPc);
+  }
+  return true;
+}
+
+void JITImpl::installCompiledCode(Core &core)
+{
+  JITCoreInfo *coreInfo = getJITCoreInfo(core);
+  if (!coreInfo)
+    return;
+  // Only reclaim functions belonging to this core. Other cores may be
+  // executing their code on another host thread.
+  reclaimUnreachableFunctions(*coreInfo);
+  std::vector<JITCompiledRegion> &compiledRegions = coreInfo->compiledRegions;
+  for (std::vector<JITCompiledRegion>::iterator it = compiledRegions.begin(),
+       e = compiledRegions.end(); it != e; ++it) {
+    if (!installRegion(core, *coreInfo, *it)) {
+      deleteFunction(it->info);
+      ++regionsDiscarded;
+    }
+  }
+  compiledRegions.clear();
+}
+
+/// Decode a region recorded in the cache. Returns false if the code in memory
+/// differs from the code that was recorded.
+static bool
+decodeCachedRegion(Core &core, const JITCacheRegion &cacheRegion,
+                   JITRegion &region)
+{
+  uint64_t hash = JITCache::INITIAL_HASH;
+  for (unsigned i = 0, e = cacheRegion.fragments.size(); i != e; ++i) {
+    uint32_t startPc = cacheRegion.fragments[i].first;
+    uint32_t endPc = cacheRegion.fragments[i].second;
+    if (!core.isValidPc(startPc) || !core.isValidPc(endPc - 1))
+      return false;
+    bool endOfBlock;
+    uint32_t nextPc;
+    region.push_back(JITFragment());
+    if (!decodeFragment(core, startPc, region.back(), endOfBlock, nextPc) ||
+        region.back().endPc != endPc)
+      return false;
+    hash = hashFragment(region.back(), hash);
+  }
+  return hash == cacheRegion.codeHash;
+}
+
+static uint64_t getCacheKey(const Core &core)
+{
+  uint64_t key = JITCache::hash(instructionBitcode, instructionBitcodeSize);
+  uint32_t layout[] = { core.ram_base, core.ramSizeLog2 };
+  return JITCache::hash(layout, sizeof(layout), key);
+}
+
+/// Compile the regions recorded in the cache for the core's memory layout
+/// whose code matches the code in memory. This is done the first time the
+/// core compiles anything, by which time its program has been loaded.
+void JITImpl::loadCache(Core &core)
+{
+  std::vector<JITCacheRegion> cached;
+  {
+    ScopedLock lock(mutex);
+    if (!cacheLoaded.insert(&core).second)
+      return;
+    std::string path = JITCache::getPath(cacheDirectory, getCacheKey(core));
+    std::map<std::string,std::vector<JITCacheRegion> >::iterator file =
+      cacheFiles.find(path);
+    if (file == cacheFiles.end()) {
+      file = cacheFiles.insert(std::make_pair(path,
+                                              std::vector<JITCacheRegion>())).first;
+      JITCache::read(path, file->second);
+    }
+    cached = file->second;
+  }
+  JITCompileRequest *requests[] = {
+    new JITCompileRequest(core, false),
+    new JITCompileRequest(core, true)
+  };
+  unsigned numLoaded = 0;
+  for (std::vector<JITCacheRegion>::iterator it = cached.begin(),
+       e = cached.end(); it != e; ++it) {
+    bool optimize = tierPolicy == JIT::OPTIMIZING_ONLY ||
+                    (tierPolicy == JIT::TIERED && it->optimized);
+    JITRegion region;
+    if (!decodeCachedRegion(core, *it, region))
+      continue;
+    requests[optimize]->regions.push_back(JITRegion());
+    requests[optimize]->regions.back().swap(region);
+    ++numLoaded;
+  }
+  {
+    ScopedLock lock(mutex);
+    cachedRegionsLoaded += numLoaded;
+  }
+  for (unsigned i = 0; i < ARRAY_SIZE(requests); i++) {
+    if (requests[i]->regions.empty())
+      delete requests[i];
+    else
+      enqueueOrCompile(requests[i]);
+  }
+}
+
+/// Write the regions currently installed to the persistent cache, together
+/// with regions read from the cache that weren't compiled in this run.
+void JITImpl::writeCache()
+{
+  if (cacheDirectory.empty())
+    return;
+  ScopedLock lock(mutex);
+  std::map<std::string,std::vector<JITCacheRegion> > files;
+  for (std::map<const Core*,JITCoreInfo*>::iterator it = jitCoreMap.begin(),
+       e = jitCoreMap.end(); it != e; ++it) {
+    std::vector<JITCacheRegion> &regions =
+      files[JITCache::getPath(cacheDirectory, getCacheKey(*it->first))];
+    std::map<uint32_t,JITFunctionInfo*> &functionMap = it->second->functionMap;
+    for (std::map<uint32_t,JITFunctionInfo*>::iterator
+         infoIt = functionMap.begin(), infoE = functionMap.end();
+         infoIt != infoE; ++infoIt) {
+      JITFunctionInfo *info = infoIt->second;
+      if (info->installed && !info->cacheRegion.fragments.empty())
+        regions.push_back(info->cacheRegion);
+    }
+  }
+  for (std::map<std::string,std::vector<JITCacheRegion> >::iterator
+       it = files.begin(), e = files.end(); it != e; ++it) {
+    std::vector<JITCacheRegion> &regions = it->second;
+    std::set<std::pair<uint32_t,uint64_t> > seen;
+    for (std::vector<JITCacheRegion>::iterator regionIt = regions.begin(),
+         regionE = regions.end(); regionIt != regionE; ++regionIt) {
+      seen.insert(std::make_pair(regionIt->fragments.front().first,
+                                 regionIt->codeHash));
+    }
+    const std::vector<JITCacheRegion> &previous = cacheFiles[it->first];
+    for (std::vector<JITCacheRegion>::const_iterator
+         regionIt = previous.begin(), regionE = previous.end();
+         regionIt != regionE; ++regionIt) {
+      if (seen.insert(std::make_pair(regionIt->fragments.front().first,
+                                     regionIt->codeHash)).second)
+        regions.push_back(*regionIt);
+    }
+    if (!JITCache::write(it->first, regions)) {
+      std::cerr << "Warning: failed to write JIT cache file " << it->first
+                << std::endl;
+    }
+  }
+}
+
+/// Remove a function which isn't called by any other function and free it.
+/// This must only be called when none of the core's threads are executing
+/// compiled code.
+void JITImpl::
+evictFunction(Core &core, JITCoreInfo &coreInfo, JITFunctionInfo *info)
+{
+  assert(info->references.empty());
+  if (!info->isStub)
+    core.clearOpcode(info->pc);
+  coreInfo.functionMap.erase(info->pc);
+  removeRegionMembers(coreInfo, info);
+  deleteFunction(info);
+  ++functionsEvicted;
+}
+
+/// Evict the core's least recently used functions until the code cache is
+/// back under its limit. Functions called directly by other functions are
+/// only evicted once all their callers have been evicted.
+void JITImpl::evictColdFunctions(Core &core)
+{
+  if (codeCacheLimit == 0 || codeCacheSize <= codeCacheLimit)
+    return;
+  JITCoreInfo *coreInfo = getJITCoreInfo(core);
+  if (!coreInfo)
+    return;
+  // Return address stacks may refer to the functions about to be freed.
+  for (unsigned i = 0; i < NUM_THREADS; i++) {
+    core.getThread(i).clearReturnAddressStack();
+  }
+  while (codeCacheSize > codeCacheLimit) {
+    std::vector<std::pair<uint32_t,JITFunctionInfo*> > candidates;
+    for (std::map<uint32_t,JITFunctionInfo*>::iterator
+         it = coreInfo->functionMap.begin(), e = coreInfo->functionMap.end();
+         it != e; ++it) {
+      JITFunctionInfo *info = it->second;
+      if (!info->references.empty())
+        continue;
+      uint32_t lastUsed =
+        info->shared ? info->shared->lastUsed : info->lastUsed;
+      candidates.push_back(std::make_pair(lastUsed, info));
+    }
+    if (candidates.empty())
+      break;
+    std::sort(candidates.begin(), candidates.end());
+    for (std::vector<std::pair<uint32_t,JITFunctionInfo*> >::iterator
+         it = candidates.begin(), e = candidates.end();
+         it != e && codeCacheSize > codeCacheLimit; ++it) {
+      evictFunction(core, *coreInfo, it->second);
+    }
+  }
+  ++useEpoch;
+}
+
+void JITImpl::compileBlock(Core &core, uint32_t pc)
+{
+  if (!cacheDirectory.empty())
+    loadCache(core);
+  JITCompileRequest *request =
+    new JITCompileRequest(core, tierPolicy == JIT::OPTIMIZING_ONLY);
+  // Decode on the simulation thread since the worker can't safely read the
+  // core's memory.
+  decodeBlock(core, pc, request->regions);
+  enqueueOrCompile(request);
+}
+
+/// Recompile the baseline function at the specified pc with the optimizing
+/// tier. This is called from the baseline function itself.
+void JITImpl::optimizeRegion(Core &core, uint32_t pc)
+{
+  JITCompileRequest *request = new JITCompileRequest(core, true);
+  std::vector<uint32_t> continuations;
+  request->regions.push_back(JITRegion());
+  decodeRegion(core, pc, request->regions.back(), continuations);
+  if (request->regions.back().empty())
+    request->regions.pop_back();
+  enqueueOrCompile(request);
+}
+
+/// Copy the targets recorded for the indirect branches in the request's
+/// regions. This runs on the simulation thread, which is the only thread that
+/// writes the targets, so the worker never reads them while they change.
+void JITImpl::copyIndirectBranchProfiles(JITCompileRequest &request)
+{
+  ScopedLock lock(profileMutex);
+  JITCoreInfo *coreInfo = getJITCoreInfo(request.core);
+  if (!coreInfo)
+    return;
+  const JITIndirectBranchProfiles &recorded = coreInfo->indirectBranchProfiles;
+  for (std::vector<JITRegion>::iterator regionIt = request.regions.begin(),
+       regionEnd = request.regions.end(); regionIt != regionEnd; ++regionIt) {
+    for (JITRegion::iterator it = regionIt->begin(), e = regionIt->end();
+         it != e; ++it) {
+      JITIndirectBranchProfiles::const_iterator
+        profileIt = recorded.lower_bound(it->startPc),
+        profileEnd = recorded.lower_bound(it->endPc);
+      request.indirectBranchProfiles.insert(profileIt, profileEnd);
+    }
+  }
+}
+
+/// Forget the targets recorded for the indirect branches in an invalidated
+/// function. The entries are reset rather than erased since the function may
+/// still be executing. This is called holding mutex so no entries are being
+/// added.
+void JITImpl::
+resetIndirectBranchProfiles(JITCoreInfo &coreInfo, const JITFunctionInfo &info)
+{
+  JITIndirectBranchProfiles &recorded = coreInfo.indirectBranchProfiles;
+  for (std::vector<std::pair<uint32_t,uint32_t> >::const_iterator
+       it = info.fragmentRanges.begin(), e = info.fragmentRanges.end();
+       it != e; ++it) {
+    for (JITIndirectBranchProfiles::iterator
+         profileIt = recorded.lower_bound(it->first),
+         profileEnd = recorded.lower_bound(it->second);
+         profileIt != profileEnd; ++profileIt) {
+      profileIt->second.numTargets = 0;
+    }
+  }
+}
+
+void JITImpl::enqueueOrCompile(JITCompileRequest *request)
+{
+  Core &core = request->core;
+  if (request->optimize && tierPolicy == JIT::TIERED)
+    copyIndirectBranchProfiles(*request);
+  {
+    ScopedLock lock(queueMutex);
+    if (backgroundCompilation && startWorker()) {
+      queue.push_back(request);
+      ++requestsQueued;
+      totalQueueDepth += queue.size();
+      maxQueueDepth = std::max(maxQueueDepth, queue.size());
+      queueNotEmpty.notifyAll();
+      return;
+    }
+    backgroundCompilation = false;
+  }
+  {
+    ScopedLock lock(mutex);
+    compileRequest(*request);
+  }
+  // The request may come from compiled code (a baseline function tiering
+  // up) so the code is installed at the next safe point, as it is when it
+  // is compiled in the background.
+  core.setCompiledCodePending();
+  delete request;
+}
+
+void JITImpl::dumpStats(std::ostream &out)
+{
+  ScopedLock lock(mutex);
+  ScopedLock queueLock(queueMutex);
+  static const char *policyNames[] = { "tiered", "baseline", "optimizing" };
+  double meanQueueDepth =
+    requestsQueued ? (double)totalQueueDepth / (double)requestsQueued : 0.0;
+  out << "JIT tier policy:              " << policyNames[tierPolicy];
+  if (tierPolicy == JIT::TIERED)
+    out << " (tier up after " << tierUpThreshold << " executions)";
+  out << std::endl;
+  out << "JIT regions compiled:         " << regionsCompiled[BASELINE_TIER]
+    << " baseline, " << regionsCompiled[OPTIMIZING_TIER] << " optimizing"
+    << std::endl;
+  out << "JIT fragments compiled:       " << fragmentsCompiled[BASELINE_TIER]
+    << " baseline, " << fragmentsCompiled[OPTIMIZING_TIER] << " optimizing"
+    << std::endl;
+  out << "JIT regions tiered up:        " << regionsTieredUp << std::endl;
+  out << "JIT regions discarded:        " << regionsDiscarded << std::endl;
+  out << "JIT inline caches:            " << inlineCaches << std::endl;
+  out << "JIT code cache (KB):          " << codeCacheSize / 1024;
+  if (codeCacheLimit != 0)
+    out << " (limit " << codeCacheLimit / 1024 << ")";
+  out << std::endl;
+  out << "JIT functions evicted:        " << functionsEvicted << std::endl;
+  if (!cacheDirectory.empty()) {
+    out << "JIT regions from cache:       " << cachedRegionsLoaded << std::endl;
+  }
+  if (codeSharing) {
+    out << "JIT regions shared:           " << regionsShared << std::endl;
+  }
+  out << "JIT compile time (s):         "
+    << std::fixed << std::setprecision(3) << compileTime[BASELINE_TIER]
+    << " baseline, " << compileTime[OPTIMIZING_TIER] << " optimizing"
+    << std::endl;
+  out << "Mean JIT queue depth:         "
+    << std::setprecision(1) << meanQueueDepth << std::endl;
+  out << "Max JIT queue depth:          " << maxQueueDepth << std::endl;
+  out.unsetf(std::ios::floatfield);
+}
+
 void JIT::compileBlock(Core &core, uint32_t pc)
 {
   return JITImpl::instance.compileBlock(core, pc);
@@ -818,5 +2174,72 @@ void JIT::compileBlock(Core &core, uint32_t pc)
 
 bool JIT::invalidate(Core &core, uint32_t pc)
 {
+  ScopedLock lock(JITImpl::instance.mutex);
   return JITImpl::instance.invalidate(core, pc);
 }
+
+bool JIT::isCompiling()
+{
+  return JITImpl::instance.compiling.isSet();
+}
+
+bool JIT::installCompiledCode(Core &core)
+{
+  // Don't stall the simulation while the worker is compiling.
+  if (!JITImpl::instance.mutex.tryLock())
+    return false;
+  JITImpl::instance.installCompiledCode(core);
+  JITImpl::instance.evictColdFunctions(core);
+  JITImpl::instance.mutex.unlock();
+  return true;
+}
+
+void JIT::optimizeRegion(Core &core, uint32_t pc)
+{
+  return JITImpl::instance.optimizeRegion(core, pc);
+}
+
+void JIT::setTierPolicy(TierPolicy policy)
+{
+  JITImpl::instance.setTierPolicy(policy);
+}
+
+void JIT::setTierUpThreshold(uint32_t threshold)
+{
+  JITImpl::instance.setTierUpThreshold(threshold);
+}
+
+void JIT::setCacheDirectory(const std::string &dir)
+{
+  JITImpl::instance.setCacheDirectory(dir);
+}
+
+void JIT::writeCache()
+{
+  JITImpl::instance.writeCache();
+}
+
+void JIT::setCodeCacheLimit(size_t bytes)
+{
+  JITImpl::instance.setCodeCacheLimit(bytes);
+}
+
+void JIT::setCodeSharing(bool enable)
+{
+  JITImpl::instance.setCodeSharing(enable);
+}
+
+void JIT::setBackgroundCompilation(bool enable)
+{
+  JITImpl::instance.setBackgroundCompilation(enable);
+}
+
+void JIT::stopBackgroundCompilation()
+{
+  JITImpl::instance.stopWorker();
+}
+
+void JIT::dumpStats(std::ostream &out)
+{
+  JITImpl::instance.dumpStats(out);
+}
@@ -7,14 +7,60 @@
 #define _JIT_h_
 
 #include <stdint.h>
+#include <cstddef>
+#include <iosfwd>
+#include <string>
 #include "JITInstructionFunction.h"
 
 class Thread;
 class Core;
 
 namespace JIT {
+  enum TierPolicy {
+    /// Compile with the baseline tier and recompile fragments that execute
+    /// often with the optimizing tier.
+    TIERED,
+    BASELINE_ONLY,
+    OPTIMIZING_ONLY
+  };
+  /// Compile the block starting at the specified pc. Unless background
+  /// compilation is disabled the block is compiled on a worker thread. In
+  /// both cases the code is installed by a later call to
+  /// installCompiledCode().
   void compileBlock(Core &c, uint32_t pc);
+  /// Recompile the baseline region starting at the specified pc with the
+  /// optimizing tier.
+  void optimizeRegion(Core &c, uint32_t pc);
   bool invalidate(Core &c, uint32_t pc);
+  /// Install code compiled for the core on the worker thread. This must only
+  /// be called when none of the core's threads are executing compiled code.
+  /// \return false if the JIT was busy and nothing was installed.
+  bool installCompiledCode(Core &c);
+  /// Returns true while the worker thread is compiling. Compiled code can't
+  /// be installed until it has finished.
+  bool isCompiling();
+  void setBackgroundCompilation(bool enable);
+  void setTierPolicy(TierPolicy policy);
+  /// Set the number of times a baseline region must execute before it is
+  /// recompiled with the optimizing tier.
+  void setTierUpThreshold(uint32_t threshold);
+  /// Set the size in bytes of machine code above which the least recently
+  /// used functions are evicted. A size of 0 means there is no limit.
+  void setCodeCacheLimit(size_t bytes);
+  /// Share the code compiled for a region between all cores with the same
+  /// memory layout and the same code in the region. Shared code always
+  /// returns to the dispatch loop when it leaves the region.
+  void setCodeSharing(bool enable);
+  /// Use the specified directory as a persistent cache of the regions worth
+  /// compiling. Cached regions are compiled as soon as the core starts using
+  /// the JIT instead of once they become hot.
+  void setCacheDirectory(const std::string &dir);
+  /// Record the regions compiled in this run in the persistent cache. This
+  /// must be called after stopBackgroundCompilation().
+  void writeCache();
+  /// Stop the worker thread. This must be called before cores are destroyed.
+  void stopBackgroundCompilation();
+  void dumpStats(std::ostream &out);
 };
 
 #endif // _JIT_h_
@@ -0,0 +1,108 @@
+// Copyright (c) 2012, Richard Osborne, All rights reserved
+// This software is freely distributable under a derivative of the
+// University of Illinois/NCSA Open Source License posted in
+// LICENSE.txt and at <http://github.xcore.com/>
+
+#include "JITCache.h"
+#include "Config.h"
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+
+/// Identifies the file format. Increment when the format changes.
+static const char cacheFileHeader[] = "AXEJIT 1";
+
+uint64_t JITCache::hash(const void *data, size_t size, uint64_t h)
+{
+  const unsigned char *p = static_cast<const unsigned char *>(data);
+  for (size_t i = 0; i < size; i++) {
+    h ^= p[i];
+    h *= 0x100000001b3ULL;
+  }
+  return h;
+}
+
+std::string JITCache::getPath(const std::string &directory, uint64_t key)
+{
+  std::ostringstream path;
+  path << directory << '/' << std::hex << std::setfill('0') << std::setw(16)
+       << key << ".axejit";
+  return path.str();
+}
+
+bool JITCache::read(const std::string &path,
+                    std::vector<JITCacheRegion> &regions)
+{
+  std::ifstream in(path.c_str());
+  if (!in)
+    return false;
+  std::string header;
+  if (!std::getline(in, header) || header != cacheFileHeader)
+    return false;
+  std::vector<JITCacheRegion> result;
+  std::string line;
+  while (std::getline(in, line)) {
+    std::istringstream fields(line);
+    JITCacheRegion region;
+    unsigned optimized, numFragments;
+    if (!(fields >> optimized >> numFragments >> std::hex >> region.codeHash
+                 >> std::dec) ||
+        numFragments == 0 || numFragments > JIT_MAX_REGION_FRAGMENTS)
+      return false;
+    region.optimized = optimized != 0;
+    for (unsigned i = 0; i < numFragments; i++) {
+      uint32_t start, end;
+      if (!(fields >> start >> end) || start >= end)
+        return false;
+      region.fragments.push_back(std::make_pair(start, end));
+    }
+    result.push_back(region);
+  }
+  regions.swap(result);
+  return true;
+}
+
+bool JITCache::write(const std::string &path,
+                     const std::vector<JITCacheRegion> &regions)
+{
+  // Write to a temporary file and rename it so other processes sharing the
+  // cache never see a partially written file.
+  std::ostringstream tmpPath;
+  tmpPath << path << '.' << getpid() << ".tmp";
+  {
+    std::ofstream out(tmpPath.str().c_str());
+    if (!out)
+      return false;
+    out << cacheFileHeader << '\n';
+    for (std::vector<JITCacheRegion>::const_iterator it = regions.begin(),
+         e = regions.end(); it != e; ++it) {
+      out << it->optimized << ' ' << it->fragments.size() << ' ' << std::hex
+          << it->codeHash << std::dec;
+      for (unsigned i = 0, size = it->fragments.size(); i != size; ++i) {
+        out << ' ' << it->fragments[i].first << ' ' << it->fragments[i].second;
+      }
+      out << '\n';
+    }
+    if (!out) {
+      out.close();
+      std::remove(tmpPath.str().c_str());
+      return false;
+    }
+  }
+  if (std::rename(tmpPath.str().c_str(), path.c_str()) != 0) {
+    // Windows won't rename over an existing file.
+    std::remove(path.c_str());
+    if (std::rename(tmpPath.str().c_str(), path.c_str()) != 0) {
+      std::remove(tmpPath.str().c_str());
+      return false;
+    }
+  }
+  return true;
+}
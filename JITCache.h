@@ -0,0 +1,44 @@
+// Copyright (c) 2012, Richard Osborne, All rights reserved
+// This software is freely distributable under a derivative of the
+// University of Illinois/NCSA Open Source License posted in
+// LICENSE.txt and at <http://github.xcore.com/>
+
+#ifndef _JITCache_h_
+#define _JITCache_h_
+
+#include <stdint.h>
+#include <cstddef>
+#include <string>
+#include <utility>
+#include <vector>
+
+/// A region recorded in the persistent JIT cache.
+struct JITCacheRegion {
+  JITCacheRegion() : optimized(false), codeHash(0) {}
+  /// Whether the region was compiled by the optimizing tier.
+  bool optimized;
+  /// The start and end pc of each fragment. The first fragment is the entry
+  /// point of the region.
+  std::vector<std::pair<uint32_t,uint32_t> > fragments;
+  /// Hash of the instructions in the fragments.
+  uint64_t codeHash;
+};
+
+/// Reading and writing of the files in the persistent JIT cache directory.
+/// Each file lists the regions compiled for cores with the same memory layout
+/// by the same build of the simulator.
+namespace JITCache {
+  const uint64_t INITIAL_HASH = 0xcbf29ce484222325ULL;
+  /// Update a 64-bit FNV-1a hash with the specified data.
+  uint64_t hash(const void *data, size_t size, uint64_t h = INITIAL_HASH);
+  /// Returns the path of the cache file with the specified key.
+  std::string getPath(const std::string &directory, uint64_t key);
+  /// Read the regions from a cache file. Returns false if the file doesn't
+  /// exist or isn't a valid cache file.
+  bool read(const std::string &path, std::vector<JITCacheRegion> &regions);
+  /// Replace the cache file with one listing the specified regions.
+  bool write(const std::string &path,
+             const std::vector<JITCacheRegion> &regions);
+};
+
+#endif // _JITCache_h_
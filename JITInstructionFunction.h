@@ -6,6 +6,8 @@
 #ifndef _JITInstructionFunction_h_
 #define _JITInstructionFunction_h_
 
+#include "Config.h"
+
 class Thread;
 
 enum JITReturn {
@@ -19,4 +21,12 @@ enum JITReturn {
 
 typedef JITReturn (*JITInstructionFunction_t)(Thread &);
 
+/// Targets of an indirect branch recorded by code compiled by the JIT's
+/// baseline tier. Only the first JIT_INLINE_CACHE_SIZE distinct targets are
+/// kept.
+struct JITIndirectBranchProfile {
+  volatile uint32_t numTargets;
+  volatile uint32_t targets[JIT_INLINE_CACHE_SIZE];
+};
+
 #endif // _JITInstructionFunction_h_
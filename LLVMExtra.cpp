@@ -5,14 +5,23 @@
 
 #include "LLVMExtra.h"
 #include "llvm-c/Disassembler.h"
+#include "llvm/Analysis/ValueTracking.h"
 #include "llvm/ExecutionEngine/ExecutionEngine.h"
 #include "llvm/ExecutionEngine/JITEventListener.h"
+#include "llvm/IntrinsicInst.h"
+#include "llvm/Operator.h"
 #include "llvm/Support/CallSite.h"
+#include "llvm/Support/IRBuilder.h"
+#include "llvm/Support/InstIterator.h"
 #include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Transforms/Utils/Cloning.h"
 #include "llvm/Transforms/Scalar.h"
+#include "llvm/Target/TargetData.h"
 #include "llvm/PassManager.h"
 #include <iostream>
+#include <map>
+#include <set>
+#include <vector>
 
 using namespace llvm;
 
@@ -32,6 +41,220 @@ void LLVMExtraAddDeadCodeEliminationPass(LLVMPassManagerRef PM) {
   unwrap(PM)->add(createDeadCodeEliminationPass());
 }
 
+/// Returns whether the pointer is derived from a pointer to a thread. Nothing
+/// in the simulator accesses thread state other than through a thread pointer
+/// so any other pointer can't alias the thread's registers.
+static bool isDerivedFromThread(Value *V, Type *ThreadTy)
+{
+  while (1) {
+    if (V->getType() == ThreadTy)
+      return true;
+    if (GEPOperator *GEP = dyn_cast<GEPOperator>(V))
+      V = GEP->getPointerOperand();
+    else if (BitCastOperator *BC = dyn_cast<BitCastOperator>(V))
+      V = BC->getOperand(0);
+    else
+      return false;
+  }
+}
+
+static void
+emitRegisterWriteBack(IRBuilder<> &Builder, const std::vector<Value*> &Slots,
+                      const std::vector<Value*> &Addrs)
+{
+  for (unsigned i = 0, e = Slots.size(); i != e; ++i) {
+    if (Slots[i])
+      Builder.CreateStore(Builder.CreateLoad(Slots[i]), Addrs[i]);
+  }
+}
+
+static void
+emitRegisterReload(IRBuilder<> &Builder, const std::vector<Value*> &Slots,
+                   const std::vector<Value*> &Addrs)
+{
+  for (unsigned i = 0, e = Slots.size(); i != e; ++i) {
+    if (Slots[i])
+      Builder.CreateStore(Builder.CreateLoad(Addrs[i]), Slots[i]);
+  }
+}
+
+static void addAliasMetadata(Function *F, Type *ThreadTy)
+{
+  LLVMContext &Ctx = F->getContext();
+  Value *RootOps[] = { MDString::get(Ctx, "XCore JIT TBAA") };
+  MDNode *Root = MDNode::get(Ctx, RootOps);
+  Value *ThreadOps[] = { MDString::get(Ctx, "thread"), Root };
+  MDNode *ThreadTag = MDNode::get(Ctx, ThreadOps);
+  Value *MemoryOps[] = { MDString::get(Ctx, "memory"), Root };
+  MDNode *MemoryTag = MDNode::get(Ctx, MemoryOps);
+  for (inst_iterator I = inst_begin(F), E = inst_end(F); I != E; ++I) {
+    Value *Ptr;
+    if (LoadInst *LI = dyn_cast<LoadInst>(&*I))
+      Ptr = LI->getPointerOperand();
+    else if (StoreInst *SI = dyn_cast<StoreInst>(&*I))
+      Ptr = SI->getPointerOperand();
+    else
+      continue;
+    // Replace any metadata from the bitcode so all tags share the same root.
+    I->setMetadata(LLVMContext::MD_tbaa,
+                   isDerivedFromThread(Ptr, ThreadTy) ? ThreadTag : MemoryTag);
+  }
+}
+
+void LLVMExtraPromoteThreadRegisters(LLVMValueRef Fn, LLVMTargetDataRef TDRef,
+                                     unsigned RegsOffset, unsigned NumRegs)
+{
+  Function *F = unwrap<Function>(Fn);
+  const TargetData &TD = *unwrap(TDRef);
+  LLVMContext &Ctx = F->getContext();
+  Argument *Thread = F->arg_begin();
+  Type *ThreadTy = Thread->getType();
+  Type *Int32Ty = Type::getInt32Ty(Ctx);
+
+  std::vector<std::pair<Instruction*,unsigned> > RegAccesses;
+  std::vector<Instruction*> Clobbers;
+  std::set<Instruction*> ClobberSet;
+  std::vector<Instruction*> Returns;
+  for (inst_iterator I = inst_begin(F), E = inst_end(F); I != E; ++I) {
+    Instruction *Inst = &*I;
+    Value *Ptr;
+    Type *AccessTy;
+    bool Volatile;
+    if (LoadInst *LI = dyn_cast<LoadInst>(Inst)) {
+      Ptr = LI->getPointerOperand();
+      AccessTy = LI->getType();
+      Volatile = LI->isVolatile();
+    } else if (StoreInst *SI = dyn_cast<StoreInst>(Inst)) {
+      Ptr = SI->getPointerOperand();
+      AccessTy = SI->getValueOperand()->getType();
+      Volatile = SI->isVolatile();
+    } else if (isa<ReturnInst>(Inst)) {
+      Returns.push_back(Inst);
+      continue;
+    } else {
+      if (isa<DbgInfoIntrinsic>(Inst) || !Inst->mayReadOrWriteMemory())
+        continue;
+      if (CallInst *CI = dyn_cast<CallInst>(Inst)) {
+        if (CI->doesNotAccessMemory())
+          continue;
+      }
+      Clobbers.push_back(Inst);
+      continue;
+    }
+    if (!isDerivedFromThread(Ptr, ThreadTy))
+      continue;
+    int64_t Offset;
+    if (GetPointerBaseWithConstantOffset(Ptr, Offset, TD) == Thread) {
+      int64_t RegOffset = Offset - (int64_t)RegsOffset;
+      int64_t Size = TD.getTypeStoreSize(AccessTy);
+      if (RegOffset + Size <= 0 || RegOffset >= (int64_t)NumRegs * 4)
+        continue;
+      if (!Volatile && AccessTy == Int32Ty && RegOffset % 4 == 0) {
+        RegAccesses.push_back(std::make_pair(Inst, (unsigned)RegOffset / 4));
+        continue;
+      }
+    }
+    // Thread state accessed through another pointer, for example through the
+    // master of a synchroniser, which may be this thread.
+    Clobbers.push_back(Inst);
+  }
+
+  if (!RegAccesses.empty()) {
+    // Create a stack slot for each register accessed and load the registers
+    // on entry.
+    BasicBlock &Entry = F->getEntryBlock();
+    IRBuilder<> Builder(&Entry, Entry.begin());
+    Value *ThreadBytes = Builder.CreateBitCast(Thread, Type::getInt8PtrTy(Ctx));
+    std::vector<Value*> Slots(NumRegs);
+    std::vector<Value*> Addrs(NumRegs);
+    for (unsigned i = 0, e = RegAccesses.size(); i != e; ++i) {
+      unsigned Reg = RegAccesses[i].second;
+      if (Slots[Reg])
+        continue;
+      Slots[Reg] = Builder.CreateAlloca(Int32Ty);
+      Value *Addr = Builder.CreateConstGEP1_32(ThreadBytes,
+                                               RegsOffset + Reg * 4);
+      Addrs[Reg] = Builder.CreateBitCast(Addr,
+                                         PointerType::getUnqual(Int32Ty));
+    }
+    emitRegisterReload(Builder, Slots, Addrs);
+    for (unsigned i = 0, e = RegAccesses.size(); i != e; ++i) {
+      Instruction *Inst = RegAccesses[i].first;
+      Value *Slot = Slots[RegAccesses[i].second];
+      if (LoadInst *LI = dyn_cast<LoadInst>(Inst))
+        LI->setOperand(LoadInst::getPointerOperandIndex(), Slot);
+      else
+        cast<StoreInst>(Inst)->setOperand(StoreInst::getPointerOperandIndex(),
+                                          Slot);
+    }
+    // Write back registers before anything that might read them and reload
+    // them after anything that might write them.
+    for (std::vector<Instruction*>::iterator it = Clobbers.begin(),
+         e = Clobbers.end(); it != e; ++it) {
+      Instruction *Inst = *it;
+      ClobberSet.insert(Inst);
+      Builder.SetInsertPoint(Inst);
+      emitRegisterWriteBack(Builder, Slots, Addrs);
+      if (!Inst->mayWriteToMemory())
+        continue;
+      BasicBlock::iterator Next = Inst;
+      ++Next;
+      // Keep tail calls in tail position. The registers are dead after the
+      // return.
+      if (isa<ReturnInst>(Next))
+        continue;
+      Builder.SetInsertPoint(Inst->getParent(), Next);
+      emitRegisterReload(Builder, Slots, Addrs);
+    }
+    for (std::vector<Instruction*>::iterator it = Returns.begin(),
+         e = Returns.end(); it != e; ++it) {
+      Instruction *Ret = *it;
+      BasicBlock::iterator Prev = Ret;
+      if (Prev != Ret->getParent()->begin() && ClobberSet.count(--Prev))
+        continue;
+      Builder.SetInsertPoint(Ret);
+      emitRegisterWriteBack(Builder, Slots, Addrs);
+    }
+  }
+  addAliasMetadata(F, ThreadTy);
+}
+
+namespace {
+class CodeSizeListener : public JITEventListener {
+public:
+  std::map<const Function*, size_t> sizes;
+  virtual void NotifyFunctionEmitted(const Function &F, void *Code,
+                                     size_t Size,
+                                     const EmittedFunctionDetails &) {
+    sizes[&F] = Size;
+  }
+};
+}
+
+static CodeSizeListener codeSizeListener;
+
+void LLVMExtraEnableCodeSizeTracking(LLVMExecutionEngineRef EE)
+{
+  unwrap(EE)->RegisterJITEventListener(&codeSizeListener);
+}
+
+size_t LLVMExtraGetMachineCodeSize(LLVMValueRef F)
+{
+  std::map<const Function*, size_t>::iterator it =
+    codeSizeListener.sizes.find(unwrap<Function>(F));
+  if (it == codeSizeListener.sizes.end())
+    return 0;
+  return it->second;
+}
+
+void LLVMExtraFreeMachineCodeForFunction(LLVMExecutionEngineRef EE,
+                                         LLVMValueRef F)
+{
+  Function *Fn = unwrap<Function>(F);
+  unwrap(EE)->freeMachineCodeForFunction(Fn);
+  codeSizeListener.sizes.erase(Fn);
+}
+
 #if 0
 class JitDisassembler : public JITEventListener {
   LLVMDisasmContextRef DC;
@@ -8,6 +8,7 @@
 
 #include "llvm-c/Core.h"
 #include "llvm-c/ExecutionEngine.h"
+#include "llvm-c/Target.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -19,6 +20,28 @@ LLVMBool LLVMExtraInlineFunction(LLVMValueRef call);
 
 void LLVMExtraAddDeadCodeEliminationPass(LLVMPassManagerRef PM);
 
+/// Rewrite accesses to the registers of the thread passed as the first
+/// argument of the function to use stack slots which the mem2reg pass can
+/// promote to SSA values. Registers are loaded once on entry and are written
+/// back before returns and before anything which might otherwise observe
+/// them. Loads and stores are also tagged with type based alias analysis
+/// metadata that separates thread state from all other memory.
+void LLVMExtraPromoteThreadRegisters(LLVMValueRef function,
+                                     LLVMTargetDataRef TD,
+                                     unsigned regsOffset,
+                                     unsigned numRegs);
+
+/// Start recording the size of the machine code emitted for each function.
+void LLVMExtraEnableCodeSizeTracking(LLVMExecutionEngineRef EE);
+
+/// Returns the size of the machine code emitted for the function, or 0 if it
+/// is unknown.
+size_t LLVMExtraGetMachineCodeSize(LLVMValueRef function);
+
+/// Free the machine code for the function and forget its size.
+void LLVMExtraFreeMachineCodeForFunction(LLVMExecutionEngineRef EE,
+                                         LLVMValueRef function);
+
 void LLVMExtraRegisterJitDisassembler(LLVMExecutionEngineRef EE,
                                       const char *triple);
 
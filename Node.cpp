@@ -5,6 +5,7 @@
 
 #include "Node.h"
 #include "Core.h"
+#include "SchedulingContext.h"
 
 XLink::XLink() :
   destNode(0),
@@ -165,7 +166,12 @@ XLink *Node::getXLinkForDirection(unsigned direction)
   return 0;
 }
 
-ChanEndpoint *Node::getChanendDest(ResourceID ID)
+SchedulingContext &Node::getSchedulingContext()
+{
+  return cores.front()->getSchedulingContext();
+}
+
+ChanEndpoint *Node::getChanendDest(ResourceID ID, SchedulingContext &from)
 {
   Node *node = this;
   // Use Brent's algorithm to detect cycles.
@@ -194,13 +200,20 @@ ChanEndpoint *Node::getChanendDest(ResourceID ID)
       tortoise = node;
     }
   }
+  ChanEndpoint *dest = 0;
+  SchedulingContext *destContext;
   if (ID.isConfig() && ID.num() == RES_CONFIG_SSCTRL) {
-    return &node->sswitch;
+    dest = &node->sswitch;
+    destContext = &node->getSchedulingContext();
+  } else {
+    unsigned destCore = ID.node() & makeMask(node->getCoreNumberBits());
+    if (destCore >= node->cores.size())
+      return 0;
+    Core *core = node->getCores()[destCore];
+    core->getLocalChanendDest(ID, dest);
+    destContext = &core->getSchedulingContext();
   }
-  unsigned destCore = ID.node() & makeMask(node->getCoreNumberBits());
-  if (destCore >= node->cores.size())
-    return 0;
-  ChanEndpoint *dest = 0;
-  node->getCores()[destCore]->getLocalChanendDest(ID, dest);
+  if (dest && destContext != &from)
+    return from.getQuantumChannel(*dest);
   return dest;
 }
@@ -14,6 +14,7 @@
 
 class Core;
 class SystemState;
+class SchedulingContext;
 
 class Node;
 
@@ -94,7 +95,14 @@ public:
   XLink &getXLink(unsigned num) { return xLinks[num]; }
   const XLink &getXLink(unsigned num) const { return xLinks[num]; }
   void connectXLink(unsigned num, Node *destNode, unsigned destNum);
-  ChanEndpoint *getChanendDest(ResourceID ID);
+  /// Returns the endpoint to use to send to the specified resource ID.
+  /// \param from The context of the sender. If the destination is in a
+  ///             different context an endpoint which buffers tokens until the
+  ///             next quantum boundary is returned.
+  ChanEndpoint *getChanendDest(ResourceID ID, SchedulingContext &from);
+  /// Returns the context used to schedule the switch. This is the context of
+  /// the first core.
+  SchedulingContext &getSchedulingContext();
   uint8_t getDirection(unsigned num) const { return directions[num]; }
   void setDirection(unsigned num, uint8_t value) { directions[num] = value; }
 };
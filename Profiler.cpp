@@ -0,0 +1,374 @@
+// Copyright (c) 2012, Richard Osborne, All rights reserved
+// This software is freely distributable under a derivative of the
+// University of Illinois/NCSA Open Source License posted in
+// LICENSE.txt and at <http://github.xcore.com/>
+
+#include "Profiler.h"
+#include "SystemState.h"
+#include "SymbolInfo.h"
+#include "Node.h"
+#include "Core.h"
+#include "Thread.h"
+#include "Instruction.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <set>
+
+using namespace Register;
+
+namespace {
+  /// Identifies a function by the index of its core and its start address.
+  typedef std::pair<unsigned, uint32_t> FunctionKey;
+  /// Identifies a call by its return address and the function called.
+  typedef std::pair<uint32_t, FunctionKey> CallKey;
+
+  struct CallgrindFunction {
+    std::string name;
+    /// Number of samples at each pc in the function.
+    std::map<uint32_t, uint64_t> self;
+    /// Number of samples in each call made by the function, including the
+    /// samples in functions it calls.
+    std::map<CallKey, uint64_t> calls;
+  };
+
+  /// Builds a message in the protocol buffer wire format.
+  class ProtobufMessage {
+    std::string data;
+    void addVarint(uint64_t value) {
+      while (value >= 0x80) {
+        data += char((value & 0x7f) | 0x80);
+        value >>= 7;
+      }
+      data += char(value);
+    }
+    void addKey(unsigned field, unsigned wireType) {
+      addVarint((field << 3) | wireType);
+    }
+  public:
+    void addInt(unsigned field, uint64_t value) {
+      addKey(field, 0);
+      addVarint(value);
+    }
+    void addBytes(unsigned field, const std::string &value) {
+      addKey(field, 2);
+      addVarint(value.size());
+      data += value;
+    }
+    void addMessage(unsigned field, const ProtobufMessage &message) {
+      addBytes(field, message.data);
+    }
+    void addPacked(unsigned field, const std::vector<uint64_t> &values) {
+      ProtobufMessage packed;
+      for (unsigned i = 0, e = values.size(); i != e; ++i)
+        packed.addVarint(values[i]);
+      addBytes(field, packed.data);
+    }
+    /// Append the fields of another message.
+    void append(const ProtobufMessage &message) { data += message.data; }
+    const std::string &getData() const { return data; }
+  };
+
+  /// The table of strings referenced by index from a pprof profile.
+  class StringTable {
+    std::map<std::string, uint64_t> indices;
+    std::vector<std::string> strings;
+  public:
+    StringTable() { get(""); }
+    uint64_t get(const std::string &s) {
+      std::map<std::string, uint64_t>::iterator it = indices.find(s);
+      if (it != indices.end())
+        return it->second;
+      uint64_t index = strings.size();
+      indices.insert(std::make_pair(s, index));
+      strings.push_back(s);
+      return index;
+    }
+    void addTo(unsigned field, ProtobufMessage &message) const {
+      for (unsigned i = 0, e = strings.size(); i != e; ++i)
+        message.addBytes(field, strings[i]);
+    }
+  };
+} // End anonymous namespace
+
+bool Profiler::Sample::operator<(const Sample &other) const
+{
+  if (core != other.core)
+    return core < other.core;
+  if (thread != other.thread)
+    return thread < other.thread;
+  return stack < other.stack;
+}
+
+Profiler::Profiler(SystemState &s, const SymbolInfo *si,
+                   const std::string &f, Format fmt, ticks_t i) :
+  sys(s),
+  symInfo(si),
+  file(f),
+  format(fmt),
+  interval(i),
+  nextSampleTime(i),
+  numSamples(0)
+{
+  for (SystemState::node_iterator nIt = sys.node_begin(),
+       nEnd = sys.node_end(); nIt != nEnd; ++nIt) {
+    Node &node = **nIt;
+    for (Node::core_iterator cIt = node.core_begin(), cEnd = node.core_end();
+         cIt != cEnd; ++cIt) {
+      cores.push_back(*cIt);
+    }
+  }
+}
+
+void Profiler::start()
+{
+  sys.getScheduler().push(*this, nextSampleTime);
+}
+
+void Profiler::run(ticks_t time)
+{
+  for (unsigned i = 0, e = cores.size(); i != e; ++i) {
+    Core &core = *cores[i];
+    for (unsigned j = 0; j != NUM_THREADS; ++j) {
+      Thread &thread = core.getThread(j);
+      if (thread.isInUse() && !thread.waiting())
+        sample(i, thread);
+    }
+  }
+  // Stop once nothing else is left to run, otherwise the profiler would keep
+  // the simulation going forever.
+  nextSampleTime = time + interval;
+  RunnableQueue &queue = sys.getScheduler();
+  if (!queue.empty())
+    queue.push(*this, nextSampleTime);
+}
+
+void Profiler::sample(unsigned coreIndex, Thread &thread)
+{
+  Sample s;
+  s.core = coreIndex;
+  s.thread = thread.getNum();
+  unwind(thread, s.stack);
+  ++samples[s];
+  ++numSamples;
+}
+
+/// Returns the number of bytes of stack allocated by the ENTSP at the start
+/// of the function at the specified address, or 0 if the function doesn't
+/// start by saving lr on the stack.
+static uint32_t getFrameSize(Core &core, uint32_t address)
+{
+  if ((address & 1) || !core.isValidAddress(address))
+    return 0;
+  InstructionOpcode opcode;
+  Operands operands;
+  instructionDecode(core, core.toPc(address), opcode, operands);
+  if (opcode != ENTSP_u6 && opcode != ENTSP_lu6)
+    return 0;
+  return operands.ops[0] << 2;
+}
+
+void Profiler::unwind(Thread &thread, std::vector<uint32_t> &stack) const
+{
+  Core &core = thread.getParent();
+  uint32_t pc = core.targetPc(thread.pc);
+  uint32_t sp = thread.regs[SP];
+  stack.push_back(pc);
+  while (stack.size() < PROFILE_MAX_STACK_DEPTH) {
+    const ElfSymbol *sym = symInfo ? symInfo->getFunctionSymbol(&core, pc) : 0;
+    if (!sym)
+      return;
+    // Until the ENTSP at the start of the function is executed the return
+    // address is still in lr.
+    uint32_t frameSize = 0;
+    if (pc != sym->value)
+      frameSize = getFrameSize(core, sym->value);
+    uint32_t returnAddress;
+    if (frameSize != 0) {
+      sp += frameSize;
+      if ((sp & 3) || !core.isValidAddress(sp))
+        return;
+      returnAddress = core.loadWord(sp);
+    } else if (stack.size() == 1) {
+      returnAddress = thread.regs[LR];
+    } else {
+      return;
+    }
+    if ((returnAddress & 1) || !core.isValidAddress(returnAddress))
+      return;
+    pc = returnAddress;
+    stack.push_back(pc);
+  }
+}
+
+std::string Profiler::
+getFunctionName(unsigned core, uint32_t address, uint32_t &start) const
+{
+  const ElfSymbol *sym =
+    symInfo ? symInfo->getFunctionSymbol(cores[core], address) : 0;
+  if (!sym) {
+    start = 0;
+    return "[unknown]";
+  }
+  start = sym->value;
+  return sym->name;
+}
+
+void Profiler::writeCallgrind(std::ostream &out) const
+{
+  std::map<FunctionKey, CallgrindFunction> functions;
+  std::set<std::pair<FunctionKey, CallKey> > seen;
+  std::vector<FunctionKey> keys;
+  for (SampleMap::const_iterator it = samples.begin(), e = samples.end();
+       it != e; ++it) {
+    const Sample &s = it->first;
+    uint64_t count = it->second;
+    keys.resize(s.stack.size());
+    for (unsigned i = 0, e = s.stack.size(); i != e; ++i) {
+      uint32_t start;
+      std::string name = getFunctionName(s.core, s.stack[i], start);
+      keys[i] = FunctionKey(s.core, start);
+      functions[keys[i]].name = name;
+    }
+    functions[keys[0]].self[s.stack[0]] += count;
+    // Only count each call once for recursive functions.
+    seen.clear();
+    for (unsigned i = 1, e = s.stack.size(); i != e; ++i) {
+      CallKey call(s.stack[i], keys[i - 1]);
+      if (seen.insert(std::make_pair(keys[i], call)).second)
+        functions[keys[i]].calls[call] += count;
+    }
+  }
+
+  out << "# callgrind format\n";
+  out << "version: 1\n";
+  out << "creator: axe\n";
+  out << "positions: instr\n";
+  out << "events: Samples\n";
+  out << "summary: " << numSamples << '\n';
+  unsigned currentCore = ~0u;
+  for (std::map<FunctionKey, CallgrindFunction>::const_iterator
+       it = functions.begin(), e = functions.end(); it != e; ++it) {
+    const CallgrindFunction &f = it->second;
+    if (it->first.first != currentCore) {
+      currentCore = it->first.first;
+      out << "\nob=" << cores[currentCore]->getCoreName() << '\n';
+    }
+    out << "\nfn=" << f.name << '\n';
+    for (std::map<uint32_t, uint64_t>::const_iterator sIt = f.self.begin(),
+         sEnd = f.self.end(); sIt != sEnd; ++sIt) {
+      out << "0x" << std::hex << sIt->first << std::dec << ' ' << sIt->second
+          << '\n';
+    }
+    // The number of calls isn't known, report the number of samples instead.
+    for (std::map<CallKey, uint64_t>::const_iterator cIt = f.calls.begin(),
+         cEnd = f.calls.end(); cIt != cEnd; ++cIt) {
+      const FunctionKey &callee = cIt->first.second;
+      out << "cfn=" << functions.find(callee)->second.name << '\n';
+      out << "calls=" << cIt->second << " 0x" << std::hex << callee.second
+          << '\n';
+      out << "0x" << cIt->first.first << std::dec << ' ' << cIt->second
+          << '\n';
+    }
+  }
+}
+
+void Profiler::writePprof(std::ostream &out) const
+{
+  StringTable strings;
+  ProtobufMessage profile;
+  ProtobufMessage locations;
+  ProtobufMessage functions;
+  std::map<std::pair<unsigned, uint32_t>, uint64_t> locationIDs;
+  std::map<FunctionKey, uint64_t> functionIDs;
+
+  // Profile.sample_type
+  ProtobufMessage samplesType;
+  samplesType.addInt(1, strings.get("samples"));
+  samplesType.addInt(2, strings.get("count"));
+  profile.addMessage(1, samplesType);
+  ProtobufMessage cyclesType;
+  cyclesType.addInt(1, strings.get("cycles"));
+  cyclesType.addInt(2, strings.get("count"));
+  profile.addMessage(1, cyclesType);
+
+  std::vector<uint64_t> ids;
+  std::vector<uint64_t> values(2);
+  for (SampleMap::const_iterator it = samples.begin(), e = samples.end();
+       it != e; ++it) {
+    const Sample &s = it->first;
+    std::string coreName = cores[s.core]->getCoreName();
+    ids.clear();
+    for (unsigned i = 0, e = s.stack.size(); i != e; ++i) {
+      std::pair<unsigned, uint32_t> location(s.core, s.stack[i]);
+      uint64_t &id = locationIDs[location];
+      if (id == 0) {
+        id = locationIDs.size();
+        uint32_t start;
+        std::string name = getFunctionName(s.core, s.stack[i], start);
+        uint64_t &functionID = functionIDs[FunctionKey(s.core, start)];
+        if (functionID == 0) {
+          functionID = functionIDs.size();
+          // Profile.function
+          ProtobufMessage function;
+          function.addInt(1, functionID);
+          function.addInt(2, strings.get(name));
+          function.addInt(3, strings.get(name));
+          function.addInt(4, strings.get(coreName));
+          functions.addMessage(5, function);
+        }
+        // Profile.location
+        ProtobufMessage line;
+        line.addInt(1, functionID);
+        ProtobufMessage loc;
+        loc.addInt(1, id);
+        loc.addInt(3, s.stack[i]);
+        loc.addMessage(4, line);
+        locations.addMessage(4, loc);
+      }
+      ids.push_back(id);
+    }
+    // Profile.sample
+    ProtobufMessage sample;
+    sample.addPacked(1, ids);
+    values[0] = it->second;
+    values[1] = it->second * interval;
+    sample.addPacked(2, values);
+    ProtobufMessage coreLabel;
+    coreLabel.addInt(1, strings.get("core"));
+    coreLabel.addInt(2, strings.get(coreName));
+    sample.addMessage(3, coreLabel);
+    ProtobufMessage threadLabel;
+    threadLabel.addInt(1, strings.get("thread"));
+    threadLabel.addInt(3, s.thread);
+    sample.addMessage(3, threadLabel);
+    profile.addMessage(2, sample);
+  }
+  profile.append(locations);
+  profile.append(functions);
+
+  // Profile.period_type and Profile.period
+  ProtobufMessage periodType;
+  periodType.addInt(1, strings.get("cycles"));
+  periodType.addInt(2, strings.get("count"));
+  profile.addMessage(11, periodType);
+  profile.addInt(12, interval);
+  // Profile.string_table
+  strings.addTo(6, profile);
+
+  const std::string &data = profile.getData();
+  out.write(data.data(), data.size());
+}
+
+void Profiler::write() const
+{
+  std::ofstream out(file.c_str(), std::ios::out | std::ios::binary);
+  if (!out) {
+    std::cerr << "Error: cannot open " << file << std::endl;
+    return;
+  }
+  if (format == PPROF)
+    writePprof(out);
+  else
+    writeCallgrind(out);
+}
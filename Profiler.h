@@ -0,0 +1,80 @@
+// Copyright (c) 2012, Richard Osborne, All rights reserved
+// This software is freely distributable under a derivative of the
+// University of Illinois/NCSA Open Source License posted in
+// LICENSE.txt and at <http://github.xcore.com/>
+
+#ifndef _Profiler_h_
+#define _Profiler_h_
+
+#include "Runnable.h"
+#include <iosfwd>
+#include <map>
+#include <string>
+#include <vector>
+
+class SystemState;
+class SymbolInfo;
+class Core;
+class Thread;
+
+/// Statistical profiler which samples the pc of every running thread at a
+/// fixed interval of simulated time. Samples are taken by a runnable in the
+/// scheduler's queue so they don't depend on how the thread is executed
+/// (dispatch loop, threaded interpreter or compiled code) and cost nothing
+/// between samples.
+///
+/// The call stack of each sample is recovered by unwinding the frames set up
+/// by ENTSP: the size of a function's frame is read from the ENTSP at its
+/// start and the return address is loaded from the top of the frame. The
+/// return address of the innermost function is taken from lr if it hasn't
+/// saved lr on the stack.
+class Profiler : public Runnable {
+public:
+  enum Format {
+    /// Text format read by callgrind_annotate and KCachegrind.
+    CALLGRIND,
+    /// Uncompressed profile.proto protocol buffer read by pprof.
+    PPROF
+  };
+private:
+  /// Samples with the same call stack on the same thread are merged.
+  struct Sample {
+    /// Index of the core in cores.
+    unsigned core;
+    unsigned thread;
+    /// The pc followed by the return address of each enclosing frame.
+    std::vector<uint32_t> stack;
+    bool operator<(const Sample &other) const;
+  };
+  typedef std::map<Sample, uint64_t> SampleMap;
+
+  SystemState &sys;
+  const SymbolInfo *symInfo;
+  std::string file;
+  Format format;
+  ticks_t interval;
+  /// Time of the next sample. The system may be run more than once, later
+  /// runs carry on sampling from where the previous run stopped.
+  ticks_t nextSampleTime;
+  /// Cores in the order they appear in the system.
+  std::vector<Core*> cores;
+  SampleMap samples;
+  uint64_t numSamples;
+
+  void sample(unsigned coreIndex, Thread &thread);
+  void unwind(Thread &thread, std::vector<uint32_t> &stack) const;
+  std::string getFunctionName(unsigned core, uint32_t address,
+                              uint32_t &start) const;
+  void writeCallgrind(std::ostream &out) const;
+  void writePprof(std::ostream &out) const;
+public:
+  Profiler(SystemState &sys, const SymbolInfo *symInfo,
+           const std::string &file, Format format, ticks_t interval);
+  /// Schedule the first sample. Must be called before the system is run.
+  void start();
+  void run(ticks_t time);
+  /// Write the samples taken so far to the profile file.
+  void write() const;
+};
+
+#endif // _Profiler_h_
@@ -0,0 +1,125 @@
+// Copyright (c) 2012, Richard Osborne, All rights reserved
+// This software is freely distributable under a derivative of the
+// University of Illinois/NCSA Open Source License posted in
+// LICENSE.txt and at <http://github.xcore.com/>
+
+#include "QuantumChannel.h"
+#include <algorithm>
+
+QuantumChannel::QuantumChannel(ChanEndpoint &d) :
+  dest(d),
+  inFlight(0),
+  sourceWaiting(false),
+  routeOpen(false),
+  claimPending(false),
+  junkPacket(false),
+  tokensDelivered(0),
+  totalDelay(0),
+  maxDelay(0)
+{
+  setJunkIncoming(false);
+}
+
+bool QuantumChannel::canAcceptToken()
+{
+  return canAcceptTokens(1);
+}
+
+bool QuantumChannel::canAcceptTokens(unsigned tokens)
+{
+  if (outgoing.size() + inFlight + tokens <= QUANTUM_CHANNEL_BUFFER_SIZE)
+    return true;
+  // The source will deschedule and wait for notifyDestCanAcceptTokens().
+  sourceWaiting = true;
+  return false;
+}
+
+void QuantumChannel::receiveToken(ticks_t time, Token token)
+{
+  outgoing.push_back(TimedToken(token, time));
+}
+
+void QuantumChannel::receiveDataToken(ticks_t time, uint8_t value)
+{
+  receiveToken(time, Token(value));
+}
+
+void QuantumChannel::
+receiveDataTokens(ticks_t time, uint8_t *values, unsigned num)
+{
+  for (unsigned i = 0; i < num; i++) {
+    receiveToken(time, Token(values[i]));
+  }
+}
+
+void QuantumChannel::receiveCtrlToken(ticks_t time, uint8_t value)
+{
+  // Unlike a chanend the pause is kept so the destination's route is closed
+  // when it is replayed.
+  receiveToken(time, Token(value, true));
+  if (value == CT_END || value == CT_PAUSE)
+    release(time);
+}
+
+void QuantumChannel::deliver(ticks_t time)
+{
+  while (!pending.empty() && !claimPending) {
+    if (!routeOpen) {
+      junkPacket = false;
+      if (!dest.claim(this, junkPacket)) {
+        claimPending = true;
+        return;
+      }
+      routeOpen = true;
+    }
+    TimedToken t = pending.front();
+    if (!junkPacket) {
+      if (!dest.canAcceptToken())
+        return;
+      ticks_t deliveryTime = std::max(time, t.time);
+      ticks_t delay = deliveryTime - t.time;
+      ++tokensDelivered;
+      totalDelay += delay;
+      maxDelay = std::max(maxDelay, delay);
+      pending.pop_front();
+      if (t.token.isControl()) {
+        dest.receiveCtrlToken(deliveryTime, t.token.getValue());
+      } else {
+        dest.receiveDataToken(deliveryTime, t.token.getValue());
+      }
+    } else {
+      pending.pop_front();
+    }
+    if (t.token.isControl() &&
+        (t.token.getValue() == CT_END || t.token.getValue() == CT_PAUSE)) {
+      routeOpen = false;
+    }
+  }
+}
+
+void QuantumChannel::notifyDestClaimed(ticks_t time)
+{
+  claimPending = false;
+  routeOpen = true;
+  deliver(time);
+}
+
+void QuantumChannel::notifyDestCanAcceptTokens(ticks_t time, unsigned tokens)
+{
+  deliver(time);
+}
+
+void QuantumChannel::exchange(ticks_t time)
+{
+  pending.insert(pending.end(), outgoing.begin(), outgoing.end());
+  outgoing.clear();
+  deliver(time);
+  inFlight = pending.size();
+  if (sourceWaiting && inFlight < QUANTUM_CHANNEL_BUFFER_SIZE) {
+    sourceWaiting = false;
+    if (ChanEndpoint *source = getSource()) {
+      source->notifyDestCanAcceptTokens(time,
+                                        QUANTUM_CHANNEL_BUFFER_SIZE - inFlight);
+    }
+  }
+}
@@ -0,0 +1,87 @@
+// Copyright (c) 2012, Richard Osborne, All rights reserved
+// This software is freely distributable under a derivative of the
+// University of Illinois/NCSA Open Source License posted in
+// LICENSE.txt and at <http://github.xcore.com/>
+
+#ifndef _QuantumChannel_h_
+#define _QuantumChannel_h_
+
+#include <deque>
+#include <vector>
+#include "ChanEndpoint.h"
+#include "Config.h"
+#include "Token.h"
+
+/// Decouples a route between two scheduling contexts in parallel quantum
+/// mode. Sources in the sending context see an endpoint with a large buffer.
+/// Tokens sent during a quantum are handed over to the receiving side at the
+/// next quantum boundary where they are replayed into the real destination,
+/// with the usual claim and flow control, from the receiving context.
+///
+/// The sending side (claim(), receive*() and canAcceptToken*()) is only used
+/// by the sending context and the receiving side (notify*()) is only used by
+/// the receiving context. Both sides are only touched together in
+/// exchange() which must be called while no contexts are running.
+class QuantumChannel : public ChanEndpoint {
+private:
+  struct TimedToken {
+    Token token;
+    ticks_t time;
+    TimedToken(Token t, ticks_t tm) : token(t), time(tm) {}
+  };
+  ChanEndpoint &dest;
+
+  // Sending side.
+  std::vector<TimedToken> outgoing;
+  /// Number of tokens handed over but not yet delivered, as of the last
+  /// exchange.
+  unsigned inFlight;
+  /// Is a source waiting for room in the buffer?
+  bool sourceWaiting;
+
+  // Receiving side.
+  std::deque<TimedToken> pending;
+  /// Has the route to the destination been opened?
+  bool routeOpen;
+  /// Are we waiting for notifyDestClaimed()?
+  bool claimPending;
+  /// Should the current packet be junked?
+  bool junkPacket;
+
+  // Statistics, updated on the receiving side.
+  uint64_t tokensDelivered;
+  uint64_t totalDelay;
+  ticks_t maxDelay;
+
+  void receiveToken(ticks_t time, Token token);
+  /// Deliver as many pending tokens as possible to the destination.
+  void deliver(ticks_t time);
+public:
+  QuantumChannel(ChanEndpoint &d);
+
+  /// Hand over tokens sent in the last quantum and deliver them. Senders
+  /// that were blocked are woken if there is now room.
+  /// \param time The time of the quantum boundary.
+  void exchange(ticks_t time);
+
+  /// Returns whether there are tokens that haven't been delivered yet.
+  bool hasUndeliveredTokens() const {
+    return !outgoing.empty() || !pending.empty();
+  }
+
+  uint64_t getTokensDelivered() const { return tokensDelivered; }
+  /// Returns the sum of the delays between each token being sent and it
+  /// being delivered.
+  uint64_t getTotalDelay() const { return totalDelay; }
+  ticks_t getMaxDelay() const { return maxDelay; }
+
+  void notifyDestClaimed(ticks_t time);
+  void notifyDestCanAcceptTokens(ticks_t time, unsigned tokens);
+  bool canAcceptToken();
+  bool canAcceptTokens(unsigned tokens);
+  void receiveDataToken(ticks_t time, uint8_t value);
+  void receiveDataTokens(ticks_t time, uint8_t *values, unsigned num);
+  void receiveCtrlToken(ticks_t time, uint8_t value);
+};
+
+#endif // _QuantumChannel_h_
@@ -0,0 +1,196 @@
+// Copyright (c) 2012, Richard Osborne, All rights reserved
+// This software is freely distributable under a derivative of the
+// University of Illinois/NCSA Open Source License posted in
+// LICENSE.txt and at <http://github.xcore.com/>
+
+#include "QuantumScheduler.h"
+#include "QuantumChannel.h"
+#include "SchedulingContext.h"
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+#include <iostream>
+#include <iomanip>
+
+QuantumScheduler::QuantumScheduler(ticks_t q) :
+  quantum(q),
+  time(0),
+  numQuanta(0),
+  started(false),
+  generation(0),
+  running(0),
+  shutdown(false)
+{
+}
+
+QuantumScheduler::~QuantumScheduler()
+{
+  if (started) {
+    {
+      ScopedLock lock(mutex);
+      shutdown = true;
+      startQuantum.notifyAll();
+    }
+    for (std::vector<Worker*>::iterator it = workers.begin(),
+         e = workers.end(); it != e; ++it) {
+      (*it)->thread.join();
+    }
+  }
+  for (std::vector<Worker*>::iterator it = workers.begin(), e = workers.end();
+       it != e; ++it) {
+    delete (*it)->context;
+    delete *it;
+  }
+}
+
+SchedulingContext &QuantumScheduler::addContext()
+{
+  assert(!started);
+  Worker *worker = new Worker;
+  worker->parent = this;
+  worker->context = new SchedulingContext;
+  worker->exited = false;
+  worker->status = 0;
+  workers.push_back(worker);
+  return *worker->context;
+}
+
+void QuantumScheduler::workerMain(void *arg)
+{
+  Worker *worker = static_cast<Worker*>(arg);
+  worker->parent->runWorker(*worker);
+}
+
+void QuantumScheduler::runWorker(Worker &worker)
+{
+  unsigned seenGeneration = 0;
+  while (1) {
+    ticks_t limit;
+    {
+      ScopedLock lock(mutex);
+      while (generation == seenGeneration && !shutdown)
+        startQuantum.wait(mutex);
+      if (shutdown)
+        return;
+      seenGeneration = generation;
+      limit = time + quantum;
+    }
+    try {
+      worker.context->runUntil(limit);
+    } catch (ExitException &ee) {
+      worker.exited = true;
+      worker.status = ee.getStatus();
+    }
+    {
+      ScopedLock lock(mutex);
+      if (--running == 0)
+        quantumDone.notifyAll();
+    }
+  }
+}
+
+void QuantumScheduler::startWorkers()
+{
+  if (started)
+    return;
+  for (std::vector<Worker*>::iterator it = workers.begin(), e = workers.end();
+       it != e; ++it) {
+    if (!(*it)->thread.start(&workerMain, *it)) {
+      std::cerr << "Error: failed to create host thread" << std::endl;
+      std::exit(1);
+    }
+  }
+  started = true;
+}
+
+void QuantumScheduler::runQuantum()
+{
+  ScopedLock lock(mutex);
+  running = workers.size();
+  ++generation;
+  startQuantum.notifyAll();
+  while (running != 0)
+    quantumDone.wait(mutex);
+}
+
+void QuantumScheduler::exchangeTokens()
+{
+  for (std::vector<Worker*>::iterator it = workers.begin(), e = workers.end();
+       it != e; ++it) {
+    SchedulingContext &context = *(*it)->context;
+    for (SchedulingContext::channel_iterator channelIt = context.channel_begin(),
+         channelEnd = context.channel_end(); channelIt != channelEnd;
+         ++channelIt) {
+      (*channelIt)->exchange(time);
+    }
+  }
+}
+
+bool QuantumScheduler::getEarliestWakeUpTime(ticks_t &earliest)
+{
+  bool found = false;
+  for (std::vector<Worker*>::iterator it = workers.begin(), e = workers.end();
+       it != e; ++it) {
+    RunnableQueue &queue = (*it)->context->getQueue();
+    if (queue.empty())
+      continue;
+    ticks_t wakeUpTime = queue.front().wakeUpTime;
+    if (!found || wakeUpTime < earliest)
+      earliest = wakeUpTime;
+    found = true;
+  }
+  return found;
+}
+
+void QuantumScheduler::run()
+{
+  startWorkers();
+  ticks_t earliest = 0;
+  while (getEarliestWakeUpTime(earliest)) {
+    // Skip quanta in which nothing would run.
+    if (earliest >= time + quantum)
+      time = earliest - earliest % quantum;
+    runQuantum();
+    time += quantum;
+    ++numQuanta;
+    exchangeTokens();
+    // If more than one context exited in the same quantum use the status from
+    // the first one.
+    Worker *exitedWorker = 0;
+    for (std::vector<Worker*>::iterator it = workers.begin(),
+         e = workers.end(); it != e; ++it) {
+      if ((*it)->exited && !exitedWorker)
+        exitedWorker = *it;
+      (*it)->exited = false;
+    }
+    if (exitedWorker)
+      throw ExitException(exitedWorker->status);
+  }
+}
+
+void QuantumScheduler::dumpSkew(std::ostream &out)
+{
+  uint64_t tokens = 0;
+  uint64_t totalDelay = 0;
+  ticks_t maxDelay = 0;
+  for (std::vector<Worker*>::iterator it = workers.begin(), e = workers.end();
+       it != e; ++it) {
+    SchedulingContext &context = *(*it)->context;
+    for (SchedulingContext::channel_iterator channelIt = context.channel_begin(),
+         channelEnd = context.channel_end(); channelIt != channelEnd;
+         ++channelIt) {
+      QuantumChannel &channel = **channelIt;
+      tokens += channel.getTokensDelivered();
+      totalDelay += channel.getTotalDelay();
+      maxDelay = std::max(maxDelay, channel.getMaxDelay());
+    }
+  }
+  double meanDelay = tokens ? (double)totalDelay / (double)tokens : 0.0;
+  out << "Parallel quantum (cycles):    " << quantum << std::endl;
+  out << "Quanta executed:              " << numQuanta << std::endl;
+  out << "Tokens sent between cores:    " << tokens << std::endl;
+  out << "Mean token delay (cycles):    "
+    << std::fixed << std::setprecision(1) << meanDelay << std::endl;
+  out << "Max token delay (cycles):     " << maxDelay << std::endl;
+  out.unsetf(std::ios::floatfield);
+}
@@ -0,0 +1,71 @@
+// Copyright (c) 2012, Richard Osborne, All rights reserved
+// This software is freely distributable under a derivative of the
+// University of Illinois/NCSA Open Source License posted in
+// LICENSE.txt and at <http://github.xcore.com/>
+
+#ifndef _QuantumScheduler_h_
+#define _QuantumScheduler_h_
+
+#include <vector>
+#include <iosfwd>
+#include "Config.h"
+#include "HostThread.h"
+
+class SchedulingContext;
+
+/// Runs a number of scheduling contexts in parallel on host threads. Each
+/// context runs for a fixed quantum of simulated cycles, after which all
+/// contexts meet at a barrier where tokens sent between contexts are
+/// delivered. Tokens sent between contexts may therefore be delivered up to
+/// a quantum later than they would be if the contexts were run together.
+class QuantumScheduler {
+  struct Worker {
+    QuantumScheduler *parent;
+    SchedulingContext *context;
+    HostThread thread;
+    /// Did the context exit the simulation in the last quantum?
+    bool exited;
+    unsigned status;
+  };
+  std::vector<Worker*> workers;
+  ticks_t quantum;
+  /// Time of the last quantum boundary.
+  ticks_t time;
+  uint64_t numQuanta;
+  bool started;
+
+  Mutex mutex;
+  /// Signalled when a new quantum should start.
+  ConditionVariable startQuantum;
+  /// Signalled when all workers have finished the quantum.
+  ConditionVariable quantumDone;
+  /// Incremented at the start of each quantum.
+  unsigned generation;
+  /// Number of workers still running the current quantum.
+  unsigned running;
+  bool shutdown;
+
+  static void workerMain(void *arg);
+  void runWorker(Worker &worker);
+  void startWorkers();
+  void runQuantum();
+  void exchangeTokens();
+  /// Returns the earliest wake up time of all runnables, or false if there
+  /// are no runnables in any context.
+  bool getEarliestWakeUpTime(ticks_t &earliest);
+public:
+  QuantumScheduler(ticks_t quantum);
+  ~QuantumScheduler();
+
+  /// Add a new context. This must be called before the first call to run().
+  SchedulingContext &addContext();
+
+  /// Run until a thread exits the simulation, in which case ExitException is
+  /// thrown, or until there are no more runnables.
+  void run();
+
+  /// Print a summary of the timing skew introduced by the quantum.
+  void dumpSkew(std::ostream &out);
+};
+
+#endif // _QuantumScheduler_h_
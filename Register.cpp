@@ -0,0 +1,32 @@
+// Copyright (c) 2012, Richard Osborne, All rights reserved
+// This software is freely distributable under a derivative of the
+// University of Illinois/NCSA Open Source License posted in
+// LICENSE.txt and at <http://github.xcore.com/>
+
+#include "Register.h"
+
+const char *registerNames[] = {
+  "r0",
+  "r1",
+  "r2",
+  "r3",
+  "r4",
+  "r5",
+  "r6",
+  "r7",
+  "r8",
+  "r9",
+  "r10",
+  "r11",
+  "cp",
+  "dp",
+  "sp",
+  "lr",
+  "et",
+  "ed",
+  "kep",
+  "ksp",
+  "spc",
+  "sed",
+  "ssr"
+};
@@ -35,4 +35,13 @@ namespace Register {
   };
 }
 
+extern const char *registerNames[];
+
+inline const char *getRegisterName(unsigned RegNum) {
+  if (RegNum < Register::NUM_REGISTERS) {
+    return registerNames[RegNum];
+  }
+  return "?";
+}
+
 #endif //_Register_h_
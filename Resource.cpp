@@ -6,7 +6,7 @@
 #include "Resource.h"
 #include "Core.h"
 #include "Node.h"
-#include "SystemState.h"
+#include "SchedulingContext.h"
 
 using namespace Register;
 
@@ -94,13 +94,13 @@ bool EventableResource::eventsPermitted() const
 void EventableResource::event(ticks_t time)
 {
   assert(eventsPermitted());
-  SystemState &sys = *owner->getParent().getParent()->getParent();
+  SchedulingContext &context = owner->getParent().getSchedulingContext();
   if (owner->isExecuting()) {
-    sys.setPendingEvent(*this, time, interruptMode);
+    context.setPendingEvent(*this, time, interruptMode);
     return;
   }
   owner->time = time;
-  sys.takeEvent(*owner, *this, interruptMode);
+  context.takeEvent(*owner, *this, interruptMode);
 }
 
 void EventableResource::completeEvent()
@@ -184,6 +184,6 @@ bool EventableResource::checkEvent()
 
 void EventableResource::scheduleUpdate(ticks_t time)
 {
-  getOwner().getParent().getParent()->getParent()->scheduleOther(*this, time);
+  getOwner().getParent().getSchedulingContext().scheduleOther(*this, time);
 }
 
@@ -11,12 +11,16 @@
 
 class Runnable {
 public:
-  Runnable *prev;
-  Runnable *next;
+  enum {
+    NOT_QUEUED = ~0u
+  };
+  /// Position of the runnable in the scheduler's heap, or NOT_QUEUED if the
+  /// runnable isn't in the scheduler.
+  unsigned queueIndex;
   ticks_t wakeUpTime;
 
   virtual void run(ticks_t time) = 0;
-  Runnable() : prev(0), next(0) {}
+  Runnable() : queueIndex(NOT_QUEUED) {}
 };
 
 #endif // _Runnable_h_
@@ -5,27 +5,75 @@
 
 #include "RunnableQueue.h"
 
-void RunnableQueue::push(Runnable &thread, ticks_t time)
+void RunnableQueue::siftUp(unsigned index)
 {
-  if (contains(thread)) {
-    remove(thread);
+  Entry e = heap[index];
+  while (index != 0) {
+    unsigned parent = (index - 1) / 2;
+    if (!before(e, heap[parent]))
+      break;
+    place(heap[parent], index);
+    index = parent;
   }
+  place(e, index);
+}
+
+void RunnableQueue::siftDown(unsigned index)
+{
+  Entry e = heap[index];
+  unsigned size = heap.size();
+  while (1) {
+    unsigned child = 2 * index + 1;
+    if (child >= size)
+      break;
+    if (child + 1 < size && before(heap[child + 1], heap[child]))
+      child++;
+    if (!before(heap[child], e))
+      break;
+    place(heap[child], index);
+    index = child;
+  }
+  place(e, index);
+}
+
+void RunnableQueue::remove(Runnable &thread)
+{
+  assert(contains(thread));
+  unsigned index = thread.queueIndex;
+  thread.queueIndex = Runnable::NOT_QUEUED;
+  Entry last = heap.back();
+  heap.pop_back();
+  if (last.runnable != &thread) {
+    place(last, index);
+    if (index != 0 && before(last, heap[(index - 1) / 2]))
+      siftUp(index);
+    else
+      siftDown(index);
+  }
+  updateDeadline();
+}
+
+void RunnableQueue::push(Runnable &thread, ticks_t time)
+{
+  bool wasQueued = contains(thread);
+  bool later = wasQueued && time >= thread.wakeUpTime;
   thread.wakeUpTime = time;
-  if (!head) {
-    thread.next = 0;
-    head = &thread;
-  } else if (time < head->wakeUpTime) {
-    head->prev = &thread;
-    thread.next = head;
-    head = &thread;
+  // A push always places the runnable after any runnables already in the
+  // queue with the same wake up time.
+  Entry e;
+  e.time = time;
+  e.seq = nextSeq++;
+  e.runnable = &thread;
+  if (!wasQueued) {
+    thread.queueIndex = heap.size();
+    heap.push_back(e);
+    siftUp(thread.queueIndex);
+  } else if (later) {
+    heap[thread.queueIndex] = e;
+    siftDown(thread.queueIndex);
   } else {
-    Runnable *p = head;
-    while (p->next && time >= p->next->wakeUpTime)
-      p = p->next;
-    thread.prev = p;
-    thread.next = p->next;
-    if (p->next)
-      p->next->prev = &thread;
-    p->next = &thread;
+    heap[thread.queueIndex] = e;
+    siftUp(thread.queueIndex);
   }
+  updateDeadline();
 }
@@ -8,50 +8,89 @@
 
 #include "Runnable.h"
 #include <cassert>
+#include <vector>
 
+/// Priority queue of runnables ordered by wake up time. Runnables with the
+/// same wake up time are run in the order in which they were pushed.
+/// Implemented as a binary heap where each runnable records its own position
+/// so it can be removed or rescheduled in O(log n). The sort key is cached in
+/// the heap entry to avoid chasing runnable pointers while sifting.
 class RunnableQueue {
 private:
-  Runnable *head;
+  struct Entry {
+    ticks_t time;
+    /// Push order, used to break ties between equal wake up times.
+    uint64_t seq;
+    Runnable *runnable;
+  };
+  std::vector<Entry> heap;
+  uint64_t nextSeq;
+  /// If non-null this is kept up to date with the wake up time of the front
+  /// of the queue, or the maximum time if the queue is empty.
+  ticks_t *deadline;
+
   bool contains(Runnable &thread) const
   {
-    return thread.prev != 0 || &thread == head;
+    return thread.queueIndex != Runnable::NOT_QUEUED;
+  }
+
+  static bool before(const Entry &a, const Entry &b)
+  {
+    if (a.time != b.time)
+      return a.time < b.time;
+    return a.seq < b.seq;
+  }
+
+  void place(const Entry &e, unsigned index)
+  {
+    heap[index] = e;
+    e.runnable->queueIndex = index;
+  }
+
+  void siftUp(unsigned index);
+  void siftDown(unsigned index);
+
+  void updateDeadline()
+  {
+    if (deadline)
+      *deadline = heap.empty() ? ~(ticks_t)0 : heap.front().time;
   }
 public:
-  RunnableQueue() : head(0) {}
+  RunnableQueue() : nextSeq(0), deadline(0) {}
+
+  /// Set the location to keep up to date with the wake up time of the front
+  /// of the queue. This lets the running thread check if its time slice has
+  /// expired without looking at the queue.
+  void setDeadline(ticks_t *value)
+  {
+    deadline = value;
+    updateDeadline();
+  }
   
   Runnable &front() const
   {
-    return *head;
+    return *heap.front().runnable;
   }
   
   bool empty() const
   {
-    return !head;
+    return heap.empty();
   }
-  
-  void remove(Runnable &thread)
-  {
-    assert(contains(thread));
-    if (&thread == head) {
-      head = thread.next;
-    } else {
-      thread.prev->next = thread.next;
-    }
-    if (thread.next)
-      thread.next->prev = thread.prev;
-    thread.prev = 0;
+
+  unsigned size() const
+  {
+    return heap.size();
   }
   
+  void remove(Runnable &thread);
+  
   // Insert a thread into the queue.
   void push(Runnable &thread, ticks_t time);
   
   void pop()
   {
     assert(!empty());
-    if (head->next) {
-      head->next->prev = 0;
-    }
-    head = head->next;
+    remove(front());
   }
 };
 
@@ -110,7 +110,8 @@ void SSwitch::handleRequest(ticks_t time, const Request &request)
         Tracer::get().SSwitchNack(*parent, destID);
     }
   }
-  ChanEndpoint *dest = parent->getChanendDest(destID);
+  ChanEndpoint *dest =
+    parent->getChanendDest(destID, parent->getSchedulingContext());
   if (!dest)
     return;
   bool junkPacket = false;
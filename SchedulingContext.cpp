@@ -0,0 +1,81 @@
+// Copyright (c) 2011-2012, Richard Osborne, All rights reserved
+// This software is freely distributable under a derivative of the
+// University of Illinois/NCSA Open Source License posted in
+// LICENSE.txt and at <http://github.xcore.com/>
+
+#include "SchedulingContext.h"
+#include "QuantumChannel.h"
+#include "Core.h"
+#include "Trace.h"
+
+using namespace Register;
+
+SchedulingContext::~SchedulingContext()
+{
+  for (channel_iterator it = channels.begin(), e = channels.end(); it != e;
+       ++it) {
+    delete *it;
+  }
+}
+
+void SchedulingContext::
+completeEvent(Thread &t, EventableResource &res, bool interrupt)
+{
+  if (interrupt) {
+    t.regs[SSR] = t.sr.to_ulong();
+    t.regs[SPC] = t.getParent().targetPc(t.pc);
+    t.regs[SED] = t.regs[ED];
+    t.ieble() = false;
+    t.inint() = true;
+    t.ink() = true;
+  } else {
+    t.inenb() = 0;
+  }
+  t.eeble() = false;
+  // EventableResource::completeEvent sets the ED and PC.
+  res.completeEvent();
+  if (Tracer::get().getTracingEnabled()) {
+    if (interrupt) {
+      Tracer::get().interrupt(t, res, t.getParent().targetPc(t.pc),
+                                      t.regs[SSR], t.regs[SPC], t.regs[SED],
+                                      t.regs[ED]);
+    } else {
+      Tracer::get().event(t, res, t.getParent().targetPc(t.pc), t.regs[ED]);
+    }
+  }
+}
+
+void SchedulingContext::run()
+{
+  stopped = false;
+  while (!stopped && !queue.empty()) {
+    Runnable &runnable = queue.front();
+    currentRunnable = &runnable;
+    queue.pop();
+    runnable.run(runnable.wakeUpTime);
+  }
+  currentRunnable = 0;
+}
+
+void SchedulingContext::runUntil(ticks_t time)
+{
+  queue.push(quantumEnd, time);
+  try {
+    run();
+  } catch (...) {
+    // Don't leave the marker behind if a runnable exits the simulation.
+    if (quantumEnd.queueIndex != Runnable::NOT_QUEUED)
+      queue.remove(quantumEnd);
+    throw;
+  }
+}
+
+ChanEndpoint *SchedulingContext::getQuantumChannel(ChanEndpoint &dest)
+{
+  QuantumChannel *&channel = channelMap[&dest];
+  if (!channel) {
+    channel = new QuantumChannel(dest);
+    channels.push_back(channel);
+  }
+  return channel;
+}
@@ -0,0 +1,127 @@
+// Copyright (c) 2011-2012, Richard Osborne, All rights reserved
+// This software is freely distributable under a derivative of the
+// University of Illinois/NCSA Open Source License posted in
+// LICENSE.txt and at <http://github.xcore.com/>
+
+#ifndef _SchedulingContext_h_
+#define _SchedulingContext_h_
+
+#include <algorithm>
+#include <map>
+#include <vector>
+#include "Thread.h"
+#include "RunnableQueue.h"
+
+class ChanEndpoint;
+class QuantumChannel;
+
+/// The state needed to schedule and run a set of cores. Normally all cores
+/// share a single context. In parallel quantum mode each core has its own
+/// context which is run on a separate host thread.
+class SchedulingContext {
+  class QuantumEnd : public Runnable {
+    SchedulingContext &parent;
+  public:
+    QuantumEnd(SchedulingContext &p) : parent(p) {}
+    void run(ticks_t time) { parent.stop(); }
+  };
+
+  RunnableQueue queue;
+  /// The currently executing runnable.
+  Runnable *currentRunnable;
+  PendingEvent pendingEvent;
+  /// Set to stop run() after the current runnable returns.
+  bool stopped;
+  QuantumEnd quantumEnd;
+  /// Channels buffering tokens sent to endpoints in other contexts, in the
+  /// order they were created.
+  std::vector<QuantumChannel*> channels;
+  /// Map from destination to the channel for that destination.
+  std::map<ChanEndpoint*, QuantumChannel*> channelMap;
+
+  void completeEvent(Thread &t, EventableResource &res, bool interrupt);
+
+public:
+  typedef std::vector<QuantumChannel*>::iterator channel_iterator;
+
+  SchedulingContext() : currentRunnable(0), stopped(false), quantumEnd(*this) {
+    pendingEvent.set = false;
+  }
+  ~SchedulingContext();
+
+  RunnableQueue &getQueue() { return queue; }
+
+  Runnable *getExecutingRunnable() {
+    return currentRunnable;
+  }
+
+  /// Run runnables in time order until there are none left or stop() is
+  /// called.
+  void run();
+
+  /// Run runnables with a wake up time no later than the specified time.
+  void runUntil(ticks_t time);
+
+  /// Make run() return once the current runnable returns.
+  void stop() { stopped = true; }
+
+  /// Schedule a thread.
+  void schedule(Thread &thread) {
+    thread.waiting() = false;
+    thread.pausedOn = 0;
+    queue.push(thread, thread.time);
+  }
+
+  void scheduleOther(Runnable &runnable, ticks_t time) {
+    queue.push(runnable, time);
+  }
+
+  /// Take an event on a thread. The thread must not be the current thread.
+  void takeEvent(Thread &thread, EventableResource &res, bool interrupt)
+  {
+    if (thread.waiting()) {
+      if (thread.pausedOn) {
+        thread.pausedOn->cancel();
+      }
+      schedule(thread);
+    }
+    completeEvent(thread, res, interrupt);
+  }
+
+  /// Take an event on the current thread.
+  /// \param CycleThread Whether to cycle the running thread after the
+  ///        event is taken.
+  /// \return The new time and pc.
+  void takeEvent(Thread &current)
+  {
+    current.time = std::max(current.time, pendingEvent.time);
+    // TODO this is probably the wrong place for this.
+    current.waiting() = false;
+    completeEvent(current, *pendingEvent.res, pendingEvent.interrupt);
+    pendingEvent.set = false;
+  }
+
+  /// Sets a pending event on the current thread.
+  void setPendingEvent(EventableResource &res, ticks_t time, bool interrupt)
+  {
+    if (pendingEvent.set && pendingEvent.time <= time)
+      return;
+    pendingEvent.set = true;
+    pendingEvent.res = &res;
+    pendingEvent.interrupt = interrupt;
+    pendingEvent.time = time;
+  }
+
+  bool hasPendingEvent() const {
+    return pendingEvent.set;
+  }
+
+  /// Returns an endpoint that buffers tokens sent from this context to an
+  /// endpoint in another context until the next quantum boundary.
+  ChanEndpoint *getQuantumChannel(ChanEndpoint &dest);
+
+  channel_iterator channel_begin() { return channels.begin(); }
+  channel_iterator channel_end() { return channels.end(); }
+};
+
+#endif // _SchedulingContext_h_
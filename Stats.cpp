@@ -12,48 +12,127 @@
 #include "Exceptions.h"
 #include <iomanip>
 #include <sstream>
+#include <fstream>
+#include <vector>
+#include <algorithm>
 #include <cstring>
 
 
 Stats Stats::instance;
 
-void Stats::updateStats(const Thread &t, const char *name) {
-  std::string s(name);
-  int cid = t.getParent().getCoreID(),
-    tid = t.getID().num();
-  std::map<std::string, long long*>::iterator iter = istats.find(s);
-  if (iter == istats.end())
-  {
-    long long *x = new long long[cores * NUM_THREADS]();
-    istats.insert(std::pair<std::string, long long*>(name,x));
-    iter = istats.find(s);
+static const char *instructionNames[] = {
+#define EMIT_INSTRUCTION_LIST
+#define DO_INSTRUCTION(inst) #inst,
+#include "InstructionGenOutput.inc"
+#undef DO_INSTRUCTION
+#undef EMIT_INSTRUCTION_LIST
+};
+
+static const unsigned numOpcodes = ARRAY_SIZE(instructionNames);
+
+void Stats::
+updateSequences(const Thread &t, InstructionOpcode opc, uint32_t nextPc) {
+  const char *name = instructionNames[opc];
+  InstructionHistory &h = history[&t];
+  if (h.length == 0 || h.nextPc != t.pc) {
+    h.length = 0;
+  } else {
+    std::string sequence = std::string(h.names[0]) + ' ' + name;
+    sequences[sequence]++;
+    if (h.length == 2)
+      sequences[std::string(h.names[1]) + ' ' + sequence]++;
+  }
+  h.names[1] = h.names[0];
+  h.names[0] = name;
+  if (h.length < 2)
+    h.length++;
+  h.nextPc = nextPc;
+}
+
+static bool
+compareSequenceCounts(const std::pair<std::string, long long> &a,
+                      const std::pair<std::string, long long> &b)
+{
+  if (a.second != b.second)
+    return a.second > b.second;
+  return a.first < b.first;
+}
+
+void Stats::dumpPairProfile() {
+  std::ofstream out(pairProfileFile.c_str());
+  if (!out) {
+    std::cerr << "Error: cannot open " << pairProfileFile << std::endl;
+    return;
+  }
+  std::vector<std::pair<std::string, long long> >
+    sorted(sequences.begin(), sequences.end());
+  std::sort(sorted.begin(), sorted.end(), compareSequenceCounts);
+  for (std::vector<std::pair<std::string, long long> >::iterator
+       it = sorted.begin(), e = sorted.end(); it != e; ++it) {
+    out << it->first << " # " << it->second << '\n';
   }
-  long long *ts = iter->second;
-  ts[(NUM_THREADS * cid) + tid] += 1;
-  return;
 }
 
 void Stats::dump() {
+  if (!pairProfileFile.empty())
+    dumpPairProfile();
+  if (!xsimStatsEnabled)
+    return;
   //TODO: Get the chip rev. Hard coded for xsim compatibility for now...
   std::cout <<
 "InstructionCount:\n"
 "-----------------\n";
-  long long *counts;
-  int threads = cores * NUM_THREADS;
-  for (std::map<std::string, long long*>::iterator iter = istats.begin();
-    iter != istats.end(); iter++)
-  {
-    std::cout << "xs1b_" << iter->first << " -";
-    counts = iter->second;
-    for (int t = 0; t < threads; t += 1)
+  // List the instructions executed in order of name.
+  const unsigned numRows = rowColumns.size();
+  std::vector<std::pair<std::string, unsigned> > executed;
+  for (unsigned opc = 0; opc != numOpcodes; ++opc) {
+    for (unsigned row = 0; row != numRows; ++row) {
+      if (counts[row * numOpcodes + opc] != 0) {
+        executed.push_back(std::make_pair(instructionNames[opc], opc));
+        break;
+      }
+    }
+  }
+  std::sort(executed.begin(), executed.end());
+  std::vector<long long> columnCounts(numColumns);
+  for (std::vector<std::pair<std::string, unsigned> >::iterator
+       it = executed.begin(), e = executed.end(); it != e; ++it) {
+    std::fill(columnCounts.begin(), columnCounts.end(), 0);
+    for (unsigned row = 0; row != numRows; ++row) {
+      if (rowColumns[row] < numColumns)
+        columnCounts[rowColumns[row]] += counts[row * numOpcodes + it->second];
+    }
+    std::cout << "xs1b_" << it->first << " -";
+    for (unsigned column = 0; column != numColumns; ++column)
     {
-      std::cout << " " << counts[t];
+      std::cout << " " << columnCounts[column];
     }
     std::cout << "\n";
   }
   return;
 }
 
-void Stats::initStats(const int cores) {
-  Stats::cores = cores;
+void Stats::initStats(SystemState &sys) {
+  // The report has a column for each thread of the first node_count() core
+  // IDs.
+  numColumns = sys.node_count() * NUM_THREADS;
+  std::vector<Thread*> threads;
+  rowColumns.clear();
+  for (SystemState::node_iterator outerIt = sys.node_begin(),
+       outerE = sys.node_end(); outerIt != outerE; ++outerIt) {
+    Node &node = **outerIt;
+    for (Node::core_iterator innerIt = node.core_begin(),
+         innerE = node.core_end(); innerIt != innerE; ++innerIt) {
+      Core &core = **innerIt;
+      for (unsigned i = 0; i != NUM_THREADS; ++i) {
+        Thread &thread = core.getThread(i);
+        threads.push_back(&thread);
+        rowColumns.push_back(core.getCoreID() * NUM_THREADS + i);
+      }
+    }
+  }
+  counts.assign(threads.size() * numOpcodes, 0);
+  for (unsigned row = 0, e = threads.size(); row != e; ++row) {
+    threads[row]->instructionCounts = &counts[row * numOpcodes];
+  }
 }
@@ -8,26 +8,71 @@
 
 #include "TerminalColours.h"
 #include "Thread.h"
+#include "Instruction.h"
 #include <iostream>
 #include <sstream>
 #include <string>
 #include <memory>
 #include <map>
+#include <vector>
+
+class SystemState;
 
 class Stats {
 private:
   Stats() :
-    statsEnabled(false) {}
+    statsEnabled(false), xsimStatsEnabled(false) {}
   public:
+  /// Whether updateStats() is called for each instruction interpreted.
   bool statsEnabled;
+  bool xsimStatsEnabled;
   static Stats instance;
-  int cores;
-  std::map<std::string, long long*> istats;
+  /// Number of columns in the instruction count report.
+  unsigned numColumns;
+  /// The instruction counts of every thread in the system. Each thread
+  /// counts into its own row of one counter per opcode.
+  std::vector<long long> counts;
+  /// The report column of each row of counts.
+  std::vector<unsigned> rowColumns;
+  /// The last instructions executed by a thread.
+  struct InstructionHistory {
+    InstructionHistory() : length(0), nextPc(0) {}
+    /// Number of valid entries in names.
+    unsigned length;
+    const char *names[2];
+    /// The pc after the most recent instruction if it doesn't branch.
+    uint32_t nextPc;
+  };
+  std::string pairProfileFile;
+  std::map<const Thread*, InstructionHistory> history;
+  /// Number of times each sequence of two or three instructions was executed.
+  std::map<std::string, long long> sequences;
+  void updateSequences(const Thread &t, InstructionOpcode opc,
+                       uint32_t nextPc);
+  void dumpPairProfile();
 public:
-  void setStatsEnabled(bool enable) { statsEnabled = enable; }
+  void setStatsEnabled(bool enable) {
+    xsimStatsEnabled = enable;
+    statsEnabled = xsimStatsEnabled || !pairProfileFile.empty();
+  }
+  /// Write a histogram of adjacent instructions executed by the interpreter
+  /// to the specified file. The file can be used as input to instgen to
+  /// generate superinstructions.
+  void setPairProfileFile(const std::string &file) {
+    pairProfileFile = file;
+    statsEnabled = xsimStatsEnabled || !pairProfileFile.empty();
+  }
   bool getStatsEnabled() const { return statsEnabled; }
-  void initStats(const int cores);
-  void updateStats(const Thread &t, const char *name);
+  /// Whether the number of times each instruction is executed is counted.
+  bool getInstructionCountsEnabled() const { return xsimStatsEnabled; }
+  /// Allocate the instruction counts of each thread in the system.
+  void initStats(SystemState &sys);
+  void updateStats(const Thread &t, InstructionOpcode opc, uint32_t nextPc) {
+    if (xsimStatsEnabled)
+      ++t.instructionCounts[opc];
+    if (!pairProfileFile.empty())
+      updateSequences(t, opc, nextPc);
+  }
   void dump();
   static Stats &get()
   {
@@ -47,6 +47,19 @@ const ElfSymbol *CoreSymbolInfo::getDataSymbol(uint32_t address) const
   return getSymbol(dataSymbols, address);
 }
 
+void CoreSymbolInfo::
+getFunctionAddresses(uint32_t low, uint32_t high,
+                     std::vector<uint32_t> &addresses) const
+{
+  // The map is sorted in descending order of address.
+  for (SymbolAddressMap::const_reverse_iterator
+       it = SymbolAddressMap::const_reverse_iterator(
+         functionSymbols.upper_bound(low)),
+       e = functionSymbols.rend(); it != e && it->first < high; ++it) {
+    addresses.push_back(it->first);
+  }
+}
+
 void CoreSymbolInfoBuilder::
 addSymbol(const char *name, uint32_t value, unsigned char info)
 {
@@ -97,6 +110,7 @@ void SymbolInfo::add(const Core *core, std::auto_ptr<CoreSymbolInfo> info)
     delete entry;
   }
   entry = info.release();
+  ++generation;
 }
 
 CoreSymbolInfo *SymbolInfo::getCoreSymbolInfo(const Core *core) const
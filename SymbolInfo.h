@@ -34,9 +34,17 @@ private:
   static const ElfSymbol *getSymbol(const SymbolAddressMap &symbols,
                                     uint32_t address);
 public:
+  typedef std::vector<ElfSymbol>::const_iterator symbol_iterator;
+  /// Iterate over the symbols in the order they were added to the builder.
+  symbol_iterator symbol_begin() const { return symbols.begin(); }
+  symbol_iterator symbol_end() const { return symbols.end(); }
   const ElfSymbol *getGlobalSymbol(const std::string &name) const;
   const ElfSymbol *getFunctionSymbol(uint32_t address) const;
   const ElfSymbol *getDataSymbol(uint32_t address) const;
+  /// Append the addresses of the function symbols in the range [low, high)
+  /// to the vector in ascending order.
+  void getFunctionAddresses(uint32_t low, uint32_t high,
+                            std::vector<uint32_t> &addresses) const;
 };
 
 class CoreSymbolInfoBuilder {
@@ -52,13 +60,20 @@ class Core;
 class SymbolInfo {
 private:
   std::map<const Core*,CoreSymbolInfo*> coreMap;
+  unsigned generation;
   CoreSymbolInfo *getCoreSymbolInfo(const Core *core) const;
   SymbolInfo(const SymbolInfo &); // Not implemented.
   void operator=(const SymbolInfo &); // Not implemented.
 public:
-  SymbolInfo() {}
+  typedef std::map<const Core*,CoreSymbolInfo*>::const_iterator iterator;
+  SymbolInfo() : generation(0) {}
   ~SymbolInfo();
   void add(const Core *core, std::auto_ptr<CoreSymbolInfo> info);
+  iterator begin() const { return coreMap.begin(); }
+  iterator end() const { return coreMap.end(); }
+  /// Returns a number which changes whenever the symbols of a core are added
+  /// or replaced.
+  unsigned getGeneration() const { return generation; }
   const ElfSymbol *getGlobalSymbol(const Core *core,
                                    const std::string &name) const;
   const ElfSymbol *getFunctionSymbol(const Core *core,
@@ -15,6 +15,7 @@
 #include <fcntl.h>
 #include <stdint.h>
 #include "ScopedArray.h"
+#include "HostThread.h"
 #include "Trace.h"
 
 #ifndef _MSC_VER
@@ -39,6 +40,12 @@ private:
   const scoped_array<int> fds;
   bool tracing;
   unsigned doneSyscallsRequired;
+  /// Serialises syscalls from cores running on different host threads with
+  /// --parallel-quantum. Every syscall takes it, not just those touching
+  /// shared state, since cores finishing in the same quantum make OSCALL_DONE
+  /// at the same time and a lost decrement of doneSyscallsRequired would
+  /// stop the simulation exiting.
+  Mutex mutex;
   char *getString(Thread &thread, uint32_t address);
   void *getBuffer(Thread &thread, uint32_t address, uint32_t size);
   int getNewFd();
@@ -54,6 +61,7 @@ public:
   void setDoneSyscallsRequired(unsigned count) { doneSyscallsRequired = count; }
   SyscallHandler::SycallOutcome doSyscall(Thread &thread, int &retval);
   void doException(const Thread &thread);
+  Mutex &getMutex() { return mutex; }
 
   static SyscallHandlerImpl instance;
 };
@@ -324,6 +332,9 @@ doSyscall(Thread &thread, int &retval)
         thread.regs[R0] = (uint32_t)-1;
         return SyscallHandler::CONTINUE;
       }
+      // The host writes the buffer directly so writes to code aren't seen
+      // by the core.
+      thread.getParent().invalidateRange(thread.regs[R2], thread.regs[R3]);
       thread.regs[R0] = read(fds[thread.regs[R1]], buf, thread.regs[R3]);
       return SyscallHandler::CONTINUE;
     }
@@ -340,6 +351,8 @@ doSyscall(Thread &thread, int &retval)
         thread.regs[R0] = (uint32_t)-1;
         return SyscallHandler::CONTINUE;
       }
+      // Keep the output of the program in order with the trace.
+      Tracer::get().flush();
       thread.regs[R0] = write(fds[thread.regs[R1]], buf, thread.regs[R3]);
       return SyscallHandler::CONTINUE;
     }
@@ -384,8 +397,10 @@ doSyscall(Thread &thread, int &retval)
           thread.regs[R0] = (uint32_t)-1;
           return SyscallHandler::CONTINUE;
         }
+        // Invalidate first so the store doesn't fault if the page is write
+        // protected.
+        core.invalidateRange(TimeAddr, 4);
         core.storeWord(Time, TimeAddr);
-        core.invalidateWord(TimeAddr);
       }
       thread.regs[R0] = Time;
       return SyscallHandler::CONTINUE;
@@ -431,16 +446,19 @@ SyscallHandlerImpl SyscallHandlerImpl::instance;
 
 void SyscallHandler::setDoneSyscallsRequired(unsigned number)
 {
+  ScopedLock lock(SyscallHandlerImpl::instance.getMutex());
   SyscallHandlerImpl::instance.setDoneSyscallsRequired(number);
 }
 
 SyscallHandler::SycallOutcome SyscallHandler::
 doSyscall(Thread &thread, int &retval)
 {
+  ScopedLock lock(SyscallHandlerImpl::instance.getMutex());
   return SyscallHandlerImpl::instance.doSyscall(thread, retval);
 }
 
 void SyscallHandler::doException(const Thread &thread)
 {
+  ScopedLock lock(SyscallHandlerImpl::instance.getMutex());
   return SyscallHandlerImpl::instance.doException(thread);
 }
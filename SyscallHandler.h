@@ -14,6 +14,8 @@ public:
     EXIT
   };
   static void setDoneSyscallsRequired(unsigned number);
+  /// Handle a syscall. Calls from cores running on different host threads
+  /// are serialised.
   static SycallOutcome doSyscall(Thread &thread, int &retval);
   static void doException(const Thread &thread);
 };
@@ -4,16 +4,26 @@
 // LICENSE.txt and at <http://github.xcore.com/>
 
 #include <iomanip>
+#include <fstream>
 #include "SystemState.h"
 #include "Node.h"
 #include "Core.h"
 #include "Trace.h"
 #include "Stats.h"
+#include "JIT.h"
+#include "HostThread.h"
 
 using namespace Register;
 
+SystemState::SystemState() : stats(false), hostTime(0)
+{
+}
+
 SystemState::~SystemState()
 {
+  // The JIT's worker thread may still be compiling code for the cores.
+  JIT::stopBackgroundCompilation();
+  JIT::writeCache();
   for (node_iterator it = nodes.begin(), e = nodes.end(); it != e; ++it) {
     delete *it;
   }
@@ -21,8 +31,27 @@ SystemState::~SystemState()
 
 void SystemState::finalize()
 {
-  for (node_iterator it = nodes.begin(), e = nodes.end(); it != e; ++it) {
-    (*it)->finalize();
+  for (node_iterator outerIt = nodes.begin(), outerEnd = nodes.end();
+       outerIt != outerEnd; ++outerIt) {
+    Node &node = **outerIt;
+    for (Node::core_iterator innerIt = node.core_begin(),
+         innerEnd = node.core_end(); innerIt != innerEnd; ++innerIt) {
+      (*innerIt)->setSchedulingContext(scheduler);
+    }
+    node.finalize();
+  }
+}
+
+void SystemState::setParallelQuantum(ticks_t quantum)
+{
+  quantumScheduler.reset(new QuantumScheduler(quantum));
+  for (node_iterator outerIt = nodes.begin(), outerEnd = nodes.end();
+       outerIt != outerEnd; ++outerIt) {
+    Node &node = **outerIt;
+    for (Node::core_iterator innerIt = node.core_begin(),
+         innerEnd = node.core_end(); innerIt != innerEnd; ++innerIt) {
+      (*innerIt)->setSchedulingContext(quantumScheduler->addContext());
+    }
   }
 }
 
@@ -33,59 +62,80 @@ void SystemState::addNode(std::auto_ptr<Node> n)
   n.release();
 }
 
-void SystemState::
-completeEvent(Thread &t, EventableResource &res, bool interrupt)
-{
-  if (interrupt) {
-    t.regs[SSR] = t.sr.to_ulong();
-    t.regs[SPC] = t.getParent().targetPc(t.pc);
-    t.regs[SED] = t.regs[ED];
-    t.ieble() = false;
-    t.inint() = true;
-    t.ink() = true;
-  } else {
-    t.inenb() = 0;
-  }
-  t.eeble() = false;
-  // EventableResource::completeEvent sets the ED and PC.
-  res.completeEvent();
-  if (Tracer::get().getTracingEnabled()) {
-    if (interrupt) {
-      Tracer::get().interrupt(t, res, t.getParent().targetPc(t.pc),
-                                      t.regs[SSR], t.regs[SPC], t.regs[SED],
-                                      t.regs[ED]);
-    } else {
-      Tracer::get().event(t, res, t.getParent().targetPc(t.pc), t.regs[ED]);
-    }
-  }
-}
-
 int SystemState::run()
 {
+  double startTime = getHostTime();
+  if (profiler.get()) {
+    profiler->start();
+  }
   try {
-    while (!scheduler.empty()) {
-      Runnable &runnable = scheduler.front();
-      currentRunnable = &runnable;
-      scheduler.pop();
-      runnable.run(runnable.wakeUpTime);
+    if (quantumScheduler.get()) {
+      quantumScheduler->run();
+    } else {
+      scheduler.run();
     }
   } catch (ExitException &ee) {
+    hostTime += getHostTime() - startTime;
+    Tracer::get().flush();
     if (stats) {
       dump();
     }
+    if (!statsJSONFile.empty()) {
+      writeStatsJSON();
+    }
+    if (profiler.get()) {
+      profiler->write();
+    }
+    if (quantumScheduler.get()) {
+      quantumScheduler->dumpSkew(std::cerr);
+    }
     if (Stats::get().getStatsEnabled())
     {
       Stats::get().dump();
     }
     return ee.getStatus();
   }
+  hostTime += getHostTime() - startTime;
   Tracer::get().noRunnableThreads(*this);
+  Tracer::get().flush();
+  if (profiler.get()) {
+    profiler->write();
+  }
+  if (quantumScheduler.get()) {
+    quantumScheduler->dumpSkew(std::cerr);
+  }
   return 1;
 }
 
+/// Simulated time in seconds of the specified number of ticks. The reference
+/// clock runs at 100MHz.
+static double getSimulatedSeconds(ticks_t ticks)
+{
+  return (double) ticks / 100000000.0;
+}
+
+void SystemState::
+getTotals(uint64_t &instructions, uint64_t &jitInstructions, ticks_t &maxTime)
+{
+  instructions = 0;
+  jitInstructions = 0;
+  maxTime = 0;
+  for (node_iterator nIt=node_begin(), nEnd=node_end(); nIt!=nEnd; ++nIt) {
+    Node &node = **nIt;
+    for (Node::core_iterator cIt=node.core_begin(), cEnd=node.core_end();
+        cIt!=cEnd; ++cIt) {
+      Core &core = **cIt;
+      for (int i=0; i<NUM_THREADS; i++) {
+        Thread &thread = core.getThread(i);
+        instructions += thread.getInstructionCount();
+        jitInstructions += thread.jitCount;
+        maxTime = maxTime > thread.time ? maxTime : thread.time;
+      }
+    }
+  }
+}
+
 void SystemState::dump() {
-  long totalCount = 0;
-  ticks_t maxTime = 0;
   for (node_iterator nIt=node_begin(), nEnd=node_end(); nIt!=nEnd; ++nIt) {
     Node &node = **nIt;
     for (Node::core_iterator cIt=node.core_begin(), cEnd=node.core_end(); 
@@ -99,29 +149,120 @@ void SystemState::dump() {
         << std::setw(12) << "Insts/cycle" << std::endl;
       for (int i=0; i<NUM_THREADS; i++) {
         Thread &thread = core.getThread(i);
-        totalCount += thread.count;
-        maxTime = maxTime > thread.time ? maxTime : thread.time;
-        double ratio = (double) thread.count / (double) thread.time;
+        uint64_t count = thread.getInstructionCount();
+        double ratio = (double) count / (double) thread.time;
         std::cout 
           << std::setw(8) << i << " " 
           << std::setw(12) << thread.time << " "
-          << std::setw(12) << thread.count << " " 
+          << std::setw(12) << count << " " 
           << std::setw(12) << std::setprecision(2) << ratio << std::endl;
       }
     }
   }
-  // Assume 10ns cycle (400Mhz clock)
-  double seconds = (double) maxTime / 100000000.0;
-  double opsPerSec = (double) totalCount / seconds;
-  double gOpsPerSec = opsPerSec / 1000000.0;
+  uint64_t totalCount;
+  uint64_t jitCount;
+  ticks_t maxTime;
+  getTotals(totalCount, jitCount, maxTime);
+  double seconds = getSimulatedSeconds(maxTime);
+  double jitPercent = totalCount ? 100.0 * jitCount / totalCount : 0.0;
   std::cout << std::endl;
   std::cout << "Total instructions executed:  " << totalCount << std::endl;
+  std::cout << "  Interpreted:                " << (totalCount - jitCount)
+    << " (" << std::fixed << std::setprecision(1) << (100.0 - jitPercent)
+    << "%)" << std::endl;
+  std::cout << "  JIT compiled:               " << jitCount
+    << " (" << jitPercent << "%)" << std::endl;
   std::cout << "Total cycles:                 " << maxTime << std::endl;
-  std::cout << "Elapsed time (s):             " 
-    << std::setprecision(2) << seconds << std::endl;
-  std::cout << "Instructions per second:      "
-    << std::setprecision(2) << opsPerSec
-    << " (" << std::setprecision(2) << gOpsPerSec << " GIPS)" << std::endl;
+  std::cout << "Simulated time (s):           "
+    << std::setprecision(6) << seconds << std::endl;
+  std::cout << "Host time (s):                "
+    << std::setprecision(3) << hostTime << std::endl;
+  if (hostTime > 0) {
+    std::cout << "Host MIPS:                    "
+      << std::setprecision(2) << totalCount / hostTime / 1000000.0
+      << std::endl;
+    std::cout << "Simulated/host time ratio:    "
+      << std::setprecision(6) << seconds / hostTime << std::endl;
+  }
+  std::cout.unsetf(std::ios::floatfield);
   std::cout << std::endl;
+  JIT::dumpStats(std::cout);
+  std::cout << std::endl;
+}
+
+static void writeJSONString(std::ostream &out, const std::string &s)
+{
+  out << '"';
+  for (std::string::const_iterator it = s.begin(), e = s.end(); it != e;
+       ++it) {
+    unsigned char c = *it;
+    if (c == '"' || c == '\\') {
+      out << '\\' << c;
+    } else if (c < 0x20) {
+      out << "\\u" << std::hex << std::setw(4) << std::setfill('0')
+          << unsigned(c) << std::dec << std::setfill(' ');
+    } else {
+      out << c;
+    }
+  }
+  out << '"';
+}
+
+void SystemState::dumpJSON(std::ostream &out) {
+  uint64_t totalCount;
+  uint64_t jitCount;
+  ticks_t maxTime;
+  getTotals(totalCount, jitCount, maxTime);
+  double seconds = getSimulatedSeconds(maxTime);
+  out << std::setprecision(9);
+  out << "{\n";
+  out << "  \"instructions\": " << totalCount << ",\n";
+  out << "  \"interpreted_instructions\": " << (totalCount - jitCount)
+      << ",\n";
+  out << "  \"jit_instructions\": " << jitCount << ",\n";
+  out << "  \"cycles\": " << maxTime << ",\n";
+  out << "  \"simulated_seconds\": " << seconds << ",\n";
+  out << "  \"host_seconds\": " << hostTime << ",\n";
+  out << "  \"host_mips\": "
+      << (hostTime > 0 ? totalCount / hostTime / 1000000.0 : 0.0) << ",\n";
+  out << "  \"simulated_to_host_ratio\": "
+      << (hostTime > 0 ? seconds / hostTime : 0.0) << ",\n";
+  out << "  \"cores\": [";
+  bool firstCore = true;
+  for (node_iterator nIt=node_begin(), nEnd=node_end(); nIt!=nEnd; ++nIt) {
+    Node &node = **nIt;
+    for (Node::core_iterator cIt=node.core_begin(), cEnd=node.core_end();
+        cIt!=cEnd; ++cIt) {
+      Core &core = **cIt;
+      out << (firstCore ? "\n" : ",\n");
+      firstCore = false;
+      out << "    {\n";
+      out << "      \"id\": " << core.getCoreID() << ",\n";
+      out << "      \"name\": ";
+      writeJSONString(out, core.getCoreName());
+      out << ",\n";
+      out << "      \"threads\": [\n";
+      for (int i=0; i<NUM_THREADS; i++) {
+        Thread &thread = core.getThread(i);
+        out << "        { \"thread\": " << i
+            << ", \"time\": " << thread.time
+            << ", \"instructions\": " << thread.getInstructionCount()
+            << ", \"jit_instructions\": " << thread.jitCount << " }"
+            << (i + 1 < NUM_THREADS ? ",\n" : "\n");
+      }
+      out << "      ]\n";
+      out << "    }";
+    }
+  }
+  out << "\n  ]\n";
+  out << "}\n";
 }
 
+void SystemState::writeStatsJSON() {
+  std::ofstream out(statsJSONFile.c_str());
+  if (!out) {
+    std::cerr << "Error: cannot open " << statsJSONFile << std::endl;
+    return;
+  }
+  dumpJSON(out);
+}
@@ -8,91 +8,56 @@
 
 #include <vector>
 #include <memory>
+#include <string>
+#include <iosfwd>
 #include "Thread.h"
-#include "RunnableQueue.h"
+#include "SchedulingContext.h"
+#include "QuantumScheduler.h"
+#include "Profiler.h"
 
 class Node;
 class ChanEndpoint;
 
 class SystemState {
   std::vector<Node*> nodes;
-  RunnableQueue scheduler;
-  /// The currently executing runnable.
-  Runnable *currentRunnable;
-  PendingEvent pendingEvent;
+  SchedulingContext scheduler;
+  /// Scheduler used to run cores in parallel, 0 if cores are run together.
+  std::auto_ptr<QuantumScheduler> quantumScheduler;
+  /// Profiler sampling the running threads, 0 if profiling is disabled.
+  std::auto_ptr<Profiler> profiler;
   bool stats;
+  /// File to write execution statistics to as JSON, empty if none.
+  std::string statsJSONFile;
+  /// Host wall-clock time in seconds spent in run().
+  double hostTime;
 
-  void completeEvent(Thread &t, EventableResource &res, bool interrupt);
-
+  void getTotals(uint64_t &instructions, uint64_t &jitInstructions,
+                 ticks_t &maxTime);
+  void writeStatsJSON();
 public:
   typedef std::vector<Node*>::iterator node_iterator;
   typedef std::vector<Node*>::const_iterator const_node_iterator;
-  SystemState() : currentRunnable(0), stats(false) {
-    pendingEvent.set = false;
-  }
+  SystemState();
   ~SystemState();
   void finalize();
-  RunnableQueue &getScheduler() { return scheduler; }
+  RunnableQueue &getScheduler() { return scheduler.getQueue(); }
   void addNode(std::auto_ptr<Node> n);
   void dump();
+  void dumpJSON(std::ostream &out);
   void enableStats() { stats = true; }
+  /// Write execution statistics as JSON to the specified file on exit.
+  void setStatsJSONFile(const std::string &file) { statsJSONFile = file; }
 
-  Runnable *getExecutingRunnable() {
-    return currentRunnable;
-  }
+  /// Run each core on its own host thread, synchronising every quantum
+  /// cycles. Must be called after finalize() and before any threads are
+  /// scheduled.
+  void setParallelQuantum(ticks_t quantum);
 
-  int run();
-  
-  /// Schedule a thread.
-  void schedule(Thread &thread) {
-    thread.waiting() = false;
-    thread.pausedOn = 0;
-    scheduler.push(thread, thread.time);
-  }
-  
-  void scheduleOther(Runnable &runnable, ticks_t time) {
-    scheduler.push(runnable, time);
-  }
-  
-  /// Take an event on a thread. The thread must not be the current thread.
-  void takeEvent(Thread &thread, EventableResource &res, bool interrupt)
-  {
-    if (thread.waiting()) {
-      if (thread.pausedOn) {
-        thread.pausedOn->cancel();
-      }
-      schedule(thread);
-    }
-    completeEvent(thread, res, interrupt);
-  }
+  /// Sample the running threads with the specified profiler. The profile is
+  /// written when the simulation ends. Can't be used with a parallel quantum.
+  void setProfiler(std::auto_ptr<Profiler> p) { profiler = p; }
 
-  /// Take an event on the current thread.
-  /// \param CycleThread Whether to cycle the running thread after the
-  ///        event is taken.
-  /// \return The new time and pc.
-  void takeEvent(Thread &current)
-  {
-    current.time = std::max(current.time, pendingEvent.time);
-    // TODO this is probably the wrong place for this.
-    current.waiting() = false;
-    completeEvent(current, *pendingEvent.res, pendingEvent.interrupt);
-    pendingEvent.set = false;
-  }
-  
-  /// Sets a pending event on the current thread.
-  void setPendingEvent(EventableResource &res, ticks_t time, bool interrupt)
-  {
-    if (pendingEvent.set && pendingEvent.time <= time)
-      return;
-    pendingEvent.set = true;
-    pendingEvent.res = &res;
-    pendingEvent.interrupt = interrupt;
-    pendingEvent.time = time;
-  }
-  
-  bool hasPendingEvent() const {
-    return pendingEvent.set;
-  }
+  int run();
 
   node_iterator node_begin() { return nodes.begin(); }
   node_iterator node_end() { return nodes.end(); }
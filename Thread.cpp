@@ -6,7 +6,7 @@
 #include "Thread.h"
 #include "Core.h"
 #include "Node.h"
-#include "SystemState.h"
+#include "SchedulingContext.h"
 #include "Trace.h"
 #include "Stats.h"
 #include "Exceptions.h"
@@ -19,39 +19,19 @@
 #include "Chanend.h"
 #include "ClockBlock.h"
 #include "InstructionProperties.h"
+#include "HostMemory.h"
 #include <iostream>
 #include <cstdlib>
+#include <algorithm>
 
 using namespace Register;
 
-const char *registerNames[] = {
-  "r0",
-  "r1",
-  "r2",
-  "r3",
-  "r4",
-  "r5",
-  "r6",
-  "r7",
-  "r8",
-  "r9",
-  "r10",
-  "r11",
-  "cp",
-  "dp",
-  "sp",
-  "lr",
-  "et",
-  "ed",
-  "kep",
-  "ksp",
-  "spc",
-  "sed",
-  "ssr"
-};
-
-Thread::Thread() : Resource(RES_TYPE_THREAD), parent(0), scheduler(0) {
+Thread::Thread() :
+  Resource(RES_TYPE_THREAD), parent(0), scheduler(0), timeSliceEnd(0),
+  instructionCounts(0) {
   time = 0;
+  count = 0;
+  jitCount = 0;
   pc = 0;
   regs[KEP] = 0;
   regs[KSP] = 0;
@@ -62,11 +42,21 @@ Thread::Thread() : Resource(RES_TYPE_THREAD), parent(0), scheduler(0) {
   eeble() = false;
   ieble() = false;
   setInUse(false);
+  clearReturnAddressStack();
+}
+
+void Thread::clearReturnAddressStack()
+{
+  for (unsigned i = 0; i < JIT_RETURN_ADDRESS_STACK_SIZE; i++) {
+    returnAddressStack[i].pc = 0;
+    returnAddressStack[i].code = 0;
+  }
+  returnAddressStackTop = 0;
 }
 
 void Thread::finalize()
 {
-  scheduler = &getParent().getParent()->getParent()->getScheduler();
+  scheduler = &getParent().getSchedulingContext().getQueue();
 }
 
 void Thread::dump() const
@@ -81,17 +71,17 @@ void Thread::dump() const
 
 void Thread::schedule()
 {
-  getParent().getParent()->getParent()->schedule(*this);
+  getParent().getSchedulingContext().schedule(*this);
 }
 
 void Thread::takeEvent()
 {
-  getParent().getParent()->getParent()->takeEvent(*this);
+  getParent().getSchedulingContext().takeEvent(*this);
 }
 
 bool Thread::hasPendingEvent() const
 {
-  return getParent().getParent()->getParent()->hasPendingEvent();
+  return getParent().getSchedulingContext().hasPendingEvent();
 }
 
 bool Thread::setSRSlowPath(sr_t enabled)
@@ -119,7 +109,7 @@ bool Thread::setSRSlowPath(sr_t enabled)
 
 bool Thread::isExecuting() const
 {
-  return this == parent->getParent()->getParent()->getExecutingRunnable();
+  return this == parent->getSchedulingContext().getExecutingRunnable();
 }
 
 enum {
@@ -288,12 +278,37 @@ setC(ticks_t time, ResourceID resID, uint32_t val)
 
 #include "InstructionMacrosCommon.h"
 
+#if PAGE_PROTECTED_CODE
+static inline bool codeWriteBarrier()
+{
+  __asm__ __volatile__("" ::: "memory");
+  return false;
+}
+#endif
+
 #define THREAD thread
 #define CORE THREAD.getParent()
 #define PHYSICAL_ADDR(addr) CORE.physicalAddress(addr)
 #define VIRTUAL_ADDR(addr) CORE.virtualAddress(addr)
+#if GUARDED_MEMORY
+// Accesses outside of memory fault on the host. Thread::run() turns the
+// fault into an exception.
+#define CHECK_ADDR(addr) true
+#else
 #define CHECK_ADDR(addr) CORE.isValidAddress(addr)
+#endif
 #define CHECK_PC(addr) (((addr) >> (CORE.ramSizeLog2 - 1)) == 0)
+#if PAGE_PROTECTED_CODE
+// Pages holding cached code are write protected. If a store faults
+// retryCodeWrite() invalidates the code and executes the store again. The
+// barrier stops reads of the decode cache being moved before the store.
+#undef INVALIDATE_WORD
+#undef INVALIDATE_SHORT
+#undef INVALIDATE_BYTE
+#define INVALIDATE_WORD(addr) codeWriteBarrier()
+#define INVALIDATE_SHORT(addr) codeWriteBarrier()
+#define INVALIDATE_BYTE(addr) codeWriteBarrier()
+#endif
 //#define ERROR() internalError(THREAD, __FILE__, __LINE__);
 #define ERROR() std::abort();
 #define OP(n) (CORE.getOperands(THREAD.pc).ops[(n)])
@@ -327,7 +342,7 @@ do { \
 
 #define INSTRUCTION_CYCLES 4
 
-template<bool tracing>
+template<bool tracing, bool stats>
 JITReturn Instruction_TSETMR_2r(Thread &thread) {
   TRACE("tsetmr ", DestRegister(OP(0)), ", ", SrcRegister(OP(1)));
   THREAD.time += INSTRUCTION_CYCLES;
@@ -340,23 +355,27 @@ JITReturn Instruction_TSETMR_2r(Thread &thread) {
     THREAD.reg(OP(0)) = THREAD.reg(OP(1));
   }
   THREAD.pc++;
+  COUNT += 1;
   TRACE_END();
   return JIT_RETURN_CONTINUE;
 }
 
-template<bool tracing> JITReturn Instruction_RUN_JIT(Thread &thread) {
+template<bool tracing, bool stats>
+JITReturn Instruction_RUN_JIT(Thread &thread) {
   CORE.runJIT(THREAD.pendingPc);
   THREAD.pc = THREAD.pendingPc;
   return JIT_RETURN_END_TRACE;
 }
 
-template<bool tracing> JITReturn Instruction_DECODE(Thread &thread);
+template<bool tracing, bool stats>
+JITReturn Instruction_DECODE(Thread &thread);
 
-template<bool tracing> JITReturn Instruction_INTERPRET_ONE(Thread &thread);
+template<bool tracing, bool stats>
+JITReturn Instruction_INTERPRET_ONE(Thread &thread);
 
 static OPCODE_TYPE opcodeMap[] = {
 #define EMIT_INSTRUCTION_LIST
-#define DO_INSTRUCTION(inst) & Instruction_ ## inst <false>,
+#define DO_INSTRUCTION(inst) & Instruction_ ## inst <false, false>,
 #include "InstructionGenOutput.inc"
 #undef DO_INSTRUCTION
 #undef EMIT_INSTRUCTION_LIST
@@ -364,31 +383,274 @@ static OPCODE_TYPE opcodeMap[] = {
 
 static OPCODE_TYPE opcodeMapTracing[] = {
 #define EMIT_INSTRUCTION_LIST
-#define DO_INSTRUCTION(inst) & Instruction_ ## inst <true>,
+#define DO_INSTRUCTION(inst) & Instruction_ ## inst <true, false>,
+#include "InstructionGenOutput.inc"
+#undef DO_INSTRUCTION
+#undef EMIT_INSTRUCTION_LIST
+};
+
+static OPCODE_TYPE opcodeMapStats[] = {
+#define EMIT_INSTRUCTION_LIST
+#define DO_INSTRUCTION(inst) & Instruction_ ## inst <false, true>,
 #include "InstructionGenOutput.inc"
 #undef DO_INSTRUCTION
 #undef EMIT_INSTRUCTION_LIST
 };
 
-template<bool tracing> JITReturn Instruction_DECODE(Thread &thread) {
+static OPCODE_TYPE opcodeMapTracingStats[] = {
+#define EMIT_INSTRUCTION_LIST
+#define DO_INSTRUCTION(inst) & Instruction_ ## inst <true, true>,
+#include "InstructionGenOutput.inc"
+#undef DO_INSTRUCTION
+#undef EMIT_INSTRUCTION_LIST
+};
+
+/// Returns the interpreter function for the instruction.
+template<bool tracing, bool stats>
+static OPCODE_TYPE getInstructionFunction(InstructionOpcode opc)
+{
+  if (tracing)
+    return (stats ? opcodeMapTracingStats : opcodeMapTracing)[opc];
+  return (stats ? opcodeMapStats : opcodeMap)[opc];
+}
+
+#define EMIT_SUPERINSTRUCTION_FUNCTIONS
+#include "InstructionGenOutput.inc"
+#undef EMIT_SUPERINSTRUCTION_FUNCTIONS
+
+enum SuperinstructionOpcode {
+#define EMIT_SUPERINSTRUCTION_LIST
+#define DO_SUPERINSTRUCTION2(name, a, b) name,
+#define DO_SUPERINSTRUCTION3(name, a, b, c) name,
+#include "InstructionGenOutput.inc"
+#undef DO_SUPERINSTRUCTION3
+#undef DO_SUPERINSTRUCTION2
+#undef EMIT_SUPERINSTRUCTION_LIST
+  NUM_SUPERINSTRUCTIONS
+};
+
+struct SuperinstructionInfo {
+  unsigned length;
+  InstructionOpcode opcodes[3];
+  OPCODE_TYPE function;
+};
+
+// The extra entry avoids an empty array if there are no superinstructions.
+static const SuperinstructionInfo
+superinstructions[NUM_SUPERINSTRUCTIONS + 1] = {
+#define EMIT_SUPERINSTRUCTION_LIST
+#define DO_SUPERINSTRUCTION2(name, a, b) \
+  { 2, { a, b, a }, &Instruction_ ## name <false, false> },
+#define DO_SUPERINSTRUCTION3(name, a, b, c) \
+  { 3, { a, b, c }, &Instruction_ ## name <false, false> },
+#include "InstructionGenOutput.inc"
+#undef DO_SUPERINSTRUCTION3
+#undef DO_SUPERINSTRUCTION2
+#undef EMIT_SUPERINSTRUCTION_LIST
+};
+
+/// The threaded interpreter's dispatch table starts with the slow path,
+/// followed by the instructions and then the superinstructions.
+static unsigned getThreadedDispatchEntry(InstructionOpcode opc)
+{
+  return 1 + opc;
+}
+
+static unsigned getThreadedDispatchEntry(SuperinstructionOpcode opc)
+{
+  return 1 + sizeof(opcodeMap) / sizeof(opcodeMap[0]) + opc;
+}
+
+/// Decode the instruction at the specified pc so it can be executed as part
+/// of a superinstruction. Returns false if the pc already holds something
+/// other than the decode stub or the interpreter function for the
+/// instruction.
+static bool
+decodeForSuperinstruction(Core &core, uint32_t pc, InstructionOpcode &opc)
+{
+  if (!core.isValidPc(pc))
+    return false;
+  Operands ops;
+  instructionDecode(core, pc, opc, ops);
+  instructionTransform(opc, ops, core, pc);
+  if (!core.isCacheableCode(pc, instructionProperties[opc].size))
+    return false;
+  const OPCODE_TYPE existing = core.getOpcodeArray()[pc];
+  if (existing != &Instruction_DECODE<false, false> &&
+      core.getDecodeCache()[pc].threadedDispatch !=
+        getThreadedDispatchEntry(opc))
+    return false;
+  core.setOpcode(pc, opcodeMap[opc], ops, instructionProperties[opc].size);
+  core.setThreadedDispatch(pc, getThreadedDispatchEntry(opc));
+  return true;
+}
+
+/// If the instruction at the specified pc starts a sequence of instructions
+/// with a superinstruction then install the superinstruction, preferring the
+/// longest match.
+static void
+installSuperinstruction(Core &core, uint32_t pc, InstructionOpcode first)
+{
+  bool isFirst = false;
+  for (unsigned i = 0; i < NUM_SUPERINSTRUCTIONS; i++) {
+    if (superinstructions[i].opcodes[0] == first) {
+      isFirst = true;
+      break;
+    }
+  }
+  if (!isFirst)
+    return;
+  InstructionOpcode opcodes[3];
+  uint32_t pcs[4];
+  opcodes[0] = first;
+  pcs[0] = pc;
+  pcs[1] = pc + instructionProperties[first].size / 2;
+  unsigned numDecoded = 1;
+  while (numDecoded < 3 &&
+         decodeForSuperinstruction(core, pcs[numDecoded],
+                                   opcodes[numDecoded])) {
+    pcs[numDecoded + 1] = pcs[numDecoded] +
+                          instructionProperties[opcodes[numDecoded]].size / 2;
+    ++numDecoded;
+  }
+  int best = -1;
+  for (unsigned i = 0; i < NUM_SUPERINSTRUCTIONS; i++) {
+    const SuperinstructionInfo &info = superinstructions[i];
+    if (info.length > numDecoded ||
+        (best >= 0 && info.length <= superinstructions[best].length) ||
+        !std::equal(info.opcodes, info.opcodes + info.length, opcodes))
+      continue;
+    best = i;
+  }
+  if (best < 0)
+    return;
+  const SuperinstructionInfo &info = superinstructions[best];
+  // The size covers all the instructions so a write to any of them
+  // invalidates the superinstruction.
+  core.setOpcode(pc, info.function, (pcs[info.length] - pc) * 2);
+  core.setThreadedDispatch(pc,
+    getThreadedDispatchEntry(static_cast<SuperinstructionOpcode>(best)));
+}
+
+template<bool tracing, bool stats>
+JITReturn Instruction_DECODE(Thread &thread) {
   InstructionOpcode opc;
   Operands ops;
   instructionDecode(CORE, THREAD.pc, opc, ops);
   instructionTransform(opc, ops, CORE, THREAD.pc);
-  CORE.setOpcode(THREAD.pc, (tracing ? opcodeMapTracing : opcodeMap)[opc], ops,
+  if (!CORE.isCacheableCode(THREAD.pc, instructionProperties[opc].size)) {
+    // Execute the instruction without caching it.
+    CORE.setOperands(THREAD.pc, ops);
+    return (*getInstructionFunction<tracing, stats>(opc))(thread);
+  }
+  CORE.setOpcode(THREAD.pc, getInstructionFunction<tracing, stats>(opc), ops,
                  instructionProperties[opc].size);
+  // Superinstructions and the threaded interpreter don't trace or collect
+  // statistics.
+  if (!tracing && !stats) {
+    CORE.setThreadedDispatch(THREAD.pc, getThreadedDispatchEntry(opc));
+    installSuperinstruction(CORE, THREAD.pc, opc);
+  }
   return JIT_RETURN_END_TRACE;
 }
 
-template<bool tracing> JITReturn Instruction_INTERPRET_ONE(Thread &thread) {
+template<bool tracing, bool stats>
+JITReturn Instruction_INTERPRET_ONE(Thread &thread) {
   THREAD.pc = THREAD.pendingPc;
   InstructionOpcode opc;
   Operands ops;
   instructionDecode(CORE, THREAD.pc, opc, ops);
   instructionTransform(opc, ops, CORE, THREAD.pc);
-  return (*opcodeMap[opc])(thread);
+  return (*getInstructionFunction<false, stats>(opc))(thread);
+}
+
+#if THREADED_INTERPRETER
+#undef OP
+#undef LOP
+#undef TIME
+#undef COUNT
+#define OP(n) (decodeCache[THREADED_PC].operands.ops[(n)])
+#define LOP(n) (decodeCache[THREADED_PC].operands.lops[(n)])
+#define TIME threadedTime
+#define COUNT threadedCount
+#define THREADED_PC threadedPc
+#define THREADED_BLOCK(inst) Threaded_ ## inst:
+#define THREADED_DISPATCH() \
+goto *dispatchTable[decodeCache[THREADED_PC].threadedDispatch]
+#define THREADED_SYNC() \
+do { \
+THREAD.pc = THREADED_PC; \
+THREAD.time = TIME; \
+THREAD.count += COUNT; \
+COUNT = 0; \
+} while(0)
+#if GUARDED_MEMORY
+// The pc and time must be written back in case the access faults.
+#define THREADED_MEMORY_ACCESS() THREADED_SYNC()
+#else
+#define THREADED_MEMORY_ACCESS()
+#endif
+#define THREADED_YIELD_IF_TIME_SLICE_EXPIRED() \
+do { \
+if (TIME > threadedDeadline) { \
+THREADED_SYNC(); \
+THREAD.schedule(); \
+return; \
+} \
+} while(0)
+
+void Thread::runThreaded()
+{
+  static void * const dispatchTable[] = {
+    &&Threaded_SLOW_PATH,
+#define EMIT_THREADED_LIST
+#define THREADED_INSTRUCTION(inst) &&Threaded_ ## inst,
+#define THREADED_SLOW_PATH(inst) &&Threaded_SLOW_PATH,
+#include "InstructionGenOutput.inc"
+#undef THREADED_SLOW_PATH
+#undef THREADED_INSTRUCTION
+#undef EMIT_THREADED_LIST
+  };
+  Thread &thread = *this;
+  const OPCODE_TYPE *opcode = CORE.getOpcodeArray();
+  const DecodeCacheEntry *decodeCache = CORE.getDecodeCache();
+  uint32_t threadedPc = pc;
+  ticks_t threadedTime = time;
+  // Instructions retired since the last THREADED_SYNC(). Keeping a narrow
+  // delta instead of a copy of the 64 bit count stops GCC from packing the
+  // count and time into one vector register, which merges every dispatch
+  // into a single shared indirect jump.
+  uint32_t threadedCount = 0;
+  ticks_t threadedDeadline = timeSliceEnd;
+  THREADED_DISPATCH();
+#define EMIT_THREADED_BLOCKS
+#include "InstructionGenOutput.inc"
+#undef EMIT_THREADED_BLOCKS
+Threaded_SLOW_PATH:
+  THREADED_SYNC();
+  if ((*opcode[THREADED_PC])(THREAD) == JIT_RETURN_END_THREAD_EXECUTION)
+    return;
+  // Any compiled code called by the slow path has returned.
+  CORE.installCompiledCode();
+  // The deadline may have changed if other runnables were scheduled.
+  threadedPc = pc;
+  threadedTime = time;
+  threadedDeadline = timeSliceEnd;
+  THREADED_DISPATCH();
 }
 
+#undef THREADED_YIELD_IF_TIME_SLICE_EXPIRED
+#undef THREADED_MEMORY_ACCESS
+#undef THREADED_SYNC
+#undef THREADED_DISPATCH
+#undef THREADED_BLOCK
+#undef THREADED_PC
+#undef TIME
+#undef COUNT
+#define TIME THREAD.time
+#define COUNT THREAD.count
+#endif // THREADED_INTERPRETER
+
 #undef THREAD
 #undef CORE
 #undef ERROR
@@ -400,28 +662,148 @@ template<bool tracing> JITReturn Instruction_INTERPRET_ONE(Thread &thread) {
 
 void Thread::run(ticks_t time)
 {
+  getParent().initCacheIfNeeded();
   const OPCODE_TYPE *opcode = getParent().getOpcodeArray();
+  scheduler->setDeadline(&timeSliceEnd);
+  // No compiled code is executing between time slices so this is a safe point
+  // to install code compiled in the background. The dispatch loops below
+  // also install code while the thread runs, a thread may never reach the
+  // end of its time slice if it is the only one that is runnable.
+  getParent().installCompiledCode();
+
+#if GUARDED_MEMORY
+  // The fault handler jumps back here if a load or store faults. The pc of
+  // the faulting instruction has been written back to the thread.
+  MemoryFaultContext faultContext(getParent().getMemoryReservation(),
+                                  Core::getMemoryReservationSize());
+  if (sigsetjmp(faultContext.env, 0) &&
+      !retryCodeWrite(faultContext.getFaultOffset())) {
+    takeMemoryFault(faultContext.getFaultOffset());
+    if (hasTimeSliceExpired()) {
+      schedule();
+      return;
+    }
+  }
+#endif
 
+#if THREADED_INTERPRETER
+  // The threaded interpreter doesn't support tracing or statistics.
+  if (!Tracer::get().getTracingEnabled() && !Stats::get().getStatsEnabled()) {
+    runThreaded();
+    return;
+  }
+#endif
   while (1) {
-    if ((*opcode[pc])(*this) == JIT_RETURN_END_THREAD_EXECUTION)
-      return;
+    JITReturn ret = (*opcode[pc])(*this);
+    if (ret != JIT_RETURN_CONTINUE) {
+      if (ret == JIT_RETURN_END_THREAD_EXECUTION)
+        return;
+      // Compiled code returns here when it ends a trace, so nothing compiled
+      // is executing.
+      getParent().installCompiledCode();
+    }
   }
 }
 
-template<bool tracing>
+#if GUARDED_MEMORY
+/// Called when a load or store of the specified address faulted on the host.
+/// If the address is on a page protected because it holds cached code then
+/// the code is invalidated and the store is retried by executing the
+/// instruction again, in which case it returns true. This is done here
+/// rather than in the signal handler since invalidating code isn't async
+/// signal safe. Only the interpreter stores to protected pages, compiled
+/// code returns to the dispatch loop first, so the instruction has had no
+/// other effect.
+bool Thread::retryCodeWrite(uint32_t address)
+{
+#if PAGE_PROTECTED_CODE
+  if (!getParent().fixupMemoryFault(address))
+    return false;
+  if (Tracer::get().getTracingEnabled())
+    Tracer::get().traceEnd();
+  // Execute the instruction without caching it, caching it would protect
+  // the page again.
+  pendingPc = pc;
+  pc = getParent().getInterpretOneAddr();
+  return true;
+#else
+  return false;
+#endif
+}
+
+/// Take the exception for a load or store of the specified address which
+/// faulted on the host.
+void Thread::takeMemoryFault(uint32_t address)
+{
+  // Loads and stores take a single instruction cycle.
+  const ticks_t cycles = 4;
+  pc = exception(*this, pc, ET_LOAD_STORE, address);
+  time += cycles;
+  if (Tracer::get().getTracingEnabled())
+    Tracer::get().traceEnd();
+}
+#endif
+
+template<bool tracing, bool stats>
 void initInstructionCacheAux(Core &c)
 {
-  c.initCache(&Instruction_DECODE<tracing>,
-              &Instruction_ILLEGAL_PC<tracing>,
-              &Instruction_ILLEGAL_PC_THREAD<tracing>,
-              &Instruction_RUN_JIT<tracing>,
-              &Instruction_INTERPRET_ONE<tracing>);
+  c.initCache(&Instruction_DECODE<tracing, stats>,
+              &Instruction_ILLEGAL_PC<tracing, stats>,
+              &Instruction_ILLEGAL_PC_THREAD<tracing, stats>,
+              &Instruction_RUN_JIT<tracing, stats>,
+              &Instruction_INTERPRET_ONE<tracing, stats>);
 }
 
 void initInstructionCache(Core &c)
 {
-  if (Tracer::get().getTracingEnabled())
-    initInstructionCacheAux<true>(c);
+  bool tracing = Tracer::get().getTracingEnabled();
+  bool stats = Stats::get().getStatsEnabled();
+  if (tracing && stats)
+    initInstructionCacheAux<true, true>(c);
+  else if (tracing)
+    initInstructionCacheAux<true, false>(c);
+  else if (stats)
+    initInstructionCacheAux<false, true>(c);
+  else
+    initInstructionCacheAux<false, false>(c);
+}
+
+template<bool tracing, bool stats>
+static void predecodeInstructionsAux(Core &c, uint32_t pc, uint32_t endPc)
+{
+  const OPCODE_TYPE *opcode = c.getOpcodeArray();
+  while (pc < endPc && c.isValidPc(pc) &&
+         opcode[pc] == &Instruction_DECODE<tracing, stats>) {
+    InstructionOpcode opc;
+    Operands ops;
+    instructionDecode(c, pc, opc, ops);
+    if (opc == ILLEGAL_INSTRUCTION || opc == ILLEGAL_PC)
+      return;
+    instructionTransform(opc, ops, c, pc);
+    unsigned size = instructionProperties[opc].size;
+    if (!c.isCacheableCode(pc, size))
+      return;
+    // Cache the instruction in the same way as Instruction_DECODE.
+    c.setOpcode(pc, getInstructionFunction<tracing, stats>(opc), ops, size);
+    if (!tracing && !stats) {
+      c.setThreadedDispatch(pc, getThreadedDispatchEntry(opc));
+      installSuperinstruction(c, pc, opc);
+    }
+    pc += size / 2;
+  }
+}
+
+void predecodeInstructions(Core &c, uint32_t pc, uint32_t endPc)
+{
+  c.initCacheIfNeeded();
+  bool tracing = Tracer::get().getTracingEnabled();
+  bool stats = Stats::get().getStatsEnabled();
+  if (tracing && stats)
+    predecodeInstructionsAux<true, true>(c, pc, endPc);
+  else if (tracing)
+    predecodeInstructionsAux<true, false>(c, pc, endPc);
+  else if (stats)
+    predecodeInstructionsAux<false, true>(c, pc, endPc);
   else
-    initInstructionCacheAux<false>(c);
+    predecodeInstructionsAux<false, false>(c, pc, endPc);
 }
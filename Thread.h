@@ -22,15 +22,6 @@ public:
   unsigned getStatus() const { return status; }
 };
 
-extern const char *registerNames[];
-
-inline const char *getRegisterName(unsigned RegNum) {
-  if (RegNum < Register::NUM_REGISTERS) {
-    return registerNames[RegNum];
-  }
-  return "?";
-}
-
 class EventableResourceIterator :
   public std::iterator<std::forward_iterator_tag, int> {
 public:
@@ -93,6 +84,9 @@ class Thread : public Runnable, public Resource {
   Core *parent;
   /// The scheduler.
   RunnableQueue *scheduler;
+  /// Wake up time of the next runnable in the scheduler. This is kept up to
+  /// date by the scheduler while the thread is running.
+  ticks_t timeSliceEnd;
 public:
   enum SRBit {
     EEBLE = 0,
@@ -113,21 +107,59 @@ public:
   /// The time for the thread. This approximates the XCore's 400 MHz processor
   /// clock.
   ticks_t time;
-  // Instructions executed count
-  long count;
+  /// Number of instructions retired by the interpreter.
+  uint64_t count;
+  /// Number of instructions retired by JIT compiled code.
+  uint64_t jitCount;
   sr_t sr;
   /// When executing some pseduo instructions placed at the end this holds the
   /// real pc.
   uint32_t pendingPc;
   /// The resource on which the thread is paused on.
   Resource *pausedOn;
+  /// Number of times the thread has executed each instruction, indexed by
+  /// opcode. Only allocated when instruction counts are enabled.
+  long long *instructionCounts;
+  /// Entry in the return address stack.
+  struct ReturnAddress {
+    uint32_t pc;
+    /// The JIT compiled code for the pc.
+    void *code;
+  };
+  /// Return addresses pushed by calls in JIT compiled code, used to predict
+  /// the target of returns. Older entries are overwritten when it is full.
+  ReturnAddress returnAddressStack[JIT_RETURN_ADDRESS_STACK_SIZE];
+  unsigned returnAddressStackTop;
 
   Thread();
 
+  void pushReturnAddress(uint32_t pc, void *code) {
+    returnAddressStackTop =
+      (returnAddressStackTop + 1) % JIT_RETURN_ADDRESS_STACK_SIZE;
+    returnAddressStack[returnAddressStackTop].pc = pc;
+    returnAddressStack[returnAddressStackTop].code = code;
+  }
+
+  /// Pop the top of the return address stack. Returns the compiled code to
+  /// run if the entry matches the specified pc, otherwise returns 0.
+  void *popReturnAddress(uint32_t pc) {
+    ReturnAddress &entry = returnAddressStack[returnAddressStackTop];
+    void *code = entry.pc == pc ? entry.code : 0;
+    entry.code = 0;
+    returnAddressStackTop =
+      (returnAddressStackTop + JIT_RETURN_ADDRESS_STACK_SIZE - 1) %
+      JIT_RETURN_ADDRESS_STACK_SIZE;
+    return code;
+  }
+
+  /// Forget all return addresses. This must be called before the compiled
+  /// code they refer to is freed.
+  void clearReturnAddressStack();
+
+  uint64_t getInstructionCount() const { return count + jitCount; }
+
   bool hasTimeSliceExpired() const {
-    if (scheduler->empty())
-      return false;
-    return time > scheduler->front().wakeUpTime;
+    return time > timeSliceEnd;
   }
 
   bool alloc(Thread &CurrentThread)
@@ -284,6 +316,14 @@ public:
   bool setC(ticks_t time, ResourceID resID, uint32_t val);
 private:
   bool setSRSlowPath(sr_t old);
+  /// Run using the threaded interpreter. The pc and time are kept in locals
+  /// and only written back when an instruction that needs the full thread
+  /// state is executed.
+  void runThreaded();
+#if GUARDED_MEMORY
+  bool retryCodeWrite(uint32_t address);
+  void takeMemoryFault(uint32_t address);
+#endif
 };
 
 struct PendingEvent {
@@ -295,4 +335,9 @@ struct PendingEvent {
 
 void initInstructionCache(Core &c);
 
+/// Decode the instructions from pc up to endPc into the core's caches ahead of
+/// their first execution. Stops early at anything which doesn't decode to a
+/// valid instruction or which is already cached.
+void predecodeInstructions(Core &c, uint32_t pc, uint32_t endPc);
+
 #endif // _Thread_h_
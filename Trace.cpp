@@ -12,14 +12,30 @@
 #include <iomanip>
 #include <sstream>
 #include <cstring>
+#include <iterator>
 
 using namespace Register;
+using namespace TraceFormat;
 
 const unsigned mnemonicColumn = 49;
 const unsigned regWriteColumn = 87;
 
 Tracer Tracer::instance;
 
+Tracer::Tracer() :
+  tracingEnabled(false),
+  line(std::cout, buf, pendingBuf),
+  colours(TerminalColours::null),
+  lastThread(0),
+  lastThreadState(0),
+  symbolGeneration(0)
+{
+  for (unsigned i = 0; i != STRING_CACHE_SIZE; ++i) {
+    stringCache[i].s = 0;
+    stringCache[i].id = 0;
+  }
+}
+
 Tracer::PushLineState::PushLineState() :
   needRestore(false),
   line(Tracer::get().line.pending)
@@ -42,9 +58,139 @@ void Tracer::setSymbolInfo(std::auto_ptr<SymbolInfo> &si)
   symInfo = si;
 }
 
+void Tracer::setTracingEnabled(bool enable)
+{
+  tracingEnabled = enable;
+  if (!enable || writer.get())
+    return;
+  // Leave the formatting of the trace to a host writer thread so the
+  // simulation thread only has to encode the records.
+  writer.reset(TraceWriter::print(std::cout, colours));
+  if (!writer.get()) {
+    std::cerr << "Warning: failed to create trace writer thread, tracing in "
+                 "the foreground\n";
+  }
+}
+
 void Tracer::setColour(bool enable)
 {
-  colours = enable ? TerminalColours::ansi : TerminalColours::null;
+  // Text in the binary trace file is copied to the output of axe-tracedump
+  // as it is, so it is never coloured.
+  if (enable && !writer.get())
+    colours = TerminalColours::ansi;
+  else
+    colours = TerminalColours::null;
+}
+
+bool Tracer::setTraceFile(const std::string &path)
+{
+  TraceWriter *w = TraceWriter::open(path);
+  if (!w)
+    return false;
+  writer.reset(w);
+  colours = TerminalColours::null;
+  return true;
+}
+
+unsigned Tracer::getCoreID(const Core &core)
+{
+  std::map<const Core*, unsigned>::iterator it = coreIDs.find(&core);
+  if (it != coreIDs.end())
+    return it->second;
+  unsigned id = coreIDs.size();
+  coreIDs.insert(std::make_pair(&core, id));
+  writer->writeByte(RECORD_CORE);
+  writer->writeString(core.getCoreName());
+  return id;
+}
+
+Tracer::ThreadState &Tracer::getThreadState(const Thread &t)
+{
+  std::map<const Thread*, ThreadState>::iterator it = threadStates.find(&t);
+  if (it != threadStates.end())
+    return it->second;
+  unsigned coreID = getCoreID(t.getParent());
+  ThreadState state;
+  state.id = threadStates.size();
+  state.pc = 0;
+  state.time = 0;
+  writer->writeByte(RECORD_THREAD);
+  writer->writeVarint(coreID);
+  writer->writeVarint(t.getNum());
+  return threadStates.insert(std::make_pair(&t, state)).first->second;
+}
+
+void Tracer::writeSymbols()
+{
+  symbolGeneration = symInfo->getGeneration();
+  for (SymbolInfo::iterator it = symInfo->begin(), e = symInfo->end(); it != e;
+       ++it) {
+    unsigned coreID = getCoreID(*it->first);
+    const CoreSymbolInfo &coreSymbols = *it->second;
+    writer->writeByte(RECORD_SYMBOLS);
+    writer->writeVarint(coreID);
+    writer->writeVarint(std::distance(coreSymbols.symbol_begin(),
+                                      coreSymbols.symbol_end()));
+    for (CoreSymbolInfo::symbol_iterator symIt = coreSymbols.symbol_begin(),
+         symEnd = coreSymbols.symbol_end(); symIt != symEnd; ++symIt) {
+      writer->writeString(symIt->name);
+      writer->writeVarint(symIt->value);
+      writer->writeByte(symIt->info);
+    }
+  }
+}
+
+void Tracer::writeInstructionStart(const Thread &t)
+{
+  if (symInfo.get() && symInfo->getGeneration() != symbolGeneration)
+    writeSymbols();
+  if (&t != lastThread) {
+    lastThreadState = &getThreadState(t);
+    lastThread = &t;
+  }
+  ThreadState &state = *lastThreadState;
+  uint32_t pc = t.getParent().targetPc(t.pc);
+  writer->writeByte(RECORD_INSTRUCTION);
+  writer->writeVarint(state.id);
+  writer->writeSignedVarint(static_cast<int32_t>(pc - state.pc));
+  writer->writeSignedVarint(static_cast<int64_t>(t.time - state.time));
+  state.pc = pc;
+  state.time = t.time;
+}
+
+void Tracer::writeString(const char *s)
+{
+  uintptr_t hash = reinterpret_cast<uintptr_t>(s);
+  hash ^= hash >> 8;
+  StringCacheEntry &entry = stringCache[hash % STRING_CACHE_SIZE];
+  if (entry.s != s) {
+    std::map<const char*, unsigned>::iterator it = stringIDs.find(s);
+    if (it == stringIDs.end()) {
+      unsigned id = stringIDs.size();
+      stringIDs.insert(std::make_pair(s, id));
+      entry.s = s;
+      entry.id = id;
+      writer->writeByte(ITEM_NEW_STRING);
+      writer->writeString(s, std::strlen(s));
+      return;
+    }
+    entry.s = s;
+    entry.id = it->second;
+  }
+  writer->writeByte(ITEM_STRING);
+  writer->writeVarint(entry.id);
+}
+
+void Tracer::writeText(const std::string &s)
+{
+  writer->writeByte(RECORD_TEXT);
+  writer->writeString(s);
+}
+
+void Tracer::flush()
+{
+  if (writer.get())
+    writer->sync();
 }
 
 void Tracer::escapeCode(const char *s)
@@ -55,9 +201,21 @@ void Tracer::escapeCode(const char *s)
 
 void Tracer::printCommonEnd()
 {
+  if (line.binary) {
+    writer->writeByte(ITEM_END);
+    // Lines output while the instruction was traced follow it.
+    if (!line.pending->str().empty())
+      writeText(line.pending->str());
+    line.binary = false;
+    line.thread = 0;
+    return;
+  }
   *line.buf << '\n';
   if (line.out) {
-    *line.out << line.buf->str() << line.pending->str();
+    if (writer.get())
+      writeText(line.buf->str() + line.pending->str());
+    else
+      *line.out << line.buf->str() << line.pending->str();
     line.buf->str("");
   }
   line.thread = 0;
@@ -121,6 +279,13 @@ void Tracer::printThreadPC()
 
 void Tracer::printInstructionStart(const Thread &t)
 {
+  if (writer.get()) {
+    printCommonStart();
+    line.thread = &t;
+    line.binary = true;
+    writeInstructionStart(t);
+    return;
+  }
   printCommonStart(t);
   *line.buf << ' ';
   printThreadPC();
@@ -133,21 +298,57 @@ void Tracer::printInstructionStart(const Thread &t)
   }
 }
 
+void Tracer::printOperand(const char *op)
+{
+  if (line.binary) {
+    writeString(op);
+    return;
+  }
+  *line.buf << op;
+}
+
+void Tracer::printOperand(uint32_t op)
+{
+  if (line.binary) {
+    writer->writeByte(ITEM_IMMEDIATE);
+    writer->writeVarint(op);
+    return;
+  }
+  *line.buf << op;
+}
+
 void Tracer::printOperand(SrcRegister op)
 {
   Register::Reg reg = op.getRegister();
+  if (line.binary) {
+    writer->writeByte(ITEM_SRC_REGISTER);
+    writer->writeVarint(reg);
+    writer->writeVarint(line.thread->regs[reg]);
+    return;
+  }
   *line.buf << reg << "(0x" << std::hex << line.thread->regs[reg] << ')'
        << std::dec;
 }
 
 void Tracer::printOperand(DestRegister op)
 {
+  if (line.binary) {
+    writer->writeByte(ITEM_DEST_REGISTER);
+    writer->writeVarint(op.getRegister());
+    return;
+  }
   *line.buf << op.getRegister();
 }
 
 void Tracer::printOperand(SrcDestRegister op)
 {
   Register::Reg reg = op.getRegister();
+  if (line.binary) {
+    writer->writeByte(ITEM_SRC_REGISTER);
+    writer->writeVarint(reg);
+    writer->writeVarint(line.thread->regs[reg]);
+    return;
+  }
   *line.buf << reg << "(0x" << std::hex << line.thread->regs[reg] << ')'
        << std::dec;
 }
@@ -155,6 +356,12 @@ void Tracer::printOperand(SrcDestRegister op)
 void Tracer::printOperand(CPRelOffset op)
 {
   uint32_t cpValue = line.thread->regs[CP];
+  if (line.binary) {
+    writer->writeByte(ITEM_CP_OFFSET);
+    writer->writeVarint(op.getOffset());
+    writer->writeVarint(cpValue);
+    return;
+  }
   uint32_t address = cpValue + (op.getOffset() << 2);
   const Core *core = &line.thread->getParent();
   const ElfSymbol *sym, *cpSym;
@@ -173,6 +380,12 @@ void Tracer::printOperand(CPRelOffset op)
 void Tracer::printOperand(DPRelOffset op)
 {
   uint32_t dpValue = line.thread->regs[DP];
+  if (line.binary) {
+    writer->writeByte(ITEM_DP_OFFSET);
+    writer->writeVarint(op.getOffset());
+    writer->writeVarint(dpValue);
+    return;
+  }
   uint32_t address = dpValue + (op.getOffset() << 2);
   const Core *core = &line.thread->getParent();
   const ElfSymbol *sym, *dpSym;
@@ -190,6 +403,12 @@ void Tracer::printOperand(DPRelOffset op)
 
 void Tracer::regWrite(Reg reg, uint32_t value)
 {
+  if (line.binary) {
+    writer->writeByte(ITEM_REG_WRITE);
+    writer->writeVarint(reg);
+    writer->writeVarint(value);
+    return;
+  }
   if (!line.hadRegWrite) {
     *line.buf << ' ';
     // Align
@@ -9,10 +9,13 @@
 #include "SymbolInfo.h"
 #include "Thread.h"
 #include "TerminalColours.h"
+#include "TraceFormat.h"
+#include "TraceWriter.h"
 #include <iostream>
 #include <sstream>
 #include <string>
 #include <memory>
+#include <map>
 
 class EventableResource;
 class SystemState;
@@ -62,22 +65,23 @@ public:
 
 class Tracer {
 private:
-  Tracer() :
-    tracingEnabled(false),
-    line(std::cout, buf, pendingBuf),
-    colours(TerminalColours::null) {}
+  Tracer();
   struct LineState {
     LineState(std::ostringstream *b) :
       thread(0),
+      binary(false),
       out(0),
       buf(b),
       pending(0) {}
     LineState(std::ostream &o, std::ostringstream &b, std::ostringstream &pendingBuf) :
       thread(0),
+      binary(false),
       out(&o),
       buf(&b),
       pending(&pendingBuf) {}
     const Thread *thread;
+    /// Whether the line is an instruction written to the binary trace.
+    bool binary;
     bool hadRegWrite;
     size_t numEscapeChars;
     std::ostream *out;
@@ -100,8 +104,42 @@ private:
   std::auto_ptr<SymbolInfo> symInfo;
   TerminalColours colours;
 
+  /// Binary trace, 0 if the trace is formatted on the simulation thread. It
+  /// is either written to the trace file or printed as text by the writer
+  /// thread.
+  std::auto_ptr<TraceWriter> writer;
+  struct ThreadState {
+    unsigned id;
+    /// The pc and time of the last instruction traced on the thread.
+    uint32_t pc;
+    ticks_t time;
+  };
+  std::map<const Core*, unsigned> coreIDs;
+  std::map<const Thread*, ThreadState> threadStates;
+  /// The thread of the last instruction written to the binary trace.
+  const Thread *lastThread;
+  ThreadState *lastThreadState;
+  /// Generation of the symbols last written to the binary trace.
+  unsigned symbolGeneration;
+  std::map<const char*, unsigned> stringIDs;
+  /// Direct mapped cache in front of stringIDs. The strings passed to trace()
+  /// are literals so they are identified by their address.
+  enum { STRING_CACHE_SIZE = 256 };
+  struct StringCacheEntry {
+    const char *s;
+    unsigned id;
+  };
+  StringCacheEntry stringCache[STRING_CACHE_SIZE];
+
   static Tracer instance;
 
+  unsigned getCoreID(const Core &core);
+  ThreadState &getThreadState(const Thread &t);
+  void writeSymbols();
+  void writeInstructionStart(const Thread &t);
+  void writeString(const char *s);
+  void writeText(const std::string &s);
+
   void escapeCode(const char *s);
   void reset() { escapeCode(colours.reset); }
   void red() { escapeCode(colours.red); }
@@ -118,9 +156,18 @@ private:
   template <typename T>
     void printOperand(const T &op)
   {
+    if (line.binary) {
+      std::ostringstream s;
+      s << op;
+      writer->writeByte(TraceFormat::ITEM_TEXT);
+      writer->writeString(s.str());
+      return;
+    }
     *line.buf << op;
   }
 
+  void printOperand(const char *op);
+  void printOperand(uint32_t op);
   void printOperand(SrcRegister op);
   void printOperand(DestRegister op);
   void printOperand(SrcDestRegister op);
@@ -131,11 +178,20 @@ private:
   void dumpThreadSummary(const SystemState &system);
 public:
 
-  void setTracingEnabled(bool enable) { tracingEnabled = enable; }
+  /// When tracing is enabled without a trace file the trace is printed by a
+  /// host writer thread. setColour() must be called first.
+  void setTracingEnabled(bool enable);
   bool getTracingEnabled() const { return tracingEnabled; }
   void setSymbolInfo(std::auto_ptr<SymbolInfo> &si);
   SymbolInfo *getSymbolInfo() { return symInfo.get(); }
   void setColour(bool enable);
+  /// Write the trace to the specified file in the binary format read by
+  /// axe-tracedump instead of writing text to stdout. Returns false if the
+  /// file can't be created.
+  bool setTraceFile(const std::string &path);
+  /// Wait until everything traced so far has been written. Called before
+  /// output which must appear after the trace.
+  void flush();
 
   template<typename T0>
   void trace(const Thread &t, T0 op0)
@@ -0,0 +1,265 @@
+// Copyright (c) 2012, Richard Osborne, All rights reserved
+// This software is freely distributable under a derivative of the
+// University of Illinois/NCSA Open Source License posted in
+// LICENSE.txt and at <http://github.xcore.com/>
+
+#include "TraceDumper.h"
+#include "TraceFormat.h"
+#include "SymbolInfo.h"
+#include "Register.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <iomanip>
+
+using namespace TraceFormat;
+
+const unsigned mnemonicColumn = 49;
+const unsigned regWriteColumn = 87;
+
+void TraceReader::error(const char *message)
+{
+  std::cerr << "Error: malformed trace: " << message << std::endl;
+  std::exit(1);
+}
+
+uint64_t TraceReader::readVarint()
+{
+  uint64_t value = 0;
+  for (unsigned shift = 0; shift < 64; shift += 7) {
+    uint8_t byte = readByte();
+    value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+    if (!(byte & 0x80))
+      return value;
+  }
+  error("malformed varint");
+  return 0;
+}
+
+std::string TraceReader::readString()
+{
+  uint64_t length = readVarint();
+  std::string s;
+  s.reserve(length);
+  // The string may be split across more than one block.
+  while (length) {
+    if (!fill())
+      error("unexpected end of trace");
+    size_t size = std::min<uint64_t>(length, end - pos);
+    s.append(reinterpret_cast<const char*>(pos), size);
+    pos += size;
+    length -= size;
+  }
+  return s;
+}
+
+TraceDumper::TraceDumper(TraceReader &r, std::ostream &o,
+                         const TerminalColours &c, bool t) :
+  reader(r),
+  out(o),
+  colours(c),
+  showTime(t),
+  numEscapeChars(0)
+{
+}
+
+TraceDumper::~TraceDumper()
+{
+  for (unsigned i = 0, e = coreSymbols.size(); i != e; ++i)
+    delete coreSymbols[i];
+}
+
+unsigned TraceDumper::readCoreID()
+{
+  uint64_t core = reader.readVarint();
+  if (core >= coreNames.size())
+    reader.error("undefined core");
+  return core;
+}
+
+void TraceDumper::readSymbols()
+{
+  unsigned core = readCoreID();
+  uint64_t count = reader.readVarint();
+  CoreSymbolInfoBuilder builder;
+  for (uint64_t i = 0; i != count; ++i) {
+    std::string name = reader.readString();
+    uint32_t value = reader.readVarint();
+    unsigned char info = reader.readByte();
+    builder.addSymbol(name.c_str(), value, info);
+  }
+  delete coreSymbols[core];
+  coreSymbols[core] = builder.getSymbolInfo().release();
+}
+
+void TraceDumper::escapeCode(const char *s)
+{
+  buf << s;
+  numEscapeChars += std::strlen(s);
+}
+
+void TraceDumper::printPC(unsigned core, uint32_t pc)
+{
+  const CoreSymbolInfo *symbols = coreSymbols[core];
+  const ElfSymbol *sym;
+  if (symbols && (sym = symbols->getFunctionSymbol(pc))) {
+    buf << sym->name;
+    if (sym->value != pc)
+      buf << '+' << (pc - sym->value);
+    buf << "(0x" << std::hex << pc << std::dec << ')';
+  } else {
+    buf << "0x" << std::hex << pc << std::dec;
+  }
+}
+
+void TraceDumper::printRelOffset(unsigned core, uint32_t offset,
+                                 uint32_t base, const char *baseSymbol)
+{
+  uint32_t address = base + (offset << 2);
+  const CoreSymbolInfo *symbols = coreSymbols[core];
+  const ElfSymbol *sym, *baseSym;
+  if (symbols &&
+      (sym = symbols->getDataSymbol(address)) &&
+      sym->value == address &&
+      (baseSym = symbols->getGlobalSymbol(baseSymbol)) &&
+      baseSym->value == base) {
+    buf << sym->name;
+    buf << "(0x" << std::hex << address << std::dec << ')';
+  } else {
+    buf << offset;
+  }
+}
+
+void TraceDumper::align(unsigned column)
+{
+  size_t pos = buf.str().size() - numEscapeChars;
+  if (pos < column)
+    buf << std::setw(column - pos) << "";
+}
+
+void TraceDumper::dumpInstruction()
+{
+  uint64_t id = reader.readVarint();
+  if (id >= threads.size())
+    reader.error("undefined thread");
+  ThreadInfo &thread = threads[id];
+  thread.pc += reader.readSignedVarint();
+  thread.time += reader.readSignedVarint();
+
+  buf.str("");
+  numEscapeChars = 0;
+  escapeCode(colours.green);
+  buf << '<' << coreNames[thread.core] << ":t" << thread.num << '>';
+  escapeCode(colours.reset);
+  buf << ' ';
+  printPC(thread.core, thread.pc);
+  buf << ": ";
+  align(mnemonicColumn);
+  bool hadRegWrite = false;
+  while (1) {
+    switch (reader.readByte()) {
+    default:
+      reader.error("unknown item");
+      break;
+    case ITEM_END:
+      buf << '\n';
+      if (showTime)
+        out << std::setw(12) << thread.time << ' ';
+      out << buf.str();
+      return;
+    case ITEM_STRING:
+      {
+        uint64_t string = reader.readVarint();
+        if (string >= strings.size())
+          reader.error("undefined string");
+        buf << strings[string];
+      }
+      break;
+    case ITEM_NEW_STRING:
+      strings.push_back(reader.readString());
+      buf << strings.back();
+      break;
+    case ITEM_TEXT:
+      buf << reader.readString();
+      break;
+    case ITEM_SRC_REGISTER:
+      {
+        unsigned reg = reader.readVarint();
+        uint32_t value = reader.readVarint();
+        buf << getRegisterName(reg) << "(0x" << std::hex << value << ')'
+            << std::dec;
+      }
+      break;
+    case ITEM_DEST_REGISTER:
+      buf << getRegisterName(reader.readVarint());
+      break;
+    case ITEM_IMMEDIATE:
+      buf << static_cast<uint32_t>(reader.readVarint());
+      break;
+    case ITEM_CP_OFFSET:
+      {
+        uint32_t offset = reader.readVarint();
+        uint32_t cp = reader.readVarint();
+        printRelOffset(thread.core, offset, cp, "_cp");
+      }
+      break;
+    case ITEM_DP_OFFSET:
+      {
+        uint32_t offset = reader.readVarint();
+        uint32_t dp = reader.readVarint();
+        printRelOffset(thread.core, offset, dp, "_dp");
+      }
+      break;
+    case ITEM_REG_WRITE:
+      {
+        unsigned reg = reader.readVarint();
+        uint32_t value = reader.readVarint();
+        if (!hadRegWrite) {
+          buf << ' ';
+          align(regWriteColumn);
+          buf << "# ";
+        } else {
+          buf << ", ";
+        }
+        buf << getRegisterName(reg) << "=0x" << std::hex << value << std::dec;
+        hadRegWrite = true;
+      }
+      break;
+    }
+  }
+}
+
+void TraceDumper::dump()
+{
+  while (!reader.atEnd()) {
+    switch (reader.readByte()) {
+    default:
+      reader.error("unknown record");
+      break;
+    case RECORD_CORE:
+      coreNames.push_back(reader.readString());
+      coreSymbols.push_back(0);
+      break;
+    case RECORD_THREAD:
+      {
+        ThreadInfo thread;
+        thread.core = readCoreID();
+        thread.num = reader.readVarint();
+        thread.pc = 0;
+        thread.time = 0;
+        threads.push_back(thread);
+      }
+      break;
+    case RECORD_SYMBOLS:
+      readSymbols();
+      break;
+    case RECORD_INSTRUCTION:
+      dumpInstruction();
+      break;
+    case RECORD_TEXT:
+      out << reader.readString();
+      break;
+    }
+  }
+}
@@ -0,0 +1,98 @@
+// Copyright (c) 2012, Richard Osborne, All rights reserved
+// This software is freely distributable under a derivative of the
+// University of Illinois/NCSA Open Source License posted in
+// LICENSE.txt and at <http://github.xcore.com/>
+
+#ifndef _TraceDumper_h_
+#define _TraceDumper_h_
+
+#include "TerminalColours.h"
+#include <iosfwd>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+class CoreSymbolInfo;
+
+/// Reads the binary trace format described in TraceFormat.h. Subclasses
+/// supply the bytes a block at a time.
+class TraceReader {
+  const uint8_t *pos;
+  const uint8_t *end;
+
+  bool fill()
+  {
+    if (pos != end)
+      return true;
+    return refill(pos, end) && pos != end;
+  }
+protected:
+  /// Set [begin, end) to the next block of the trace. Returns false at the
+  /// end of the trace.
+  virtual bool refill(const uint8_t *&begin, const uint8_t *&end) = 0;
+public:
+  TraceReader() : pos(0), end(0) {}
+  virtual ~TraceReader() {}
+  /// Report a malformed trace and exit.
+  virtual void error(const char *message);
+  /// Returns true if there is nothing left to read.
+  bool atEnd() { return !fill(); }
+  uint8_t readByte()
+  {
+    if (!fill())
+      error("unexpected end of trace");
+    return *pos++;
+  }
+  uint64_t readVarint();
+  int64_t readSignedVarint()
+  {
+    uint64_t value = readVarint();
+    return (value >> 1) ^ -static_cast<int64_t>(value & 1);
+  }
+  std::string readString();
+};
+
+/// Prints a binary trace in the same format as the textual trace written by
+/// axe -t.
+class TraceDumper {
+  struct ThreadInfo {
+    unsigned core;
+    unsigned num;
+    uint32_t pc;
+    int64_t time;
+  };
+
+  TraceReader &reader;
+  std::ostream &out;
+  TerminalColours colours;
+  bool showTime;
+  std::vector<std::string> coreNames;
+  /// Symbols of each core, 0 if there are none.
+  std::vector<CoreSymbolInfo*> coreSymbols;
+  std::vector<ThreadInfo> threads;
+  std::vector<std::string> strings;
+  std::ostringstream buf;
+  /// Number of characters in buf which are part of an escape code.
+  unsigned numEscapeChars;
+
+  TraceDumper(const TraceDumper &); // Not implemented.
+  void operator=(const TraceDumper &); // Not implemented.
+
+  unsigned readCoreID();
+  void readSymbols();
+  void dumpInstruction();
+  void escapeCode(const char *s);
+  void printPC(unsigned core, uint32_t pc);
+  void printRelOffset(unsigned core, uint32_t offset, uint32_t base,
+                      const char *baseSymbol);
+  void align(unsigned column);
+public:
+  TraceDumper(TraceReader &reader, std::ostream &out,
+              const TerminalColours &colours, bool showTime);
+  ~TraceDumper();
+  /// Print records until the end of the trace.
+  void dump();
+};
+
+#endif // _TraceDumper_h_
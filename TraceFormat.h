@@ -0,0 +1,69 @@
+// Copyright (c) 2012, Richard Osborne, All rights reserved
+// This software is freely distributable under a derivative of the
+// University of Illinois/NCSA Open Source License posted in
+// LICENSE.txt and at <http://github.xcore.com/>
+
+#ifndef _TraceFormat_h_
+#define _TraceFormat_h_
+
+/// Layout of the binary trace files written by axe and read by
+/// axe-tracedump.
+///
+/// A file starts with the magic string followed by the version. The rest of
+/// the file is a sequence of records, each starting with a byte giving the
+/// record type. Integers are unsigned LEB128 varints, signed integers are
+/// zigzag encoded first. Strings are a varint length followed by the bytes.
+///
+/// Cores and threads are defined once and then referred to by id, ids are
+/// allocated in order starting from 0. The pc and time of an instruction are
+/// stored as the difference from the previous instruction traced on the same
+/// thread. The text of an instruction is stored as a sequence of items ending
+/// with ITEM_END. Strings used in the text are defined the first time they are
+/// used and referred to by id after that.
+namespace TraceFormat {
+  const char magic[] = "AXETRACE";
+  const unsigned magicSize = sizeof(magic) - 1;
+  const unsigned version = 1;
+
+  enum RecordType {
+    /// Define a core: name.
+    RECORD_CORE,
+    /// Define a thread: core id, thread number.
+    RECORD_THREAD,
+    /// Replace the symbols of a core: core id, number of symbols, then the
+    /// name, value and ELF info byte of each symbol.
+    RECORD_SYMBOLS,
+    /// An instruction: thread id, signed pc difference, signed time
+    /// difference, items.
+    RECORD_INSTRUCTION,
+    /// A line of text which isn't an instruction, for example an event,
+    /// exception or system call: text including the newline.
+    RECORD_TEXT
+  };
+
+  enum ItemType {
+    /// End of the instruction.
+    ITEM_END,
+    /// A string used before: string id.
+    ITEM_STRING,
+    /// A string used for the first time, allocating the next string id:
+    /// text.
+    ITEM_NEW_STRING,
+    /// Text which isn't given an id: text.
+    ITEM_TEXT,
+    /// A register read by the instruction: register number, value.
+    ITEM_SRC_REGISTER,
+    /// A register written by the instruction: register number.
+    ITEM_DEST_REGISTER,
+    /// An immediate printed in decimal: value.
+    ITEM_IMMEDIATE,
+    /// A word offset from cp: offset, value of cp.
+    ITEM_CP_OFFSET,
+    /// A word offset from dp: offset, value of dp.
+    ITEM_DP_OFFSET,
+    /// A register write: register number, value.
+    ITEM_REG_WRITE
+  };
+}
+
+#endif // _TraceFormat_h_
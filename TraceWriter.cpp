@@ -0,0 +1,196 @@
+// Copyright (c) 2012, Richard Osborne, All rights reserved
+// This software is freely distributable under a derivative of the
+// University of Illinois/NCSA Open Source License posted in
+// LICENSE.txt and at <http://github.xcore.com/>
+
+#include "TraceWriter.h"
+#include "TraceFormat.h"
+#include "TraceDumper.h"
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+
+/// Reads the buffers handed to the writer thread.
+class TraceWriter::ChunkReader : public TraceReader {
+  TraceWriter &writer;
+  bool haveChunk;
+protected:
+  bool refill(const uint8_t *&begin, const uint8_t *&end);
+public:
+  ChunkReader(TraceWriter &w) : writer(w), haveChunk(false) {}
+};
+
+bool TraceWriter::ChunkReader::refill(const uint8_t *&begin,
+                                      const uint8_t *&end)
+{
+  if (haveChunk) {
+    // Everything in the buffer must have been printed when sync() returns.
+    writer.out->flush();
+    writer.releaseChunk();
+  }
+  size_t size;
+  haveChunk = writer.getChunk(begin, size);
+  if (!haveChunk)
+    return false;
+  end = begin + size;
+  return true;
+}
+
+TraceWriter::TraceWriter(std::FILE *f, const std::string &p,
+                         std::ostream *o, const TerminalColours &c) :
+  file(f),
+  path(p),
+  out(o),
+  colours(c),
+  buffers(new uint8_t[2 * TRACE_BUFFER_SIZE]),
+  buffer(&buffers[0]),
+  used(0),
+  failed(false),
+  full(0),
+  fullSize(0),
+  done(false),
+  running(false)
+{
+}
+
+TraceWriter::~TraceWriter()
+{
+  finish();
+  if (!file)
+    return;
+  if (std::fclose(file) != 0)
+    failed = true;
+  if (failed)
+    std::cerr << "Error: failed to write trace to " << path << std::endl;
+}
+
+TraceWriter *TraceWriter::open(const std::string &path)
+{
+  std::FILE *file = std::fopen(path.c_str(), "wb");
+  if (!file)
+    return 0;
+  TraceWriter *writer = new TraceWriter(file, path, 0, TerminalColours::null);
+  if (!writer->start()) {
+    std::cerr << "Error: failed to create host thread" << std::endl;
+    std::exit(1);
+  }
+  for (unsigned i = 0; i != TraceFormat::magicSize; ++i)
+    writer->writeByte(TraceFormat::magic[i]);
+  writer->writeVarint(TraceFormat::version);
+  return writer;
+}
+
+TraceWriter *TraceWriter::
+print(std::ostream &out, const TerminalColours &colours)
+{
+  TraceWriter *writer = new TraceWriter(0, std::string(), &out, colours);
+  if (!writer->start()) {
+    delete writer;
+    return 0;
+  }
+  return writer;
+}
+
+bool TraceWriter::start()
+{
+  running = thread.start(threadEntry, this);
+  return running;
+}
+
+void TraceWriter::finish()
+{
+  if (!running)
+    return;
+  handOff();
+  {
+    ScopedLock lock(mutex);
+    done = true;
+    cond.notifyAll();
+  }
+  thread.join();
+  running = false;
+}
+
+void TraceWriter::threadEntry(void *arg)
+{
+  static_cast<TraceWriter*>(arg)->threadMain();
+}
+
+void TraceWriter::threadMain()
+{
+  if (file) {
+    const uint8_t *data;
+    size_t size;
+    while (getChunk(data, size)) {
+      if (std::fwrite(data, 1, size, file) != size)
+        failed = true;
+      releaseChunk();
+    }
+    return;
+  }
+  ChunkReader reader(*this);
+  TraceDumper dumper(reader, *out, colours, false);
+  dumper.dump();
+}
+
+bool TraceWriter::getChunk(const uint8_t *&data, size_t &size)
+{
+  ScopedLock lock(mutex);
+  while (!full && !done)
+    cond.wait(mutex);
+  if (!full)
+    return false;
+  data = full;
+  size = fullSize;
+  return true;
+}
+
+void TraceWriter::releaseChunk()
+{
+  ScopedLock lock(mutex);
+  full = 0;
+  cond.notifyAll();
+}
+
+void TraceWriter::handOff()
+{
+  if (!used)
+    return;
+  {
+    ScopedLock lock(mutex);
+    // Wait for the writer thread to finish with the other buffer.
+    while (full)
+      cond.wait(mutex);
+    full = buffer;
+    fullSize = used;
+    cond.notifyAll();
+  }
+  if (buffer == &buffers[0])
+    buffer = &buffers[TRACE_BUFFER_SIZE];
+  else
+    buffer = &buffers[0];
+  used = 0;
+}
+
+void TraceWriter::sync()
+{
+  handOff();
+  ScopedLock lock(mutex);
+  while (full)
+    cond.wait(mutex);
+}
+
+void TraceWriter::writeString(const char *s, size_t length)
+{
+  writeVarint(length);
+  // Long strings are split across buffers.
+  while (length) {
+    if (used == TRACE_BUFFER_SIZE)
+      handOff();
+    size_t size = std::min<size_t>(length, TRACE_BUFFER_SIZE - used);
+    std::memcpy(&buffer[used], s, size);
+    used += size;
+    s += size;
+    length -= size;
+  }
+}
@@ -0,0 +1,123 @@
+// Copyright (c) 2012, Richard Osborne, All rights reserved
+// This software is freely distributable under a derivative of the
+// University of Illinois/NCSA Open Source License posted in
+// LICENSE.txt and at <http://github.xcore.com/>
+
+#ifndef _TraceWriter_h_
+#define _TraceWriter_h_
+
+#include "Config.h"
+#include "ScopedArray.h"
+#include "HostThread.h"
+#include "TerminalColours.h"
+#include <cstdio>
+#include <cstring>
+#include <iosfwd>
+#include <string>
+
+/// Writes a binary trace, see TraceFormat.h for the layout. Records are
+/// written to one of two large buffers by the simulation thread. When it is
+/// full the buffer is handed to a host writer thread which either writes it
+/// to a file or prints it as text while the simulation thread fills the
+/// other buffer. If the writer thread falls behind the simulation thread
+/// waits for it to finish with the other buffer.
+///
+/// The buffers are only ever written by one simulation thread (tracing
+/// isn't supported with --parallel-quantum) so the lock is only taken when a
+/// buffer is handed over.
+class TraceWriter {
+  class ChunkReader;
+  friend class ChunkReader;
+
+  /// Trace file, 0 if the trace is printed as text.
+  std::FILE *file;
+  std::string path;
+  /// Stream the trace is printed to if it is printed as text.
+  std::ostream *out;
+  TerminalColours colours;
+  /// Storage for both buffers.
+  scoped_array<uint8_t> buffers;
+  /// The buffer being filled by the simulation thread.
+  uint8_t *buffer;
+  size_t used;
+  /// Set by the writer thread, only read once it has finished.
+  bool failed;
+
+  Mutex mutex;
+  /// Signalled whenever full or done change.
+  ConditionVariable cond;
+  /// The buffer owned by the writer thread, 0 if it is waiting for one.
+  const uint8_t *full;
+  size_t fullSize;
+  /// Set when there is nothing more to write.
+  bool done;
+  /// Set while the writer thread is running.
+  bool running;
+  HostThread thread;
+
+  TraceWriter(const TraceWriter &); // Not implemented.
+  void operator=(const TraceWriter &); // Not implemented.
+
+  TraceWriter(std::FILE *file, const std::string &path, std::ostream *out,
+              const TerminalColours &colours);
+  bool start();
+  void finish();
+  static void threadEntry(void *arg);
+  void threadMain();
+  /// Called on the writer thread to wait for the next buffer. Returns false
+  /// if there is nothing more to write.
+  bool getChunk(const uint8_t *&data, size_t &size);
+  /// Called on the writer thread when it has finished with a buffer.
+  void releaseChunk();
+
+  void handOff();
+  void reserve(size_t size)
+  {
+    if (used + size > TRACE_BUFFER_SIZE)
+      handOff();
+  }
+public:
+  /// Writes the remaining records and waits for the writer thread to exit.
+  /// The file is closed if there is one.
+  ~TraceWriter();
+  /// Create the file, write the header and start the writer thread. Returns
+  /// 0 if the file can't be created.
+  static TraceWriter *open(const std::string &path);
+  /// Start a writer thread which prints the trace to the specified stream in
+  /// the same format as axe-tracedump. Returns 0 if the thread can't be
+  /// started.
+  static TraceWriter *print(std::ostream &out, const TerminalColours &colours);
+
+  /// Wait until the writer thread has written everything written so far to
+  /// the file or printed it and flushed the stream.
+  void sync();
+
+  void writeByte(uint8_t value)
+  {
+    reserve(1);
+    buffer[used++] = value;
+  }
+
+  void writeVarint(uint64_t value)
+  {
+    reserve(10);
+    uint8_t *p = &buffer[used];
+    uint8_t *start = p;
+    while (value >= 0x80) {
+      *p++ = (value & 0x7f) | 0x80;
+      value >>= 7;
+    }
+    *p++ = value;
+    used += p - start;
+  }
+
+  void writeSignedVarint(int64_t value)
+  {
+    writeVarint((static_cast<uint64_t>(value) << 1) ^ (value >> 63));
+  }
+
+  void writeString(const char *s, size_t length);
+  void writeString(const std::string &s) { writeString(s.data(), s.size()); }
+};
+
+#endif // _TraceWriter_h_
@@ -0,0 +1,290 @@
+// Copyright (c) 2012, Richard Osborne, All rights reserved
+// This software is freely distributable under a derivative of the
+// University of Illinois/NCSA Open Source License posted in
+// LICENSE.txt and at <http://github.xcore.com/>
+
+// Microbenchmark comparing the per core decode cache, which interleaves the
+// operands and threaded dispatch entries, against the separate operands and
+// threaded dispatch arrays it replaced. Many simulated cores are run round
+// robin on a single host thread as they are by the scheduler. The cache line
+// accesses of each layout are fed through a model of the host's L1 and L2
+// data caches to count misses, then the same access pattern is timed on the
+// host.
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <ctime>
+#include <cstdlib>
+#include <cstring>
+#include <stdint.h>
+
+namespace {
+
+typedef int (*Handler)(void *);
+
+struct Operands {
+  union {
+    uint32_t ops[3];
+    uint8_t lops[6];
+  };
+};
+
+/// Mirrors DecodeCacheEntry in Core.h.
+struct DecodeCacheEntry {
+  Operands operands;
+  uint16_t threadedDispatch;
+};
+
+const unsigned lineSize = 64;
+const unsigned ramSizeShorts = 1 << 15;
+const unsigned codeSizeShorts = 1 << 14;
+const unsigned numBlocks = 512;
+const unsigned numHotBlocks = 64;
+const unsigned timeSlice = 32;
+
+/// Set associative cache with LRU replacement.
+class CacheModel {
+  unsigned numSets;
+  unsigned ways;
+  std::vector<uint64_t> tags;
+  std::vector<uint64_t> lastUse;
+  uint64_t clock;
+public:
+  uint64_t misses;
+  CacheModel(unsigned size, unsigned w) :
+    numSets(size / (lineSize * w)), ways(w), tags(numSets * w, ~uint64_t(0)),
+    lastUse(numSets * w, 0), clock(0), misses(0) {}
+  /// Returns whether the access hit.
+  bool access(uint64_t line)
+  {
+    unsigned set = line % numSets;
+    uint64_t *setTags = &tags[set * ways];
+    uint64_t *setLastUse = &lastUse[set * ways];
+    unsigned victim = 0;
+    ++clock;
+    for (unsigned i = 0; i != ways; ++i) {
+      if (setTags[i] == line) {
+        setLastUse[i] = clock;
+        return true;
+      }
+      if (setLastUse[i] < setLastUse[victim])
+        victim = i;
+    }
+    ++misses;
+    setTags[victim] = line;
+    setLastUse[victim] = clock;
+    return false;
+  }
+};
+
+class CacheHierarchy {
+public:
+  CacheModel l1;
+  CacheModel l2;
+  CacheHierarchy() : l1(32 * 1024, 8), l2(1024 * 1024, 16) {}
+  void touch(const void *p, unsigned size)
+  {
+    uintptr_t address = reinterpret_cast<uintptr_t>(p);
+    for (uintptr_t line = address / lineSize,
+         last = (address + size - 1) / lineSize; line <= last; ++line) {
+      if (!l1.access(line))
+        l2.access(line);
+    }
+  }
+};
+
+/// The original parallel arrays, kept for comparison.
+class SeparateLayout {
+  std::vector<Handler> opcode;
+  std::vector<uint16_t> threadedDispatch;
+  std::vector<Operands> operands;
+public:
+  static const char *getName() { return "separate"; }
+  static unsigned getBytesPerShort() {
+    return sizeof(Handler) + sizeof(uint16_t) + sizeof(Operands);
+  }
+  SeparateLayout() :
+    opcode(ramSizeShorts), threadedDispatch(ramSizeShorts),
+    operands(ramSizeShorts) {}
+  const Handler &getOpcode(uint32_t pc) const { return opcode[pc]; }
+  const uint16_t &getThreadedDispatch(uint32_t pc) const {
+    return threadedDispatch[pc];
+  }
+  const Operands &getOperands(uint32_t pc) const { return operands[pc]; }
+};
+
+class InterleavedLayout {
+  std::vector<Handler> opcode;
+  std::vector<char> storage;
+  DecodeCacheEntry *entries;
+public:
+  static const char *getName() { return "interleaved"; }
+  static unsigned getBytesPerShort() {
+    return sizeof(Handler) + sizeof(DecodeCacheEntry);
+  }
+  InterleavedLayout() :
+    opcode(ramSizeShorts),
+    storage(ramSizeShorts * sizeof(DecodeCacheEntry) + lineSize - 1)
+  {
+    uintptr_t address = reinterpret_cast<uintptr_t>(&storage[0]);
+    address = (address + lineSize - 1) & ~uintptr_t(lineSize - 1);
+    entries = reinterpret_cast<DecodeCacheEntry*>(address);
+  }
+  const Handler &getOpcode(uint32_t pc) const { return opcode[pc]; }
+  const uint16_t &getThreadedDispatch(uint32_t pc) const {
+    return entries[pc].threadedDispatch;
+  }
+  const Operands &getOperands(uint32_t pc) const {
+    return entries[pc].operands;
+  }
+};
+
+class Random {
+  uint32_t state;
+public:
+  Random() : state(12345) {}
+  uint32_t next()
+  {
+    state = state * 1103515245 + 12345;
+    return state >> 8;
+  }
+};
+
+/// A deterministic instruction stream per core: basic blocks of 3 to 10
+/// instructions, most branches going to a small set of hot blocks.
+struct CoreState {
+  std::vector<uint32_t> blockStart;
+  std::vector<uint32_t> blockLength;
+  uint32_t block;
+  uint32_t offset;
+};
+
+void initCores(std::vector<CoreState> &cores)
+{
+  Random random;
+  for (unsigned i = 0, e = cores.size(); i != e; ++i) {
+    CoreState &core = cores[i];
+    core.blockStart.resize(numBlocks);
+    core.blockLength.resize(numBlocks);
+    for (unsigned j = 0; j != numBlocks; ++j) {
+      core.blockStart[j] = random.next() % (codeSizeShorts - 16);
+      core.blockLength[j] = 3 + random.next() % 8;
+    }
+    core.block = 0;
+    core.offset = 0;
+  }
+}
+
+/// Step the core to its next instruction. Returns the pc of the instruction
+/// executed.
+uint32_t step(CoreState &core, Random &random)
+{
+  uint32_t pc = core.blockStart[core.block] + core.offset;
+  if (++core.offset == core.blockLength[core.block]) {
+    uint32_t r = random.next();
+    core.block = (r & 3) ? (r >> 2) % numHotBlocks : (r >> 2) % numBlocks;
+    core.offset = 0;
+  }
+  return pc;
+}
+
+/// Count the L1 and L2 misses of the interpreter's accesses to the decode
+/// cache. The threaded interpreter reads the dispatch entry and operands, the
+/// dispatch loop reads the opcode and operands.
+template <class Layout>
+void simulate(const std::vector<Layout*> &layouts, bool threaded,
+              unsigned numInstructions, CacheHierarchy &caches)
+{
+  std::vector<CoreState> cores(layouts.size());
+  initCores(cores);
+  Random random;
+  for (unsigned i = 0; i < numInstructions;) {
+    for (unsigned c = 0, e = cores.size(); c != e; ++c) {
+      const Layout &layout = *layouts[c];
+      for (unsigned j = 0; j != timeSlice; ++j, ++i) {
+        uint32_t pc = step(cores[c], random);
+        if (threaded)
+          caches.touch(&layout.getThreadedDispatch(pc), sizeof(uint16_t));
+        else
+          caches.touch(&layout.getOpcode(pc), sizeof(Handler));
+        caches.touch(&layout.getOperands(pc), sizeof(Operands));
+      }
+    }
+  }
+}
+
+/// Time the same accesses on the host. Returns the elapsed time in seconds.
+template <class Layout>
+double run(const std::vector<Layout*> &layouts, bool threaded,
+           unsigned numInstructions, uint64_t &checksum)
+{
+  std::vector<CoreState> cores(layouts.size());
+  initCores(cores);
+  Random random;
+  checksum = 0;
+  std::clock_t start = std::clock();
+  for (unsigned i = 0; i < numInstructions;) {
+    for (unsigned c = 0, e = cores.size(); c != e; ++c) {
+      const Layout &layout = *layouts[c];
+      for (unsigned j = 0; j != timeSlice; ++j, ++i) {
+        uint32_t pc = step(cores[c], random);
+        if (threaded)
+          checksum += layout.getThreadedDispatch(pc);
+        else
+          checksum += layout.getOpcode(pc) != 0;
+        checksum += layout.getOperands(pc).ops[0];
+      }
+    }
+  }
+  std::clock_t end = std::clock();
+  return double(end - start) / CLOCKS_PER_SEC;
+}
+
+template <class Layout>
+void bench(unsigned numCores, bool threaded, unsigned numInstructions)
+{
+  std::vector<Layout*> layouts;
+  for (unsigned i = 0; i != numCores; ++i)
+    layouts.push_back(new Layout);
+  CacheHierarchy caches;
+  simulate(layouts, threaded, numInstructions, caches);
+  uint64_t checksum;
+  double time = run(layouts, threaded, numInstructions, checksum);
+  double perK = 1000.0 / numInstructions;
+  std::cout << std::setw(7) << numCores
+            << std::setw(13) << Layout::getName()
+            << std::setw(10) << (threaded ? "threaded" : "loop")
+            << std::setw(12) << Layout::getBytesPerShort()
+            << std::setw(12) << std::fixed << std::setprecision(1)
+            << (caches.l1.misses * perK)
+            << std::setw(12) << (caches.l2.misses * perK)
+            << std::setw(12) << std::setprecision(2)
+            << (time * 1e9 / numInstructions) << '\n';
+  for (unsigned i = 0; i != numCores; ++i)
+    delete layouts[i];
+}
+
+} // End anonymous namespace
+
+int main(int argc, char **argv)
+{
+  unsigned numInstructions = 20000000;
+  if (argc > 1)
+    numInstructions = std::strtoul(argv[1], 0, 0);
+  std::cout << std::setw(7) << "Cores"
+            << std::setw(13) << "Layout"
+            << std::setw(10) << "Mode"
+            << std::setw(12) << "Bytes/pc"
+            << std::setw(12) << "L1 miss/1K"
+            << std::setw(12) << "L2 miss/1K"
+            << std::setw(12) << "ns/instr" << '\n';
+  const unsigned coreCounts[] = { 1, 16, 64 };
+  for (unsigned i = 0; i != sizeof(coreCounts) / sizeof(coreCounts[0]); ++i) {
+    for (unsigned threaded = 0; threaded != 2; ++threaded) {
+      bench<SeparateLayout>(coreCounts[i], threaded, numInstructions);
+      bench<InterleavedLayout>(coreCounts[i], threaded, numInstructions);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,182 @@
+// Copyright (c) 2012, Richard Osborne, All rights reserved
+// This software is freely distributable under a derivative of the
+// University of Illinois/NCSA Open Source License posted in
+// LICENSE.txt and at <http://github.xcore.com/>
+
+// Microbenchmark comparing the scheduler's RunnableQueue against the sorted
+// linked list it replaced. Uses the classic "hold" model: pop the earliest
+// runnable and push it back at a random time in the future, as a thread or
+// clocked port does when it reschedules itself.
+
+#include "RunnableQueue.h"
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <ctime>
+#include <cstdlib>
+
+namespace {
+
+/// The original sorted doubly linked list implementation, kept for
+/// comparison.
+class ListRunnableQueue {
+  struct Entry {
+    Entry *prev;
+    Entry *next;
+    Runnable *runnable;
+    Entry() : prev(0), next(0), runnable(0) {}
+  };
+  std::vector<Entry> entries;
+  Entry *head;
+
+  bool contains(Entry &e) const { return e.prev != 0 || &e == head; }
+public:
+  ListRunnableQueue(unsigned numRunnables) : entries(numRunnables), head(0) {}
+
+  Runnable &front() const { return *head->runnable; }
+  bool empty() const { return !head; }
+
+  void remove(Entry &e)
+  {
+    if (&e == head) {
+      head = e.next;
+    } else {
+      e.prev->next = e.next;
+    }
+    if (e.next)
+      e.next->prev = e.prev;
+    e.prev = 0;
+  }
+
+  void pop()
+  {
+    if (head->next)
+      head->next->prev = 0;
+    head = head->next;
+  }
+
+  void push(Runnable &r, unsigned id, ticks_t time)
+  {
+    Entry &e = entries[id];
+    e.runnable = &r;
+    if (contains(e))
+      remove(e);
+    r.wakeUpTime = time;
+    if (!head) {
+      e.next = 0;
+      head = &e;
+    } else if (time < head->runnable->wakeUpTime) {
+      head->prev = &e;
+      e.next = head;
+      head = &e;
+    } else {
+      Entry *p = head;
+      while (p->next && time >= p->next->runnable->wakeUpTime)
+        p = p->next;
+      e.prev = p;
+      e.next = p->next;
+      if (p->next)
+        p->next->prev = &e;
+      p->next = &e;
+    }
+  }
+};
+
+class BenchRunnable : public Runnable {
+public:
+  unsigned id;
+  void run(ticks_t) {}
+};
+
+/// Deterministic pseudo random delays with plenty of ties, since threads
+/// on the same core commonly wake at identical times.
+class DelayGenerator {
+  uint32_t state;
+public:
+  DelayGenerator() : state(12345) {}
+  ticks_t next()
+  {
+    state = state * 1103515245 + 12345;
+    return ((state >> 16) % 64) * 4;
+  }
+};
+
+template <class Queue>
+struct QueueOps;
+
+template <>
+struct QueueOps<RunnableQueue> {
+  static void push(RunnableQueue &q, BenchRunnable &r, ticks_t time) {
+    q.push(r, time);
+  }
+};
+
+template <>
+struct QueueOps<ListRunnableQueue> {
+  static void push(ListRunnableQueue &q, BenchRunnable &r, ticks_t time) {
+    q.push(r, r.id, time);
+  }
+};
+
+/// Run \a numOps hold operations and return the elapsed time in seconds.
+/// The sequence of popped ids is accumulated into \a checksum so the two
+/// queues can be checked to pop in the same order.
+template <class Queue>
+double runHold(Queue &queue, std::vector<BenchRunnable> &runnables,
+               unsigned numOps, uint64_t &checksum)
+{
+  DelayGenerator delays;
+  for (unsigned i = 0, e = runnables.size(); i != e; ++i) {
+    runnables[i].id = i;
+    QueueOps<Queue>::push(queue, runnables[i], delays.next());
+  }
+  checksum = 0;
+  std::clock_t start = std::clock();
+  for (unsigned i = 0; i != numOps; ++i) {
+    BenchRunnable &r = static_cast<BenchRunnable&>(queue.front());
+    ticks_t time = r.wakeUpTime;
+    queue.pop();
+    checksum = checksum * 31 + r.id;
+    QueueOps<Queue>::push(queue, r, time + delays.next());
+  }
+  std::clock_t end = std::clock();
+  return double(end - start) / CLOCKS_PER_SEC;
+}
+
+void bench(unsigned numRunnables, unsigned numOps)
+{
+  uint64_t listChecksum, heapChecksum;
+  std::vector<BenchRunnable> listRunnables(numRunnables);
+  ListRunnableQueue listQueue(numRunnables);
+  double listTime = runHold(listQueue, listRunnables, numOps, listChecksum);
+  std::vector<BenchRunnable> heapRunnables(numRunnables);
+  RunnableQueue heapQueue;
+  double heapTime = runHold(heapQueue, heapRunnables, numOps, heapChecksum);
+  std::cout << std::setw(10) << numRunnables
+            << std::setw(14) << std::fixed << std::setprecision(1)
+            << (listTime * 1e9 / numOps)
+            << std::setw(14) << (heapTime * 1e9 / numOps)
+            << std::setw(10) << std::setprecision(2)
+            << (heapTime > 0 ? listTime / heapTime : 0.0)
+            << (listChecksum == heapChecksum ? "" : "  ORDER MISMATCH")
+            << '\n';
+  if (listChecksum != heapChecksum)
+    std::exit(1);
+}
+
+} // End anonymous namespace
+
+int main(int argc, char **argv)
+{
+  unsigned numOps = 2000000;
+  if (argc > 1)
+    numOps = std::strtoul(argv[1], 0, 0);
+  std::cout << std::setw(10) << "Runnables"
+            << std::setw(14) << "List ns/op"
+            << std::setw(14) << "Heap ns/op"
+            << std::setw(10) << "Speedup" << '\n';
+  bench(10, numOps);
+  bench(100, numOps);
+  bench(10000, numOps / 20);
+  return 0;
+}
@@ -19,6 +19,7 @@
 #include <climits>
 #include <set>
 #include <map>
+#include <algorithm>
 
 #include "Stats.h"
 #include "Trace.h"
@@ -40,6 +41,7 @@
 #include "Property.h"
 #include "PortArg.h"
 #include "JIT.h"
+#include "HostThread.h"
 
 #define XCORE_ELF_MACHINE 0xB49E
 
@@ -55,8 +57,32 @@ static void printUsage(const char *ProgName) {
 "  --loopback PORT1 PORT2      Connect PORT1 to PORT2.\n"
 "  --vcd FILE                  Write VCD trace to FILE.\n"
 "  -t                          Enable instruction tracing.\n"
+"  --trace-file FILE           Write a binary instruction trace to FILE. Use\n"
+"                              axe-tracedump to print it.\n"
 "  --stats                     Enable xsim style stats.\n"
 "  -d                          Dump execution statistics.\n"
+"  --dump-json FILE            Write execution statistics as JSON to FILE.\n"
+"  --pair-profile FILE         Write counts of adjacent instructions executed\n"
+"                              by the interpreter to FILE.\n"
+"  --profile FILE              Sample the pc and call stack of running\n"
+"                              threads and write the profile to FILE.\n"
+"  --profile-format FORMAT     Select the format of the profile. FORMAT is\n"
+"                              one of callgrind (default) or pprof.\n"
+"  --profile-interval N        Take a sample every N cycles.\n"
+"  --parallel-quantum N        Run each core on its own host thread,\n"
+"                              synchronising every N cycles.\n"
+"  --no-background-jit         Compile code on the simulation thread instead\n"
+"                              of a separate host thread.\n"
+"  --jit-policy POLICY         Select which JIT tiers are used. POLICY is one\n"
+"                              of tiered (default), baseline or optimizing.\n"
+"  --jit-tier-up N             Recompile code with the optimizing tier after it\n"
+"                              has been executed N times.\n"
+"  --jit-cache DIR             Remember which code was compiled in DIR and\n"
+"                              compile it straight away in later runs.\n"
+"  --jit-cache-mb N            Evict the least recently used compiled code\n"
+"                              when it uses more than N megabytes.\n"
+"  --jit-share-code            Share compiled code between cores running the\n"
+"                              same code.\n"
 "\n"
 "Peripherals:\n";
   for (PeripheralRegistry::iterator it = PeripheralRegistry::begin(),
@@ -146,9 +172,13 @@ static xmlAttr *findAttribute(xmlNode *node, const char *name)
   return 0;
 }
 
+/// Ranges of pcs [first, second) holding code to decode before it runs.
+typedef std::vector<std::pair<uint32_t, uint32_t> > CodeRanges;
+
 static void readElf(const char *filename, const XEElfSector *elfSector,
                     Core &core, std::auto_ptr<CoreSymbolInfo> &SI,
-                    std::map<Core*,uint32_t> &entryPoints)
+                    std::map<Core*,uint32_t> &entryPoints,
+                    CodeRanges &codeRanges)
 {
   uint64_t ElfSize = elfSector->getElfSize();
   const scoped_array<char> buf(new char[ElfSize]);
@@ -191,6 +221,7 @@ static void readElf(const char *filename, const XEElfSector *elfSector,
   core.resetCaches();
   uint32_t ram_base = core.ram_base;
   uint32_t ram_size = core.getRamSize();
+  std::vector<std::pair<uint32_t, uint32_t> > executableSegments;
   for (unsigned i = 0; i < num_phdrs; i++) {
     GElf_Phdr phdr;
     if (gelf_getphdr(e, i, &phdr) == NULL) {
@@ -211,10 +242,30 @@ static void readElf(const char *filename, const XEElfSector *elfSector,
       std::exit(1);
     }
     core.writeMemory(phdr.p_paddr, &buf[phdr.p_offset], phdr.p_filesz);
+    if (phdr.p_flags & PF_X) {
+      executableSegments.push_back(
+        std::make_pair(phdr.p_paddr, phdr.p_paddr + phdr.p_filesz));
+    }
   }
 
   readSymbols(e, ram_base, ram_base + ram_size, SI);
 
+  // Decoding stops at anything which isn't an instruction. Restart it at each
+  // function in case there is data between functions.
+  for (std::vector<std::pair<uint32_t, uint32_t> >::iterator
+       it = executableSegments.begin(), end = executableSegments.end();
+       it != end; ++it) {
+    std::vector<uint32_t> starts(1, it->first);
+    if (SI.get())
+      SI->getFunctionAddresses(it->first, it->second, starts);
+    for (unsigned i = 0, e = starts.size(); i != e; i++) {
+      uint32_t rangeEnd = i + 1 != e ? starts[i + 1] : it->second;
+      if (starts[i] != rangeEnd)
+        codeRanges.push_back(std::make_pair(core.toPc(starts[i]),
+                                            core.toPc(rangeEnd)));
+    }
+  }
+
   elf_end(e);
 }
 
@@ -492,13 +543,87 @@ readXE(XE &xe, const char *filename)
   return system;
 }
 
+struct PredecodeJob {
+  Core *core;
+  const CodeRanges *ranges;
+  PredecodeJob(Core *c, const CodeRanges *r) : core(c), ranges(r) {}
+};
+
+/// The cores waiting to be decoded. Each predecode thread takes the next
+/// core from the queue until it is empty.
+class PredecodeQueue {
+  Mutex mutex;
+  std::vector<PredecodeJob> jobs;
+  unsigned next;
+public:
+  PredecodeQueue() : next(0) {}
+  void push(const PredecodeJob &job) { jobs.push_back(job); }
+  unsigned size() const { return jobs.size(); }
+  /// Returns the next job or 0 if there are none left.
+  const PredecodeJob *pop() {
+    ScopedLock lock(mutex);
+    if (next == jobs.size())
+      return 0;
+    return &jobs[next++];
+  }
+};
+
+static void runPredecodeThread(void *arg)
+{
+  PredecodeQueue *queue = static_cast<PredecodeQueue*>(arg);
+  while (const PredecodeJob *job = queue->pop()) {
+    for (CodeRanges::const_iterator it = job->ranges->begin(),
+         e = job->ranges->end(); it != e; ++it) {
+      predecodeInstructions(*job->core, it->first, it->second);
+    }
+  }
+}
+
+/// Decode the code loaded onto the cores before they start running. Each
+/// core's caches are independent so the cores are decoded in parallel by a
+/// pool of threads, one per host processor.
+static void predecodeCores(const std::set<Core*> &cores,
+                           std::map<Core*,CodeRanges> &codeRanges)
+{
+  PredecodeQueue queue;
+  for (std::set<Core*>::iterator it = cores.begin(), e = cores.end(); it != e;
+       ++it) {
+    std::map<Core*,CodeRanges>::iterator match = codeRanges.find(*it);
+    if (match != codeRanges.end())
+      queue.push(PredecodeJob(*it, &match->second));
+  }
+  // This thread is part of the pool.
+  unsigned numThreads = std::min(getHostConcurrency(), queue.size());
+  std::vector<HostThread*> threads;
+  for (unsigned i = 1; i < numThreads; i++) {
+    HostThread *thread = new HostThread;
+    if (!thread->start(&runPredecodeThread, &queue)) {
+      delete thread;
+      break;
+    }
+    threads.push_back(thread);
+  }
+  runPredecodeThread(&queue);
+  for (std::vector<HostThread*>::iterator it = threads.begin(),
+       e = threads.end(); it != e; ++it) {
+    (*it)->join();
+    delete *it;
+  }
+  for (std::set<Core*>::iterator it = cores.begin(), e = cores.end(); it != e;
+       ++it) {
+    codeRanges.erase(*it);
+  }
+}
+
 static int runCores(SystemState &sys, const std::set<Core*> &cores,
-                     const std::map<Core*,uint32_t> &entryPoints)
+                    const std::map<Core*,uint32_t> &entryPoints,
+                    std::map<Core*,CodeRanges> &codeRanges)
 {
+  predecodeCores(cores, codeRanges);
   for (std::set<Core*>::iterator it = cores.begin(), e = cores.end(); it != e;
        ++it) {
     Core *core = *it;
-    sys.schedule(core->getThread(0));
+    core->getThread(0).schedule();
     std::map<Core*,uint32_t>::const_iterator match;
     if ((match = entryPoints.find(core)) != entryPoints.end()) {
       uint32_t entryPc = core->physicalAddress(match->second) >> 1;
@@ -521,18 +646,28 @@ int
 loop(const char *filename, const LoopbackPorts &loopbackPorts,
      const std::string &vcdFile,
      const PeripheralDescriptorWithPropertiesVector &peripherals,
-     const bool xsimstats, const bool stats)
+     const bool xsimstats, const bool stats, const std::string &statsJSONFile,
+     const std::string &profileFile, Profiler::Format profileFormat,
+     ticks_t profileInterval, ticks_t parallelQuantum)
 {
   XE xe(filename);
   std::auto_ptr<SystemState> statePtr = readXE(xe, filename);
   SystemState &sys = *statePtr;
 
+  if (parallelQuantum) {
+    sys.setParallelQuantum(parallelQuantum);
+  }
+
   if (stats) {
     sys.enableStats();
   }
 
+  if (!statsJSONFile.empty()) {
+    sys.setStatsJSONFile(statsJSONFile);
+  }
+
   if (xsimstats) {
-	Stats::get().initStats(sys.node_count());
+	Stats::get().initStats(sys);
 	Stats::get().setStatsEnabled(true);
   }
   
@@ -559,7 +694,15 @@ loop(const char *filename, const LoopbackPorts &loopbackPorts,
   Tracer::get().setSymbolInfo(SIAutoPtr);
   SymbolInfo *SI = Tracer::get().getSymbolInfo();
 
+  if (!profileFile.empty()) {
+    std::auto_ptr<Profiler> profiler(new Profiler(sys, SI, profileFile,
+                                                  profileFormat,
+                                                  profileInterval));
+    sys.setProfiler(profiler);
+  }
+
   std::map<Core*,uint32_t> entryPoints;
+  std::map<Core*,CodeRanges> codeRanges;
   std::set<Core*> gotoSectors;
   std::set<Core*> callSectors;
   for (std::vector<const XESector *>::const_iterator
@@ -579,16 +722,16 @@ loop(const char *filename, const LoopbackPorts &loopbackPorts,
         }
         if (gotoSectors.count(core)) {
           // Shouldn't happen.
-          return runCores(sys, gotoSectors, entryPoints);
+          return runCores(sys, gotoSectors, entryPoints, codeRanges);
         }
         if (callSectors.count(core)) {
-          int status = runCores(sys, callSectors, entryPoints);
+          int status = runCores(sys, callSectors, entryPoints, codeRanges);
           if (status != 0)
             return status;
           callSectors.clear();
         }
         std::auto_ptr<CoreSymbolInfo> CSI;
-        readElf(filename, elfSector, *core, CSI, entryPoints);
+        readElf(filename, elfSector, *core, CSI, entryPoints, codeRanges[core]);
         SI->add(core, CSI);
         // TODO check old instructions are cleared.
 
@@ -614,7 +757,7 @@ loop(const char *filename, const LoopbackPorts &loopbackPorts,
         static_cast<const XECallOrGotoSector*>(*it);
         if (!gotoSectors.empty()) {
           // Shouldn't happen.
-          return runCores(sys, gotoSectors, entryPoints);
+          return runCores(sys, gotoSectors, entryPoints, codeRanges);
         }
         unsigned jtagIndex = callSector->getNode();
         unsigned coreNum = callSector->getCore();
@@ -625,7 +768,7 @@ loop(const char *filename, const LoopbackPorts &loopbackPorts,
           std::exit(1);
         }
         if (!callSectors.insert(core).second) {
-          int status = runCores(sys, callSectors, entryPoints);
+          int status = runCores(sys, callSectors, entryPoints, codeRanges);
           if (status != 0)
             return status;
           callSectors.clear();
@@ -639,7 +782,7 @@ loop(const char *filename, const LoopbackPorts &loopbackPorts,
           static_cast<const XECallOrGotoSector*>(*it);
         if (!callSectors.empty()) {
           // Handle calls.
-          int status = runCores(sys, callSectors, entryPoints);
+          int status = runCores(sys, callSectors, entryPoints, codeRanges);
           if (status != 0)
             return status;
           callSectors.clear();
@@ -654,18 +797,18 @@ loop(const char *filename, const LoopbackPorts &loopbackPorts,
         }
         if (!gotoSectors.insert(core).second) {
           // Shouldn't happen.
-          return runCores(sys, gotoSectors, entryPoints);
+          return runCores(sys, gotoSectors, entryPoints, codeRanges);
         }
       }
       break;
     }
   }
   if (!gotoSectors.empty()) {
-    return runCores(sys, gotoSectors, entryPoints);
+    return runCores(sys, gotoSectors, entryPoints, codeRanges);
   }
   if (!callSectors.empty()) {
     // Shouldn't happen.
-    return runCores(sys, callSectors, entryPoints);
+    return runCores(sys, callSectors, entryPoints, codeRanges);
   }
   return 0;
 }
@@ -787,18 +930,40 @@ main(int argc, char **argv) {
   bool tracing = false;
   bool xsimstats = false;
   bool stats = false;
+  ticks_t parallelQuantum = 0;
   LoopbackPorts loopbackPorts;
   std::string vcdFile;
+  std::string pairProfileFile;
+  std::string statsJSONFile;
+  std::string traceFile;
+  std::string profileFile;
+  Profiler::Format profileFormat = Profiler::CALLGRIND;
+  ticks_t profileInterval = PROFILE_DEFAULT_INTERVAL;
   std::string arg;
   std::vector<std::pair<PeripheralDescriptor*, Properties> > peripherals;
   for (int i = 1; i < argc; i++) {
     arg = argv[i];
     if (arg == "-t") {
       tracing = true;
+    } else if (arg == "--trace-file") {
+      if (i + 1 >= argc) {
+        printUsage(argv[0]);
+        return 1;
+      }
+      traceFile = argv[i + 1];
+      tracing = true;
+      i++;
     } else if (arg == "--stats") {
       xsimstats = true;
     } else if (arg == "-d") {
       stats = true;
+    } else if (arg == "--dump-json") {
+      if (i + 1 >= argc) {
+        printUsage(argv[0]);
+        return 1;
+      }
+      statsJSONFile = argv[i + 1];
+      i++;
     } else if (arg == "--vcd") {
       if (i + 1 > argc) {
         printUsage(argv[0]);
@@ -806,6 +971,47 @@ main(int argc, char **argv) {
       }
       vcdFile = argv[i + 1];
       i++;
+    } else if (arg == "--pair-profile") {
+      if (i + 1 >= argc) {
+        printUsage(argv[0]);
+        return 1;
+      }
+      pairProfileFile = argv[i + 1];
+      i++;
+    } else if (arg == "--profile") {
+      if (i + 1 >= argc) {
+        printUsage(argv[0]);
+        return 1;
+      }
+      profileFile = argv[i + 1];
+      i++;
+    } else if (arg == "--profile-format") {
+      if (i + 1 >= argc) {
+        printUsage(argv[0]);
+        return 1;
+      }
+      std::string format = argv[i + 1];
+      if (format == "callgrind") {
+        profileFormat = Profiler::CALLGRIND;
+      } else if (format == "pprof") {
+        profileFormat = Profiler::PPROF;
+      } else {
+        std::cerr << "Error: unknown profile format \"" << format << "\"\n";
+        return 1;
+      }
+      i++;
+    } else if (arg == "--profile-interval") {
+      if (i + 1 >= argc) {
+        printUsage(argv[0]);
+        return 1;
+      }
+      char *endp;
+      profileInterval = std::strtoul(argv[i + 1], &endp, 0);
+      if (*endp != '\0' || profileInterval == 0) {
+        std::cerr << "Error: invalid interval \"" << argv[i + 1] << "\"\n";
+        return 1;
+      }
+      i++;
     } else if (arg == "--loopback") {
       if (i + 2 >= argc) {
         printUsage(argv[0]);
@@ -813,6 +1019,72 @@ main(int argc, char **argv) {
       }
       loopbackOption(argv[i + 1], argv[i + 2], loopbackPorts);
       i += 2;
+    } else if (arg == "--parallel-quantum") {
+      if (i + 1 >= argc) {
+        printUsage(argv[0]);
+        return 1;
+      }
+      char *endp;
+      parallelQuantum = std::strtoul(argv[i + 1], &endp, 0);
+      if (*endp != '\0' || parallelQuantum == 0) {
+        std::cerr << "Error: invalid quantum \"" << argv[i + 1] << "\"\n";
+        return 1;
+      }
+      i++;
+    } else if (arg == "--no-background-jit") {
+      JIT::setBackgroundCompilation(false);
+    } else if (arg == "--jit-policy") {
+      if (i + 1 >= argc) {
+        printUsage(argv[0]);
+        return 1;
+      }
+      std::string policy = argv[i + 1];
+      if (policy == "tiered") {
+        JIT::setTierPolicy(JIT::TIERED);
+      } else if (policy == "baseline") {
+        JIT::setTierPolicy(JIT::BASELINE_ONLY);
+      } else if (policy == "optimizing") {
+        JIT::setTierPolicy(JIT::OPTIMIZING_ONLY);
+      } else {
+        std::cerr << "Error: unknown JIT policy \"" << policy << "\"\n";
+        return 1;
+      }
+      i++;
+    } else if (arg == "--jit-tier-up") {
+      if (i + 1 >= argc) {
+        printUsage(argv[0]);
+        return 1;
+      }
+      char *endp;
+      unsigned long threshold = std::strtoul(argv[i + 1], &endp, 0);
+      if (*endp != '\0' || threshold == 0 || threshold > INT_MAX) {
+        std::cerr << "Error: invalid threshold \"" << argv[i + 1] << "\"\n";
+        return 1;
+      }
+      JIT::setTierUpThreshold(threshold);
+      i++;
+    } else if (arg == "--jit-cache") {
+      if (i + 1 >= argc) {
+        printUsage(argv[0]);
+        return 1;
+      }
+      JIT::setCacheDirectory(argv[i + 1]);
+      i++;
+    } else if (arg == "--jit-cache-mb") {
+      if (i + 1 >= argc) {
+        printUsage(argv[0]);
+        return 1;
+      }
+      char *endp;
+      unsigned long size = std::strtoul(argv[i + 1], &endp, 0);
+      if (*endp != '\0' || size == 0 || size > 4095) {
+        std::cerr << "Error: invalid cache size \"" << argv[i + 1] << "\"\n";
+        return 1;
+      }
+      JIT::setCodeCacheLimit(size << 20);
+      i++;
+    } else if (arg == "--jit-share-code") {
+      JIT::setCodeSharing(true);
     } else if (arg == "--help") {
       printUsage(argv[0]);
       return 0;
@@ -833,13 +1105,32 @@ main(int argc, char **argv) {
     printUsage(argv[0]);
     return 1;
   }
+  // Ports, tracers and stats are shared between cores and aren't safe to use
+  // from multiple host threads.
+  if (parallelQuantum && (tracing || xsimstats || !pairProfileFile.empty() ||
+                          !profileFile.empty() || !vcdFile.empty() ||
+                          !loopbackPorts.empty() || !peripherals.empty())) {
+    std::cerr << "Error: --parallel-quantum can't be used with -t, "
+                 "--trace-file, --stats, --pair-profile, --profile, --vcd, "
+                 "--loopback or peripherals\n";
+    return 1;
+  }
 #ifndef _WIN32
   if (isatty(fileno(stdout))) {
     Tracer::get().setColour(true);
   }
 #endif
+  if (!traceFile.empty() && !Tracer::get().setTraceFile(traceFile)) {
+    std::cerr << "Error: cannot open " << traceFile << std::endl;
+    return 1;
+  }
   if (tracing) {
     Tracer::get().setTracingEnabled(tracing);
   }
-  return loop(file, loopbackPorts, vcdFile, peripherals, xsimstats, stats);
+  if (!pairProfileFile.empty()) {
+    Stats::get().setPairProfileFile(pairProfileFile);
+  }
+  return loop(file, loopbackPorts, vcdFile, peripherals, xsimstats, stats,
+              statsJSONFile, profileFile, profileFormat, profileInterval,
+              parallelQuantum);
 }
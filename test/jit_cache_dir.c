@@ -0,0 +1,34 @@
+// RUN: xcc -target=XC-5 %s -o %t1.xe
+// RUN: rm -rf %t.dir
+// RUN: mkdir %t.dir
+// RUN: axe --jit-cache %t.dir %t1.xe > %t2.txt
+// RUN: grep -x "checksum 0xeb17e473" %t2.txt
+// RUN: axe --jit-cache %t.dir -d %t1.xe > %t3.txt
+// RUN: grep -x "checksum 0xeb17e473" %t3.txt
+// RUN: grep "JIT regions from cache: *[1-9]" %t3.txt
+
+// The first run writes the regions it compiled to the cache directory. The
+// second run compiles them as soon as the program is loaded and must still
+// print the same result.
+
+#include <stdio.h>
+
+__attribute__((noinline)) static unsigned mix(unsigned x, unsigned i)
+{
+  x = x * 1103515245u + i;
+  return x ^ (x >> 13);
+}
+
+int main()
+{
+  unsigned x = 0;
+  unsigned i;
+  for (i = 0; i < 10000; i++) {
+    if (i & 1)
+      x = mix(x, i);
+    else
+      x += i;
+  }
+  printf("checksum 0x%x\n", x);
+  return 0;
+}
@@ -0,0 +1,72 @@
+// RUN: xcc -target=XC-5 %s -o %t1.xe
+// RUN: axe %t1.xe > %t2.txt
+// RUN: grep -x "checksum 0xc068d4e4" %t2.txt
+// RUN: axe --jit-cache-mb 1 %t1.xe > %t3.txt
+// RUN: cmp %t2.txt %t3.txt
+// RUN: axe --jit-cache-mb 1 -d %t1.xe > %t4.txt
+// RUN: grep "JIT functions evicted: *[1-9]" %t4.txt
+
+// Calls enough different functions often enough for the compiled code to
+// exceed the code cache limit. Functions are evicted while their callers
+// are still compiled and while return address stacks refer to them.
+
+#include <stdio.h>
+
+#define LEAF(n) \
+__attribute__((noinline)) static unsigned leaf##n(unsigned x) \
+{ \
+  x = x * 1103515245u + n; \
+  x ^= x >> 7; \
+  x += x << 3; \
+  return x ^ (x >> 11); \
+}
+
+#define GROUP(n) \
+LEAF(n##0) LEAF(n##1) LEAF(n##2) LEAF(n##3) LEAF(n##4) \
+LEAF(n##5) LEAF(n##6) LEAF(n##7) LEAF(n##8) LEAF(n##9) \
+__attribute__((noinline)) static unsigned group##n(unsigned x) \
+{ \
+  x = leaf##n##0(x); x = leaf##n##1(x); x = leaf##n##2(x); \
+  x = leaf##n##3(x); x = leaf##n##4(x); x = leaf##n##5(x); \
+  x = leaf##n##6(x); x = leaf##n##7(x); x = leaf##n##8(x); \
+  return leaf##n##9(x); \
+}
+
+#define GROUPS(n) \
+GROUP(n##0) GROUP(n##1) GROUP(n##2) GROUP(n##3) GROUP(n##4) \
+GROUP(n##5) GROUP(n##6) GROUP(n##7) GROUP(n##8) GROUP(n##9)
+
+GROUPS(1)
+GROUPS(2)
+GROUPS(3)
+GROUPS(4)
+GROUPS(5)
+GROUPS(6)
+GROUPS(7)
+GROUPS(8)
+GROUPS(9)
+
+#define CALL_GROUPS(n) \
+x = group##n##0(x); x = group##n##1(x); x = group##n##2(x); \
+x = group##n##3(x); x = group##n##4(x); x = group##n##5(x); \
+x = group##n##6(x); x = group##n##7(x); x = group##n##8(x); \
+x = group##n##9(x);
+
+int main()
+{
+  unsigned x = 0;
+  int i;
+  for (i = 0; i < 200; i++) {
+    CALL_GROUPS(1)
+    CALL_GROUPS(2)
+    CALL_GROUPS(3)
+    CALL_GROUPS(4)
+    CALL_GROUPS(5)
+    CALL_GROUPS(6)
+    CALL_GROUPS(7)
+    CALL_GROUPS(8)
+    CALL_GROUPS(9)
+  }
+  printf("checksum 0x%x\n", x);
+  return 0;
+}
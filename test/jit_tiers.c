@@ -0,0 +1,43 @@
+// RUN: xcc -target=XC-5 %s -o %t1.xe
+// RUN: axe %t1.xe > %t2.txt
+// RUN: grep -x "checksum 0xb0be12e5" %t2.txt
+// RUN: axe --jit-policy tiered --jit-tier-up 1 -d %t1.xe > %t3.txt
+// RUN: grep -x "checksum 0xb0be12e5" %t3.txt
+// RUN: grep "JIT regions tiered up: *[1-9]" %t3.txt
+// RUN: axe --jit-policy baseline %t1.xe > %t4.txt
+// RUN: cmp %t2.txt %t4.txt
+// RUN: axe --jit-policy optimizing %t1.xe > %t5.txt
+// RUN: cmp %t2.txt %t5.txt
+
+// The loops run often enough for baseline code to be replaced by optimized
+// code with both the default and the lowest tier up threshold. Each policy
+// must compute the same result.
+
+#include <stdio.h>
+
+#define SIZE 64
+
+static unsigned data[SIZE];
+
+__attribute__((noinline)) static unsigned step(unsigned x, unsigned i)
+{
+  if (x & 1)
+    return (x >> 1) ^ 0xedb88320u;
+  return (x >> 1) + i;
+}
+
+int main()
+{
+  unsigned x = 0;
+  unsigned i, j;
+  for (i = 0; i < SIZE; i++)
+    data[i] = i * 0x9e3779b9u;
+  for (i = 0; i < 1000; i++) {
+    for (j = 0; j < SIZE; j++) {
+      x = step(x ^ data[j], j);
+      data[j] += x;
+    }
+  }
+  printf("checksum 0x%x\n", x);
+  return 0;
+}
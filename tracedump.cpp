@@ -0,0 +1,102 @@
+// Copyright (c) 2012, Richard Osborne, All rights reserved
+// This software is freely distributable under a derivative of the
+// University of Illinois/NCSA Open Source License posted in
+// LICENSE.txt and at <http://github.xcore.com/>
+
+// Print a binary trace written by axe --trace-file in the same format as
+// the textual trace written by axe -t.
+
+#include "TraceFormat.h"
+#include "TraceDumper.h"
+#include "ScopedArray.h"
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <stdint.h>
+
+using namespace TraceFormat;
+
+namespace {
+
+const size_t readBufferSize = 1 << 16;
+
+class FileTraceReader : public TraceReader {
+  std::FILE *file;
+  std::string path;
+  scoped_array<uint8_t> buffer;
+protected:
+  bool refill(const uint8_t *&begin, const uint8_t *&end);
+public:
+  FileTraceReader(std::FILE *f, const std::string &p) :
+    file(f), path(p), buffer(new uint8_t[readBufferSize]) {}
+  void error(const char *message);
+};
+
+} // End anonymous namespace
+
+bool FileTraceReader::refill(const uint8_t *&begin, const uint8_t *&end)
+{
+  size_t size = std::fread(buffer.get(), 1, readBufferSize, file);
+  begin = buffer.get();
+  end = begin + size;
+  return size != 0;
+}
+
+void FileTraceReader::error(const char *message)
+{
+  std::cerr << "Error: " << path << ": " << message << std::endl;
+  std::exit(1);
+}
+
+static void printUsage(const char *ProgName)
+{
+  std::cout << "Usage: " << ProgName << " [options] filename\n";
+  std::cout <<
+"Print a binary trace written by axe --trace-file as text.\n"
+"\n"
+"Options:\n"
+"  -help                       Display this information.\n"
+"  --time                      Print the time of each instruction.\n";
+}
+
+int main(int argc, char **argv)
+{
+  const char *file = 0;
+  bool showTime = false;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--time") {
+      showTime = true;
+    } else if (arg == "-help" || arg == "--help") {
+      printUsage(argv[0]);
+      return 0;
+    } else if (!file) {
+      file = argv[i];
+    } else {
+      printUsage(argv[0]);
+      return 1;
+    }
+  }
+  if (!file) {
+    printUsage(argv[0]);
+    return 1;
+  }
+  std::FILE *f = std::fopen(file, "rb");
+  if (!f) {
+    std::cerr << "Error: cannot open " << file << std::endl;
+    return 1;
+  }
+  FileTraceReader reader(f, file);
+  for (unsigned i = 0; i != magicSize; ++i) {
+    if (reader.atEnd() || reader.readByte() != (uint8_t)magic[i])
+      reader.error("not a trace file");
+  }
+  if (reader.readVarint() != version)
+    reader.error("unsupported trace version");
+  std::ios_base::sync_with_stdio(false);
+  TraceDumper dumper(reader, std::cout, TerminalColours::null, showTime);
+  dumper.dump();
+  std::fclose(f);
+  return 0;
+}